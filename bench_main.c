@@ -0,0 +1,1154 @@
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "parser.h"
+#include "library.h"
+#include "song_pack.h"
+#include "alterations.h"
+#include "remap_kernels.h"
+#include "playback.h"
+#include "compact_track.h"
+#include "payload_pool.h"
+#include "smf_generator.h"
+#include "song_writer.h"
+#include "file_reader.h"
+
+#define USAGE \
+"Usage instructions:\n\n"\
+"  flags:\n"\
+"    -d directory_path   Reads in all of the .mid files in the specified"\
+" directory and benchmarks them.\n"\
+"    -r rounds           Number of times each timed section is repeated"\
+" (default 5).\n"\
+"    -L threads          Threads parsing songs while playback is measured a"\
+" second time under load (default one per core).\n"\
+"    -i                  Shares identical meta and SysEx payloads of every"\
+" song in one pool and reports the bytes saved.\n"\
+"    -g directory_path   Generates a synthetic corpus in the specified"\
+" directory and benchmarks parse, free, library build, alterations and"\
+" write on it.\n"\
+"    -n files            Number of synthetic songs (default 16).\n"\
+"    -t tracks           Tracks per synthetic song (default 8).\n"\
+"    -e events           Channel events per synthetic track (default"\
+" 2000).\n"\
+"    -s percent          Share of repeated statuses written with running"\
+" status (default 50).\n"\
+"    -x bytes            SysEx size per synthetic track, 0 for none"\
+" (default 64).\n"\
+"    -m changes          Tempo changes per synthetic song (default 16).\n"\
+"    -S seed             Seed of the first synthetic song (default 1).\n"\
+"    -j json_path        Writes the synthetic results as JSON.\n"\
+"    -c json_path        Compares the synthetic results with a previous"\
+" JSON file and fails if any rate dropped or heap use grew too far.\n"\
+"    -T percent          Largest drop -c accepts (default 10).\n"\
+"    -A percent          Largest growth in heap bytes per event -c accepts"\
+" (default 10).\n"\
+"    -h                  Display information on the options and"\
+" arguments supported.\n\n"\
+"  example usage:\n"\
+"    ./bench_main -d \"songs\"\n"\
+"        Reports packed and compact song size, decode and scan throughput,\n"\
+"        alteration throughput, melody search time and playback timing over\n"\
+"        ./songs\n"\
+"    ./bench_main -g \"/tmp/synth\" -j new.json -c old.json\n"\
+"        Benchmarks a synthetic corpus and fails on regressions since\n"\
+"        old.json\n"\
+
+#define DEFAULT_ROUNDS (5)
+#define MAX_SONGS (1 << 16)
+//  Each song is played this much faster for this long
+#define PLAYBACK_SPEED (8.0)
+#define PLAYBACK_WINDOW_US (100000)
+#define MELODY_QUERY_NOTES (8)
+#define CACHE_LINE (64)
+#define NOTE_ON_KIND (0x90)
+#define KIND_MASK (0xF0)
+#define DEFAULT_GEN_FILES (16)
+#define DEFAULT_TOLERANCE (10)
+#define DEFAULT_HEAP_TOLERANCE (10)
+//  Growth in heap bytes per event below which -c ignores a change, so a
+//  step that allocates nothing is not failed by a few stray bytes
+#define HEAP_SLACK (0.5)
+//  Passed to add_result() for steps whose heap use is meaningless
+#define HEAP_NOT_MEASURED (-1)
+#define MAX_RESULTS (16)
+#define PATH_LENGTH (4096)
+#define NAME_LENGTH (64)
+#define LINE_LENGTH (512)
+#define BYTES_PER_MB (1e6)
+
+//  Rates of one step of the synthetic suite, 0 where they do not apply
+typedef struct bench_result_s {
+  const char *name;
+  double events_per_sec;
+  double mb_per_sec;
+  //  Growth of the heap per event while the step's results are alive, if
+  //  has_heap is set
+  double heap_per_event;
+  bool has_heap;
+} bench_result_t;
+
+typedef struct synthetic_s {
+  const char *directory;
+  int num_files;
+  smf_params_t params;
+  int rounds;
+  char **paths;
+  uint64_t events;
+  uint64_t bytes;
+  int num_results;
+  bench_result_t results[MAX_RESULTS];
+} synthetic_t;
+
+//  Songs parsed in a loop by parse_load_worker() while playback is measured
+typedef struct parse_load_s {
+  char **paths;
+  int count;
+  int stop;
+  uint64_t parsed;
+} parse_load_t;
+
+typedef struct corpus_s {
+  tree_node_t *nodes[MAX_SONGS];
+  int count;
+} corpus_t;
+
+/*
+ * returns the current monotonic time in seconds
+ */
+
+double now_seconds() {
+  struct timespec spec;
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+  return spec.tv_sec + spec.tv_nsec / 1e9;
+} /* now_seconds() */
+
+/*
+ * adds the node to the corpus
+ */
+
+void collect_node(tree_node_t *node, corpus_t *corpus) {
+  assert(corpus->count < MAX_SONGS);
+  corpus->nodes[corpus->count++] = node;
+} /* collect_node() */
+
+/*
+ * returns the number of bytes used by the expanded events of a song
+ */
+
+uint64_t expanded_size(song_data_t *song, uint64_t *events) {
+  uint64_t size = sizeof(song_data_t);
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    size += sizeof(track_node_t) + sizeof(track_t);
+    event_node_t *list = track_list->track->event_list;
+    while (list) {
+      event_t *event = list->event;
+      size += sizeof(event_node_t) + sizeof(event_t);
+      if (event->type == META_EVENT) {
+        size += event->meta_event.data_len;
+      }
+      else if ((event->type == SYS_EVENT_1) ||
+          (event->type == SYS_EVENT_2)) {
+        size += event->sys_event.data_len;
+      }
+      else {
+        size += event->midi_event.data_len;
+      }
+      (*events)++;
+      list = list->next_event;
+    }
+    track_list = track_list->next_track;
+  }
+  return size;
+} /* expanded_size() */
+
+/*
+ * reports bytes per event of the expanded and packed forms, and the time it
+ * takes to expand packed songs back into events
+ */
+
+void bench_pack(corpus_t *corpus, int rounds) {
+  uint64_t file_bytes = 0;
+  uint64_t expanded_bytes = 0;
+  uint64_t packed_bytes = 0;
+  uint64_t events = 0;
+  for (int i = 0; i < corpus->count; i++) {
+    struct stat info;
+    if (stat(corpus->nodes[i]->song->path, &info) == 0) {
+      file_bytes += info.st_size;
+    }
+    expanded_bytes += expanded_size(corpus->nodes[i]->song, &events);
+  }
+
+  double pack_time = 0;
+  double unpack_time = 0;
+  for (int round = 0; round < rounds; round++) {
+    double start = now_seconds();
+    pack_library(g_song_library);
+    pack_time += now_seconds() - start;
+    if (round == 0) {
+      for (int i = 0; i < corpus->count; i++) {
+        packed_bytes += packed_song_size(corpus->nodes[i]->packed);
+      }
+    }
+    start = now_seconds();
+    for (int i = 0; i < corpus->count; i++) {
+      node_song(corpus->nodes[i]);
+    }
+    unpack_time += now_seconds() - start;
+  }
+
+  if (events == 0) {
+    printf("no events\n");
+    return;
+  }
+  printf("songs:                %d\n", corpus->count);
+  printf("events:               %lu\n", events);
+  printf("smf bytes/event:      %.2f\n", (double) file_bytes / events);
+  printf("expanded bytes/event: %.2f\n", (double) expanded_bytes / events);
+  printf("packed bytes/event:   %.2f\n", (double) packed_bytes / events);
+  printf("pack events/sec:      %.0f\n", events * rounds / pack_time);
+  printf("decode events/sec:    %.0f\n", events * rounds / unpack_time);
+  if (g_payload_pool) {
+    uint64_t referenced = 0;
+    uint64_t pooled = pool_memory(g_payload_pool, &referenced);
+    printf("distinct payloads:    %u\n", g_payload_pool->num_payloads);
+    printf("payload bytes:        %lu\n", referenced);
+    printf("pooled payload bytes: %lu\n", pooled);
+  }
+} /* bench_pack() */
+
+/*
+ * single-event octave shift, as apply_to_events used to be called with
+ */
+
+int octave_event(event_t *event, void *octave) {
+  return change_event_octave(event, (int *) octave);
+} /* octave_event() */
+
+/*
+ * single-event note remapping, as apply_to_events used to be called with
+ */
+
+int note_event(event_t *event, void *table) {
+  return change_event_note(event, table);
+} /* note_event() */
+
+/*
+ * single-event instrument remapping, as apply_to_events used to be called
+ * with
+ */
+
+int instrument_event(event_t *event, void *table) {
+  return change_event_instrument(event, table);
+} /* instrument_event() */
+
+/*
+ * compares the size of expanded and compact events, and how fast a scan
+ * over every event counting sounding Note Ons runs on each
+ */
+
+void bench_compact(corpus_t *corpus, int rounds) {
+  int num_tracks = 0;
+  for (int i = 0; i < corpus->count; i++) {
+    track_node_t *track_list = node_song(corpus->nodes[i])->track_list;
+    while (track_list) {
+      num_tracks++;
+      track_list = track_list->next_track;
+    }
+  }
+  compact_track_t **compacts = malloc(sizeof(compact_track_t *) *
+      (num_tracks ? num_tracks : 1));
+  assert(compacts);
+  uint64_t events = 0;
+  uint64_t expanded_bytes = 0;
+  uint64_t compact_bytes = 0;
+  int count = 0;
+  for (int i = 0; i < corpus->count; i++) {
+    song_data_t *song = corpus->nodes[i]->song;
+    expanded_bytes += expanded_size(song, &events);
+    track_node_t *track_list = song->track_list;
+    while (track_list) {
+      compact_track_t *compact = compact_track(track_list->track);
+      compact_bytes += sizeof(compact_track_t) + compact->pool_size +
+        sizeof(compact_event_t) * compact->num_events;
+      compacts[count++] = compact;
+      track_list = track_list->next_track;
+    }
+  }
+
+  uint64_t list_notes = 0;
+  uint64_t compact_notes = 0;
+  double list_time = 0;
+  double compact_time = 0;
+  for (int round = 0; round < rounds; round++) {
+    double start = now_seconds();
+    for (int i = 0; i < corpus->count; i++) {
+      track_node_t *track_list = corpus->nodes[i]->song->track_list;
+      while (track_list) {
+        event_node_t *list = track_list->track->event_list;
+        while (list) {
+          event_t *event = list->event;
+          list_notes += (event_type(event) == MIDI_EVENT_T) &&
+            ((event->midi_event.status & KIND_MASK) == NOTE_ON_KIND) &&
+            (event->midi_event.data[1] != 0);
+          list = list->next_event;
+        }
+        track_list = track_list->next_track;
+      }
+    }
+    list_time += now_seconds() - start;
+    start = now_seconds();
+    for (int i = 0; i < count; i++) {
+      compact_event_t *event = compacts[i]->events;
+      compact_event_t *end = event + compacts[i]->num_events;
+      for (; event < end; event++) {
+        compact_notes += ((event->status & KIND_MASK) == NOTE_ON_KIND) &&
+          (event->data[1] != 0);
+      }
+    }
+    compact_time += now_seconds() - start;
+  }
+  assert(list_notes == compact_notes);
+
+  for (int i = 0; i < count; i++) {
+    free_compact_track(compacts[i]);
+    compacts[i] = NULL;
+  }
+  free(compacts);
+  compacts = NULL;
+  if (events == 0) {
+    return;
+  }
+  printf("expanded events/cache line:       %.2f\n", (double) CACHE_LINE /
+      (sizeof(event_node_t) + sizeof(event_t)));
+  printf("compact events/cache line:        %.2f\n", (double) CACHE_LINE /
+      sizeof(compact_event_t));
+  printf("compact bytes/event:              %.2f\n",
+      (double) compact_bytes / events);
+  printf("expanded scan events/sec:         %.0f\n",
+      events * rounds / list_time);
+  printf("compact scan events/sec:          %.0f\n",
+      events * rounds / compact_time);
+} /* bench_compact() */
+
+/*
+ * compares the public wrappers, which also check shared tracks before
+ * copying them, against the plain per-event apply_to_events path, and the
+ * column kernels on their own
+ */
+
+void bench_remap(corpus_t *corpus, int rounds) {
+  uint64_t events = 0;
+  for (int i = 0; i < corpus->count; i++) {
+    expanded_size(node_song(corpus->nodes[i]), &events);
+  }
+  double event_time = 0;
+  double column_time = 0;
+  int up = 1;
+  int down = -1;
+  for (int round = 0; round < rounds; round++) {
+    double start = now_seconds();
+    for (int i = 0; i < corpus->count; i++) {
+      song_data_t *song = corpus->nodes[i]->song;
+      apply_to_events(song, octave_event, &up);
+      apply_to_events(song, octave_event, &down);
+      apply_to_events(song, note_event, N_LOWER);
+      apply_to_events(song, instrument_event, I_BRASS_BAND);
+    }
+    event_time += now_seconds() - start;
+    start = now_seconds();
+    for (int i = 0; i < corpus->count; i++) {
+      song_data_t *song = corpus->nodes[i]->song;
+      change_octave(song, up);
+      change_octave(song, down);
+      remap_notes(song, N_LOWER);
+      remap_instruments(song, I_BRASS_BAND);
+    }
+    column_time += now_seconds() - start;
+  }
+  if (events == 0) {
+    return;
+  }
+  printf("apply_to_events remap events/sec: %.0f\n",
+      events * 4.0 * rounds / event_time);
+  printf("wrapper remap events/sec:         %.0f\n",
+      events * 4.0 * rounds / column_time);
+
+  //  The kernels on their own, over columns that are already packed
+  uint8_t *status = malloc(events);
+  uint8_t *data = malloc(events);
+  assert(status && data);
+  uint64_t count = 0;
+  for (int i = 0; i < corpus->count; i++) {
+    track_node_t *track_list = corpus->nodes[i]->song->track_list;
+    while (track_list) {
+      event_node_t *list = track_list->track->event_list;
+      while (list) {
+        status[count] = list->event->type;
+        data[count] = 0;
+        if ((status[count] >= MIDI_MIN) && (status[count] < SYS_EVENT_1)) {
+          data[count] = list->event->midi_event.data[0];
+        }
+        count++;
+        list = list->next_event;
+      }
+      track_list = track_list->next_track;
+    }
+  }
+  double scalar_time = 0;
+  double kernel_time = 0;
+  for (int round = 0; round < rounds; round++) {
+    double start = now_seconds();
+    shift_column_scalar(status, data, count, OCTAVE_STEP, MIDI_MIN,
+        NOTE_EVENT_MAX);
+    remap_column_scalar(status, data, count, N_LOWER, MIDI_MIN,
+        NOTE_EVENT_MAX);
+    scalar_time += now_seconds() - start;
+    start = now_seconds();
+    shift_column(status, data, count, -OCTAVE_STEP, MIDI_MIN,
+        NOTE_EVENT_MAX);
+    remap_column(status, data, count, N_LOWER, MIDI_MIN, NOTE_EVENT_MAX);
+    kernel_time += now_seconds() - start;
+  }
+  printf("scalar column events/sec:         %.0f\n",
+      count * 2.0 * rounds / scalar_time);
+  printf("simd column events/sec:           %.0f\n",
+      count * 2.0 * rounds / kernel_time);
+  free(status);
+  status = NULL;
+  free(data);
+  data = NULL;
+} /* bench_remap() */
+
+/*
+ * counts the emitted events
+ */
+
+void count_event(playback_sink_t *sink, playback_event_t *event,
+    uint64_t now_us) {
+  (*(uint64_t *) sink->data)++;
+} /* count_event() */
+
+/*
+ * parses the songs of the load over and over until it is stopped
+ */
+
+void *parse_load_worker(void *data) {
+  parse_load_t *load = data;
+  int i = 0;
+  while (!__atomic_load_n(&load->stop, __ATOMIC_ACQUIRE)) {
+    free_song(parse_file(load->paths[i]));
+    __atomic_fetch_add(&load->parsed, 1, __ATOMIC_RELAXED);
+    i = (i + 1) % load->count;
+  }
+  return NULL;
+} /* parse_load_worker() */
+
+/*
+ * plays the start of every song at PLAYBACK_SPEED into a counting sink while
+ * load_threads threads parse the corpus, none to measure an idle machine,
+ * and reports how late events were emitted and how much that varied
+ */
+
+void bench_playback(corpus_t *corpus, int load_threads) {
+  parse_load_t load = {0};
+  pthread_t *threads = NULL;
+  if (load_threads > 0) {
+    load.count = corpus->count;
+    load.paths = malloc(sizeof(char *) * load.count);
+    assert(load.paths);
+    for (int i = 0; i < load.count; i++) {
+      load.paths[i] = strdup(node_song(corpus->nodes[i])->path);
+      assert(load.paths[i]);
+    }
+    threads = malloc(sizeof(pthread_t) * load_threads);
+    assert(threads);
+    for (int i = 0; i < load_threads; i++) {
+      int create_return = pthread_create(&threads[i], NULL,
+          parse_load_worker, &load);
+      assert(create_return == 0);
+    }
+  }
+
+  uint64_t emitted = 0;
+  playback_sink_t sink = { count_event, &emitted };
+  playback_stats_t total = {0};
+  for (int i = 0; i < corpus->count; i++) {
+    player_t *player = create_player(node_song(corpus->nodes[i]), &sink);
+    player->speed = PLAYBACK_SPEED;
+    start_playback(player);
+    usleep(PLAYBACK_WINDOW_US);
+    stop_playback(player);
+    total.events += player->stats.events;
+    total.total_lateness_us += player->stats.total_lateness_us;
+    total.squared_lateness_us += player->stats.squared_lateness_us;
+    total.late_events += player->stats.late_events;
+    total.underruns += player->stats.underruns;
+    if (player->stats.max_lateness_us > total.max_lateness_us) {
+      total.max_lateness_us = player->stats.max_lateness_us;
+    }
+    if (player->stats.max_queued > total.max_queued) {
+      total.max_queued = player->stats.max_queued;
+    }
+    free_player(player);
+    player = NULL;
+  }
+
+  if (load_threads > 0) {
+    __atomic_store_n(&load.stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < load_threads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    threads = NULL;
+    for (int i = 0; i < load.count; i++) {
+      free(load.paths[i]);
+      load.paths[i] = NULL;
+    }
+    free(load.paths);
+    load.paths = NULL;
+    printf("playback with %d threads parsing, %lu songs parsed:\n",
+        load_threads, load.parsed);
+  }
+  else {
+    printf("playback with the other cores idle:\n");
+  }
+  if (total.events == 0) {
+    return;
+  }
+  double mean = (double) total.total_lateness_us / total.events;
+  double variance = (double) total.squared_lateness_us / total.events -
+    mean * mean;
+  printf("  events:                         %lu\n", total.events);
+  printf("  mean lateness (us):             %.1f\n", mean);
+  printf("  lateness jitter, std dev (us):  %.1f\n",
+      variance > 0 ? sqrt(variance) : 0.0);
+  printf("  max lateness (us):              %lu\n", total.max_lateness_us);
+  printf("  events over 1ms late:           %lu\n", total.late_events);
+  printf("  ring underruns:                 %lu\n", total.underruns);
+  printf("  most events queued:             %u\n", total.max_queued);
+} /* bench_playback() */
+
+/*
+ * writes g_melody_index to a temporary file and reads it back, attaching
+ * the songs of the corpus as make_library() would. Returns NULL if either
+ * step fails
+ */
+
+melody_index_t *round_trip_index(corpus_t *corpus) {
+  char path[] = "/tmp/melody_index_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return NULL;
+  }
+  close(fd);
+  melody_index_t *index = NULL;
+  if (write_melody_index(g_melody_index, path) == WRITE_INDEX_SUCCESS) {
+    index = read_melody_index(path);
+  }
+  unlink(path);
+  for (int i = 0; (index) && (i < corpus->count); i++) {
+    attach_song(index, corpus->nodes[i]->song_name,
+        node_song(corpus->nodes[i])->path);
+  }
+  return index;
+} /* round_trip_index() */
+
+/*
+ * returns whether two queries found the same songs with the same scores
+ * and positions
+ */
+
+bool same_results(melody_results_t *first, melody_results_t *second) {
+  if (first->num_matches != second->num_matches) {
+    return false;
+  }
+  for (uint32_t i = 0; i < first->num_matches; i++) {
+    melody_match_t *match_1 = &first->matches[i];
+    melody_match_t *match_2 = &second->matches[i];
+    if ((strcmp(match_1->song_name, match_2->song_name) != 0) ||
+        (match_1->score != match_2->score) ||
+        (match_1->num_positions != match_2->num_positions)) {
+      return false;
+    }
+    for (uint32_t j = 0; j < match_1->num_positions; j++) {
+      if ((match_1->positions[j].track != match_2->positions[j].track) ||
+          (match_1->positions[j].tick != match_2->positions[j].tick)) {
+        return false;
+      }
+    }
+  }
+  return true;
+} /* same_results() */
+
+/*
+ * searches the melody index for a fragment from the middle of the first
+ * melodic track of every song, and reports the index size, query time and
+ * how often the song the fragment came from ranks first. Every query is
+ * also run on a copy of the index written to a file and read back
+ */
+
+void bench_melody(corpus_t *corpus, int rounds) {
+  uint64_t index_bytes = 0;
+  uint64_t postings = 0;
+  for (uint32_t i = 0; i < g_melody_index->capacity; i++) {
+    index_bytes += g_melody_index->lists[i].size;
+    postings += g_melody_index->lists[i].count;
+  }
+  printf("melody index postings:            %lu\n", postings);
+  printf("melody index bytes per posting:   %.2f\n",
+      postings ? (double) index_bytes / postings : 0.0);
+
+  melody_index_t *reread = round_trip_index(corpus);
+  if (reread == NULL) {
+    printf("melody index round trip:          failed to write or read\n");
+  }
+  int queries = 0;
+  int found = 0;
+  int same = 0;
+  double query_time = 0;
+  for (int i = 0; i < corpus->count; i++) {
+    track_node_t *track_list = node_song(corpus->nodes[i])->track_list;
+    while ((track_list) &&
+        (track_melody(track_list->track, NULL, NULL) < MELODY_QUERY_NOTES)) {
+      track_list = track_list->next_track;
+    }
+    if (track_list == NULL) {
+      continue;
+    }
+    uint32_t count = track_melody(track_list->track, NULL, NULL);
+    uint8_t *pitches = malloc(count);
+    assert(pitches);
+    track_melody(track_list->track, pitches, NULL);
+    uint8_t *query = pitches + (count - MELODY_QUERY_NOTES) / 2;
+    for (int round = 0; round < rounds; round++) {
+      double start = now_seconds();
+      melody_results_t *results = query_melody(g_melody_index, query,
+          MELODY_QUERY_NOTES);
+      query_time += now_seconds() - start;
+      if (round == 0) {
+        queries++;
+        found += (results->num_matches) &&
+          (strcmp(results->matches[0].song_name,
+                  corpus->nodes[i]->song_name) == 0);
+        if (reread) {
+          melody_results_t *reread_results = query_melody(reread, query,
+              MELODY_QUERY_NOTES);
+          same += same_results(results, reread_results);
+          free_melody_results(reread_results);
+        }
+      }
+      free_melody_results(results);
+    }
+    free(pitches);
+    pitches = NULL;
+  }
+  free_melody_index(reread);
+  reread = NULL;
+  if (queries == 0) {
+    return;
+  }
+  printf("melody query mean time (ms):      %.3f\n",
+      query_time * 1000 / (queries * rounds));
+  printf("melody queries ranking source 1st: %d/%d\n", found, queries);
+  printf("melody index round trip matches:  %d/%d\n", same, queries);
+} /* bench_melody() */
+
+/*
+ * returns the bytes in use on the heap
+ */
+
+uint64_t heap_in_use() {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+} /* heap_in_use() */
+
+/*
+ * returns how much the heap grew since before, 0 if it shrank
+ */
+
+int64_t heap_growth(uint64_t before) {
+  uint64_t after = heap_in_use();
+  return (after > before) ? after - before : 0;
+} /* heap_growth() */
+
+/*
+ * records the rates of a step of the synthetic suite and prints them. heap
+ * is HEAP_NOT_MEASURED if the step does not leave anything allocated
+ */
+
+void add_result(synthetic_t *suite, const char *name, uint64_t events,
+    uint64_t bytes, double seconds, int64_t heap) {
+  assert(suite->num_results < MAX_RESULTS);
+  bench_result_t *result = &suite->results[suite->num_results++];
+  result->name = name;
+  result->events_per_sec = seconds > 0 ? events / seconds : 0;
+  result->mb_per_sec = seconds > 0 ? bytes / BYTES_PER_MB / seconds : 0;
+  result->has_heap = (heap != HEAP_NOT_MEASURED);
+  result->heap_per_event = result->has_heap ?
+    (double) heap / suite->events : 0;
+  printf("%-20s %14.0f events/s %10.2f MB/s", name, result->events_per_sec,
+      result->mb_per_sec);
+  if (result->has_heap) {
+    printf(" %10.2f heap bytes/event\n", result->heap_per_event);
+  }
+  else {
+    printf(" %10s heap bytes/event\n", "n/a");
+  }
+} /* add_result() */
+
+/*
+ * parses every synthetic song into songs, returning the heap it took
+ */
+
+int64_t parse_synthetic(synthetic_t *suite, song_data_t **songs) {
+  uint64_t before = heap_in_use();
+  for (int i = 0; i < suite->num_files; i++) {
+    songs[i] = parse_file(suite->paths[i]);
+  }
+  return heap_growth(before);
+} /* parse_synthetic() */
+
+/*
+ * times parse_file() and free_song() over the synthetic corpus
+ */
+
+void bench_synthetic_parse(synthetic_t *suite, song_data_t **songs) {
+  double parse_time = 0;
+  double free_time = 0;
+  int64_t heap = 0;
+  for (int round = 0; round < suite->rounds; round++) {
+    double start = now_seconds();
+    int64_t used = parse_synthetic(suite, songs);
+    parse_time += now_seconds() - start;
+    heap = (round == 0) ? used : heap;
+    start = now_seconds();
+    for (int i = 0; i < suite->num_files; i++) {
+      free_song(songs[i]);
+      songs[i] = NULL;
+    }
+    free_time += now_seconds() - start;
+  }
+  add_result(suite, "parse", suite->events * suite->rounds,
+      suite->bytes * suite->rounds, parse_time, heap);
+  add_result(suite, "free", suite->events * suite->rounds, 0, free_time,
+      HEAP_NOT_MEASURED);
+} /* bench_synthetic_parse() */
+
+/*
+ * times make_library() over the synthetic corpus, reading the files with
+ * the given backend
+ */
+
+void bench_synthetic_library(synthetic_t *suite, int backend,
+    const char *name) {
+  g_read_backend = backend;
+  double library_time = 0;
+  int64_t heap = 0;
+  for (int round = 0; round < suite->rounds; round++) {
+    uint64_t before = heap_in_use();
+    double start = now_seconds();
+    make_library(suite->directory);
+    library_time += now_seconds() - start;
+    heap = (round == 0) ? heap_growth(before) : heap;
+    free_melody_index(g_melody_index);
+    g_melody_index = NULL;
+    free_library(g_song_library);
+    g_song_library = NULL;
+  }
+  g_read_backend = READER_AUTO;
+  add_result(suite, name, suite->events * suite->rounds,
+      suite->bytes * suite->rounds, library_time, heap);
+} /* bench_synthetic_library() */
+
+/*
+ * times each alteration wrapper over the parsed synthetic songs
+ */
+
+void bench_synthetic_alterations(synthetic_t *suite, song_data_t **songs) {
+  static const char *names[] = {
+    "change_octave", "warp_time", "remap_instruments", "remap_notes",
+    "add_round"
+  };
+  song_data_t **clones = malloc(sizeof(song_data_t *) * suite->num_files);
+  assert(clones);
+  for (int wrapper = 0; wrapper < 5; wrapper++) {
+    double time = 0;
+    int64_t heap = 0;
+    for (int round = 0; round < suite->rounds; round++) {
+      if (wrapper == 4) {
+        for (int i = 0; i < suite->num_files; i++) {
+          clones[i] = clone_song(songs[i]);
+        }
+      }
+      //  The songs are altered in place, so their heap only grows by what
+      //  the wrapper adds, such as the tracks of a round
+      uint64_t before = heap_in_use();
+      double start = now_seconds();
+      for (int i = 0; i < suite->num_files; i++) {
+        switch (wrapper) {
+          case 0:
+            change_octave(songs[i], (round % 2) ? -1 : 1);
+            break;
+          case 1:
+            warp_time(songs[i], (round % 2) ? 0.5 : 2.0);
+            break;
+          case 2:
+            remap_instruments(songs[i], I_BRASS_BAND);
+            break;
+          case 3:
+            remap_notes(songs[i], N_LOWER);
+            break;
+          default:
+            add_round(clones[i], songs[i]->num_tracks > 1 ? 1 : 0, 1,
+                suite->params.division, 0);
+            break;
+        }
+      }
+      time += now_seconds() - start;
+      heap = (round == 0) ? heap_growth(before) : heap;
+      if (wrapper == 4) {
+        for (int i = 0; i < suite->num_files; i++) {
+          free_song(clones[i]);
+          clones[i] = NULL;
+        }
+      }
+    }
+    add_result(suite, names[wrapper], suite->events * suite->rounds, 0,
+        time, heap);
+  }
+  free(clones);
+  clones = NULL;
+} /* bench_synthetic_alterations() */
+
+/*
+ * times write_song_data() of the parsed synthetic songs
+ */
+
+void bench_synthetic_write(synthetic_t *suite, song_data_t **songs) {
+  char path[PATH_LENGTH];
+  snprintf(path, sizeof(path), "%s/written.out", suite->directory);
+  double time = 0;
+  uint64_t bytes = 0;
+  int64_t heap = 0;
+  for (int round = 0; round < suite->rounds; round++) {
+    uint64_t before = heap_in_use();
+    double start = now_seconds();
+    for (int i = 0; i < suite->num_files; i++) {
+      write_song_data(songs[i], path);
+      if (round == 0) {
+        struct stat info;
+        bytes += (stat(path, &info) == 0) ? info.st_size : 0;
+      }
+    }
+    time += now_seconds() - start;
+    heap = (round == 0) ? heap_growth(before) : heap;
+  }
+  unlink(path);
+  add_result(suite, "write", suite->events * suite->rounds,
+      bytes * suite->rounds, time, heap);
+} /* bench_synthetic_write() */
+
+/*
+ * writes the parameters and results of the suite as JSON, one result per
+ * line so compare_results() can read them back
+ */
+
+int write_results(synthetic_t *suite, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return -1;
+  }
+  smf_params_t *params = &suite->params;
+  fprintf(file, "{\n  \"params\": {\"files\": %d, \"tracks\": %u, "
+      "\"events_per_track\": %u, \"running_status\": %u, "
+      "\"sysex_size\": %u, \"tempo_changes\": %u, \"seed\": %u, "
+      "\"rounds\": %d},\n  \"events\": %lu,\n  \"bytes\": %lu,\n"
+      "  \"results\": [\n", suite->num_files, params->num_tracks,
+      params->events_per_track, params->running_status, params->sysex_size,
+      params->tempo_changes, params->seed, suite->rounds, suite->events,
+      suite->bytes);
+  for (int i = 0; i < suite->num_results; i++) {
+    bench_result_t *result = &suite->results[i];
+    fprintf(file, "    {\"name\": \"%s\", \"events_per_sec\": %.0f, "
+        "\"mb_per_sec\": %.3f", result->name, result->events_per_sec,
+        result->mb_per_sec);
+    if (result->has_heap) {
+      fprintf(file, ", \"heap_bytes_per_event\": %.2f",
+          result->heap_per_event);
+    }
+    fprintf(file, "}%s\n", (i + 1 < suite->num_results) ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+  file = NULL;
+  return 0;
+} /* write_results() */
+
+/*
+ * compares the event rates and heap use of the suite with those of a file
+ * written by write_results(). Returns the number of rates that dropped by
+ * more than tolerance percent plus the number of heap figures that grew by
+ * more than heap_tolerance percent
+ */
+
+int compare_results(synthetic_t *suite, const char *path, int tolerance,
+    int heap_tolerance) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    printf("cannot read %s\n", path);
+    return 1;
+  }
+  int regressions = 0;
+  char line[LINE_LENGTH];
+  while (fgets(line, sizeof(line), file)) {
+    char name[NAME_LENGTH];
+    double baseline = 0;
+    if (sscanf(line, " {\"name\": \"%63[^\"]\", \"events_per_sec\": %lf",
+          name, &baseline) != 2) {
+      continue;
+    }
+    for (int i = 0; i < suite->num_results; i++) {
+      bench_result_t *result = &suite->results[i];
+      if (strcmp(result->name, name) != 0) {
+        continue;
+      }
+      double change = baseline > 0 ?
+        100 * (result->events_per_sec - baseline) / baseline : 0;
+      printf("%-20s %+8.1f%%%s\n", name, change,
+          (change < -tolerance) ? "  REGRESSION" : "");
+      regressions += (change < -tolerance);
+
+      const char *heap_field = strstr(line, "\"heap_bytes_per_event\": ");
+      double baseline_heap = 0;
+      if ((!result->has_heap) || (heap_field == NULL) ||
+          (sscanf(heap_field, "\"heap_bytes_per_event\": %lf",
+            &baseline_heap) != 1)) {
+        continue;
+      }
+      double growth = result->heap_per_event - baseline_heap;
+      bool grew = (growth > HEAP_SLACK) &&
+        (growth > baseline_heap * heap_tolerance / 100);
+      printf("%-20s %+8.2f heap bytes/event%s\n", name, growth,
+          grew ? "  REGRESSION" : "");
+      regressions += grew;
+    }
+  }
+  fclose(file);
+  file = NULL;
+  return regressions;
+} /* compare_results() */
+
+/*
+ * generates the synthetic corpus and runs every step of the suite on it
+ */
+
+void bench_synthetic(synthetic_t *suite) {
+  if (generate_corpus(suite->directory, suite->num_files, &suite->params) !=
+      suite->num_files) {
+    printf("cannot write to %s\n", suite->directory);
+    return;
+  }
+  suite->paths = malloc(sizeof(char *) * suite->num_files);
+  assert(suite->paths);
+  song_data_t **songs = malloc(sizeof(song_data_t *) * suite->num_files);
+  assert(songs);
+  suite->events = 0;
+  suite->bytes = 0;
+  for (int i = 0; i < suite->num_files; i++) {
+    suite->paths[i] = malloc(PATH_LENGTH);
+    assert(suite->paths[i]);
+    snprintf(suite->paths[i], PATH_LENGTH, "%s/synth_%04d.mid",
+        suite->directory, i);
+    struct stat info;
+    if (stat(suite->paths[i], &info) == 0) {
+      suite->bytes += info.st_size;
+    }
+  }
+  parse_synthetic(suite, songs);
+  for (int i = 0; i < suite->num_files; i++) {
+    expanded_size(songs[i], &suite->events);
+    free_song(songs[i]);
+    songs[i] = NULL;
+  }
+  printf("synthetic songs:     %d\n", suite->num_files);
+  printf("synthetic events:    %lu\n", suite->events);
+  printf("synthetic bytes:     %lu\n", suite->bytes);
+  if (suite->events) {
+    bench_synthetic_parse(suite, songs);
+    bench_synthetic_library(suite, READER_AUTO, "make_library");
+    bench_synthetic_library(suite, READER_THREADS, "make_library_threads");
+    parse_synthetic(suite, songs);
+    bench_synthetic_alterations(suite, songs);
+    bench_synthetic_write(suite, songs);
+    for (int i = 0; i < suite->num_files; i++) {
+      free_song(songs[i]);
+      songs[i] = NULL;
+    }
+  }
+  free(songs);
+  songs = NULL;
+  for (int i = 0; i < suite->num_files; i++) {
+    free(suite->paths[i]);
+    suite->paths[i] = NULL;
+  }
+  free(suite->paths);
+  suite->paths = NULL;
+} /* bench_synthetic() */
+
+int main(int argc, char **argv) {
+  setvbuf(stdout, NULL, _IONBF, 0);
+  setvbuf(stderr, NULL, _IONBF, 0);
+  setvbuf(stdin, NULL, _IONBF, 0);
+
+  if (argc == 1) {
+    printf(USAGE);
+    return -1;
+  }
+
+  int opt;
+
+  char *lib_dir_path = NULL;
+  char *json_path = NULL;
+  char *baseline_path = NULL;
+  int tolerance = DEFAULT_TOLERANCE;
+  int heap_tolerance = DEFAULT_HEAP_TOLERANCE;
+  int rounds = DEFAULT_ROUNDS;
+  int load_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  synthetic_t *suite = malloc(sizeof(synthetic_t));
+  assert(suite);
+  memset(suite, 0, sizeof(synthetic_t));
+  suite->num_files = DEFAULT_GEN_FILES;
+  init_smf_params(&suite->params);
+
+  while ((opt = getopt(argc, argv, ":hid:r:L:g:n:t:e:s:x:m:S:j:c:T:A:")) !=
+      -1) {
+    switch (opt) {
+      case 'h':
+        printf(USAGE);
+        break;
+      case 'd':
+        lib_dir_path = optarg;
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      case 'L':
+        load_threads = atoi(optarg);
+        break;
+      case 'i':
+        g_payload_pool = create_payload_pool();
+        break;
+      case 'g':
+        suite->directory = optarg;
+        break;
+      case 'n':
+        suite->num_files = atoi(optarg);
+        break;
+      case 't':
+        suite->params.num_tracks = atoi(optarg);
+        break;
+      case 'e':
+        suite->params.events_per_track = atoi(optarg);
+        break;
+      case 's':
+        suite->params.running_status = atoi(optarg);
+        break;
+      case 'x':
+        suite->params.sysex_size = atoi(optarg);
+        break;
+      case 'm':
+        suite->params.tempo_changes = atoi(optarg);
+        break;
+      case 'S':
+        suite->params.seed = atoi(optarg);
+        break;
+      case 'j':
+        json_path = optarg;
+        break;
+      case 'c':
+        baseline_path = optarg;
+        break;
+      case 'T':
+        tolerance = atoi(optarg);
+        break;
+      case 'A':
+        heap_tolerance = atoi(optarg);
+        break;
+      case ':':
+        printf("option needs a value\n");
+        break;
+      case '?':
+        printf("unknown option: %c\n", optopt);
+        break;
+    }
+  }
+
+  if (((lib_dir_path == NULL) && (suite->directory == NULL)) ||
+      (rounds <= 0) || (suite->num_files <= 0) ||
+      (suite->params.num_tracks == 0) ||
+      (suite->params.running_status > 100)) {
+    free(suite);
+    return -1;
+  }
+
+  int status = 0;
+  if (suite->directory) {
+    suite->rounds = rounds;
+    bench_synthetic(suite);
+    if ((json_path) && (write_results(suite, json_path) != 0)) {
+      printf("cannot write %s\n", json_path);
+      status = -1;
+    }
+    if ((baseline_path) && (compare_results(suite, baseline_path, tolerance,
+            heap_tolerance) > 0)) {
+      status = 1;
+    }
+  }
+  free(suite);
+  suite = NULL;
+
+  if (lib_dir_path) {
+    make_library(lib_dir_path);
+    if (g_song_library == NULL) {
+      printf("No songs in %s\n", lib_dir_path);
+      return -1;
+    }
+    corpus_t *corpus = malloc(sizeof(corpus_t));
+    assert(corpus);
+    corpus->count = 0;
+    traverse_in_order(g_song_library, corpus, (void *)collect_node);
+
+    bench_pack(corpus, rounds);
+    bench_compact(corpus, rounds);
+    bench_remap(corpus, rounds);
+    bench_melody(corpus, rounds);
+    bench_playback(corpus, 0);
+    if (load_threads > 0) {
+      bench_playback(corpus, load_threads);
+    }
+
+    free(corpus);
+    corpus = NULL;
+    free_melody_index(g_melody_index);
+    g_melody_index = NULL;
+    free_library(g_song_library);
+    g_song_library = NULL;
+  }
+  if (g_payload_pool) {
+    free_payload_pool(g_payload_pool);
+    g_payload_pool = NULL;
+  }
+
+  return status;
+}
@@ -5,31 +5,87 @@
 /* Add any includes here */
 
 #include "alterations.h"
+#include "remap_kernels.h"
+#include "timeline.h"
+#include "tempo_map.h"
+#include "note_table.h"
+#include "stats.h"
+#include "memory_usage.h"
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #define MODIFIED (1)
 #define FAIL (0)
-#define NOTE_MAX (127)
-#define NOTE_MIN (0)
 #define CHANNEL_MAX (15)
-#define MIDI_MIN (0x80)
 #define MIDI_MAX (0xFE)
+#define CHANNEL_EVENT_MAX (0xEF)
+#define COLUMN_BATCH (256)
+#define MAX_THREADS (64)
 #define CLEAR_FOUR_MASK (0xF0)
-#define NOTE_EVENT_MAX (0xAF)
 #define VLQ_1_BYTE_MAX (0x7F)
 #define VLQ_2_BYTE_MAX (0x3FFF)
 #define VLQ_3_BYTE_MAX  (0x1FFFFF)
-#define PROGRAM_CHANGE_MIN (0xC0)
-#define PROGRAM_CHANGE_MAX (0xCF)
+#define STATUS_KIND_MASK (0xF0)
+#define NO_CHANGES ((change_range_t) {UINT64_MAX, 0, false})
+
+//  Events changed by an alteration, see invalidate_changes()
+typedef struct change_range_s {
+  //  Ticks of the first and last changed event, first is UINT64_MAX if none
+  //  changed and last is UINT64_MAX if every later tick may have
+  uint64_t first;
+  uint64_t last;
+  //  Set if a delta-time changed
+  bool retimed;
+} change_range_t;
 
 int octave_helper(event_t *event, void *data);
 int time_helper(song_data_t *song, float multiplier);
+int warp_track(track_t *track, uint64_t scale);
 int instruments_helper(event_t *event, void *remapping_table);
 int notes_helper(event_t *event, void *remapping_table);
-event_node_t *duplicate_events(event_node_t *list, int lowest_channel);
+int octave_column_helper(const uint8_t *status, uint8_t *data,
+    uint32_t count, void *octave);
+int column_pass(track_t *track, column_func_t function, void *data,
+    bool write, change_range_t *changes);
+int apply_to_track(track_t *track, event_func_t function, void *data,
+    change_range_t *changes);
+void add_change_range(change_range_t *changes, uint64_t first,
+    uint64_t last);
+void invalidate_changes(song_data_t *song, change_range_t *changes);
+int apply_to_changed_tracks(song_data_t *song, event_func_t function,
+    column_func_t check, void *data);
+int instruments_column_helper(const uint8_t *status, uint8_t *data,
+    uint32_t count, void *table);
+int notes_column_helper(const uint8_t *status, uint8_t *data,
+    uint32_t count, void *table);
 int vlq_size_difference(uint32_t vlq_1, uint32_t vlq_2);
+int pipeline_add_stage(transform_pipeline_t *pipeline,
+    pipeline_stage_t stage);
+uint16_t track_channels(track_t *track);
+void build_voices(track_t *source, round_voice_t *voices, int *channels,
+    int *members, int num_members, track_node_t **rounds);
+
+//  Shared state of one track-parallel run
+typedef struct parallel_job_s {
+  track_t **tracks;
+  int *results;
+  int num_tracks;
+  int next_track;
+  event_func_t function;
+  void *data;
+  uint64_t scale;
+  //  Events each track changed
+  change_range_t *changes;
+} parallel_job_t;
+
+int run_parallel(song_data_t *song, parallel_job_t *job, int threads,
+    void *(*worker)(void *));
+void *events_worker(void *job);
+void *time_worker(void *job);
 
 /*
  * changes the octave of the event
@@ -129,26 +185,374 @@ int apply_to_events(song_data_t *song, event_func_t function, void *data) {
   assert(song);
   assert(function);
   int function_return = 0;
+  change_range_t changes = NO_CHANGES;
   track_node_t *track_list = song->track_list;
   while (track_list) {
-    event_node_t *event_list = track_list->track->event_list;
-    while (event_list) {
-      function_return += function(event_list->event, data);
+    function_return += apply_to_track(own_track(track_list), function, data,
+        &changes);
+    track_list = track_list->next_track;
+  }
+  invalidate_changes(song, &changes);
+  return function_return;
+} /* apply_to_events() */
+
+/*
+ * widens the range to cover ticks first to last
+ */
+
+void add_change_range(change_range_t *changes, uint64_t first,
+    uint64_t last) {
+  if (first < changes->first) {
+    changes->first = first;
+  }
+  if (last > changes->last) {
+    changes->last = last;
+  }
+} /* add_change_range() */
+
+/*
+ * drops what the changes left out of date in the song's caches: the tempo
+ * map if a delta-time changed, and the notes around the changed ticks
+ */
+
+void invalidate_changes(song_data_t *song, change_range_t *changes) {
+  if (changes->retimed) {
+    invalidate_tempo_map(song);
+  }
+  if (changes->first != UINT64_MAX) {
+    invalidate_notes_between(song, changes->first, changes->last);
+  }
+  //  Tracks copied by own_track() start without a tick index
+  account_song_caches(song);
+} /* invalidate_changes() */
+
+/*
+ * applies the function to every event of the track, adding the ticks where
+ * notes could have changed to changes. A changed note byte only touches its
+ * own tick, while a changed program, event type or delta-time reaches every
+ * later tick. If any delta-time changed, the tick index of the track is
+ * refreshed and the range marked retimed, since the tempo map is then out
+ * of date too
+ */
+
+int apply_to_track(track_t *track, event_func_t function, void *data,
+    change_range_t *changes) {
+  int function_return = 0;
+  uint64_t tick = 0;
+  bool moved = false;
+  event_node_t *event_list = track->event_list;
+  while (event_list) {
+    event_t *event = event_list->event;
+    uint32_t delta_time = event->delta_time;
+    if ((changes->last == UINT64_MAX) && (tick >= changes->first)) {
+      //  Only a moved event can add to the range from here on
+      function_return += function(event, data);
+      moved |= (event->delta_time != delta_time);
       event_list = event_list->next_event;
+      continue;
+    }
+    uint8_t type = event->type;
+    uint8_t note = 0;
+    uint8_t velocity = 0;
+    bool channel = (type >= MIDI_MIN) && (type <= CHANNEL_EVENT_MAX);
+    if (channel) {
+      note = event->midi_event.data[0];
+      velocity = (event->midi_event.data_len > 1) ?
+        event->midi_event.data[1] : 0;
+    }
+    function_return += function(event, data);
+    if (event->delta_time != delta_time) {
+      add_change_range(changes, tick, UINT64_MAX);
+      moved = true;
+    }
+    else if (event->type != type) {
+      add_change_range(changes, tick + delta_time, UINT64_MAX);
+    }
+    else if (channel && ((event->midi_event.data[0] != note) ||
+          ((event->midi_event.data_len > 1) &&
+           (event->midi_event.data[1] != velocity)))) {
+      bool program = (type & STATUS_KIND_MASK) == PROGRAM_CHANGE_MIN;
+      add_change_range(changes, tick + delta_time,
+          program ? UINT64_MAX : tick + delta_time);
     }
+    tick += delta_time;
+    event_list = event_list->next_event;
+  }
+  if (moved) {
+    refresh_tick_index(track);
+    changes->retimed = true;
+  }
+  return function_return;
+} /* apply_to_track() */
+
+/*
+ * gathers the status and first data byte of the channel events of the track
+ * into columns and applies the function to them in batches. The data bytes
+ * are written back if write is set. Either way the ticks of the events
+ * whose byte changed are added to changes, up to the end of the song for a
+ * program change
+ */
+
+int column_pass(track_t *track, column_func_t function, void *data,
+    bool write, change_range_t *changes) {
+  uint8_t status[COLUMN_BATCH];
+  uint8_t column[COLUMN_BATCH];
+  uint8_t *targets[COLUMN_BATCH];
+  uint64_t ticks[COLUMN_BATCH];
+  int function_return = 0;
+  uint64_t tick = 0;
+  event_node_t *event_list = track->event_list;
+  uint32_t count = 0;
+  while (event_list) {
+    event_t *event = event_list->event;
+    tick += event->delta_time;
+    if ((event->type >= MIDI_MIN) && (event->type <= CHANNEL_EVENT_MAX)) {
+      status[count] = event->type;
+      column[count] = event->midi_event.data[0];
+      targets[count] = event->midi_event.data;
+      ticks[count] = tick;
+      count++;
+    }
+    event_list = event_list->next_event;
+    if ((count == COLUMN_BATCH) || ((event_list == NULL) && count)) {
+      function_return += function(status, column, count, data);
+      for (uint32_t i = 0; i < count; i++) {
+        if (*targets[i] == column[i]) {
+          continue;
+        }
+        bool program =
+          (status[i] & STATUS_KIND_MASK) == PROGRAM_CHANGE_MIN;
+        add_change_range(changes, ticks[i], program ? UINT64_MAX : ticks[i]);
+        if (write) {
+          *targets[i] = column[i];
+        }
+      }
+      count = 0;
+    }
+  }
+  return function_return;
+} /* column_pass() */
+
+/*
+ * applies the column function to the channel events of every track. Tracks
+ * shared with a clone are only copied if the function changes them
+ */
+
+int apply_to_columns(song_data_t *song, column_func_t function, void *data) {
+  assert(song);
+  assert(function);
+  int function_return = 0;
+  change_range_t changes = NO_CHANGES;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    if (track_list->track->ref_count > 1) {
+      change_range_t track_changes = NO_CHANGES;
+      int track_return = column_pass(track_list->track, function, data,
+          false, &track_changes);
+      if (track_changes.first == UINT64_MAX) {
+        function_return += track_return;
+        track_list = track_list->next_track;
+        continue;
+      }
+      own_track(track_list);
+    }
+    function_return += column_pass(track_list->track, function, data, true,
+        &changes);
     track_list = track_list->next_track;
   }
+  invalidate_changes(song, &changes);
   return function_return;
-} /* apply_to_events() */
+} /* apply_to_columns() */
+
+/*
+ * applies the event function to every event of the song like
+ * apply_to_events(), which is faster than gathering columns for a single
+ * pass. Tracks shared with a clone are first run through the matching column
+ * function without writing, and only copied if it would change them
+ */
+
+int apply_to_changed_tracks(song_data_t *song, event_func_t function,
+    column_func_t check, void *data) {
+  assert(song);
+  assert(function);
+  assert(check);
+  int function_return = 0;
+  change_range_t changes = NO_CHANGES;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    if (track_list->track->ref_count > 1) {
+      change_range_t track_changes = NO_CHANGES;
+      int track_return = column_pass(track_list->track, check, data, false,
+          &track_changes);
+      if (track_changes.first == UINT64_MAX) {
+        function_return += track_return;
+        track_list = track_list->next_track;
+        continue;
+      }
+      own_track(track_list);
+    }
+    function_return += apply_to_track(track_list->track, function, data,
+        &changes);
+    track_list = track_list->next_track;
+  }
+  invalidate_changes(song, &changes);
+  return function_return;
+} /* apply_to_changed_tracks() */
+
+/*
+ * splits the tracks of the song between worker threads that each run worker
+ * on the job, and returns the sum of the per-track results
+ */
+
+int run_parallel(song_data_t *song, parallel_job_t *job, int threads,
+    void *(*worker)(void *)) {
+  assert(song);
+  job->num_tracks = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    job->num_tracks++;
+    track_list = track_list->next_track;
+  }
+  if (job->num_tracks == 0) {
+    return 0;
+  }
+  job->tracks = malloc(sizeof(track_t *) * job->num_tracks);
+  assert(job->tracks);
+  job->results = malloc(sizeof(int) * job->num_tracks);
+  assert(job->results);
+  job->changes = malloc(sizeof(change_range_t) * job->num_tracks);
+  assert(job->changes);
+  track_list = song->track_list;
+  for (int i = 0; i < job->num_tracks; i++) {
+    job->tracks[i] = own_track(track_list);
+    job->results[i] = 0;
+    job->changes[i] = NO_CHANGES;
+    track_list = track_list->next_track;
+  }
+  job->next_track = 0;
+
+  if (threads <= 0) {
+    threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (threads > job->num_tracks) {
+    threads = job->num_tracks;
+  }
+  if (threads > MAX_THREADS) {
+    threads = MAX_THREADS;
+  }
+  pthread_t workers[MAX_THREADS];
+  int started = 0;
+  for (int i = 1; i < threads; i++) {
+    if (pthread_create(&workers[started], NULL, worker, job) == 0) {
+      started++;
+    }
+  }
+  //  The calling thread works too, so the job finishes even if no thread
+  //  could be started
+  worker(job);
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  int total = 0;
+  change_range_t changes = NO_CHANGES;
+  for (int i = 0; i < job->num_tracks; i++) {
+    total += job->results[i];
+    add_change_range(&changes, job->changes[i].first, job->changes[i].last);
+    changes.retimed |= job->changes[i].retimed;
+  }
+  invalidate_changes(song, &changes);
+  free(job->tracks);
+  job->tracks = NULL;
+  free(job->results);
+  job->results = NULL;
+  free(job->changes);
+  job->changes = NULL;
+  return total;
+} /* run_parallel() */
+
+/*
+ * claims tracks from the job and applies its function to their events
+ */
+
+void *events_worker(void *job_data) {
+  parallel_job_t *job = job_data;
+  int index = __atomic_fetch_add(&job->next_track, 1, __ATOMIC_RELAXED);
+  while (index < job->num_tracks) {
+    job->results[index] = apply_to_track(job->tracks[index], job->function,
+        job->data, &job->changes[index]);
+    index = __atomic_fetch_add(&job->next_track, 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+} /* events_worker() */
+
+/*
+ * claims tracks from the job, scales their delta-times and updates their
+ * lengths
+ */
+
+void *time_worker(void *job_data) {
+  parallel_job_t *job = job_data;
+  int index = __atomic_fetch_add(&job->next_track, 1, __ATOMIC_RELAXED);
+  while (index < job->num_tracks) {
+    job->results[index] = warp_track(job->tracks[index], job->scale);
+    //  Every tick is scaled
+    job->changes[index] = (change_range_t) {0, UINT64_MAX, true};
+    index = __atomic_fetch_add(&job->next_track, 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+} /* time_worker() */
+
+/*
+ * applies the given function to every event in the song with "data", one
+ * track per worker at a time. The function may only touch the event it is
+ * given
+ */
+
+int apply_to_events_parallel(song_data_t *song, event_func_t function,
+    void *data, int threads) {
+  assert(function);
+  parallel_job_t job = {0};
+  job.function = function;
+  job.data = data;
+  return run_parallel(song, &job, threads, events_worker);
+} /* apply_to_events_parallel() */
+
+/*
+ * modifies the length of the song by the multiplier, one track per worker at
+ * a time
+ */
+
+int warp_time_parallel(song_data_t *song, float multiplier, int threads) {
+  assert(song);
+  invalidate_tempo_map(song);
+  parallel_job_t job = {0};
+  job.scale = warp_scale(multiplier);
+  return run_parallel(song, &job, threads, time_worker);
+} /* warp_time_parallel() */
 
 /*
  * changes the octave for the entire song
  */
 
 int change_octave(song_data_t *song, int octave_change) {
-  return apply_to_events(song, octave_helper, (void *) &octave_change);
+  STAT_START(start);
+  int result = apply_to_changed_tracks(song, octave_helper,
+      octave_column_helper, (void *) &octave_change);
+  STAT_STOP(TIMER_CHANGE_OCTAVE, start);
+  return result;
 } /* change_octave() */
 
+/*
+ * applies the octave shift kernel to a column of note events
+ */
+
+int octave_column_helper(const uint8_t *status, uint8_t *data,
+    uint32_t count, void *octave) {
+  return shift_column(status, data, count, *(int *) octave * OCTAVE_STEP,
+      MIDI_MIN, NOTE_EVENT_MAX);
+} /* octave_column_helper() */
+
 /*
  * casts the arguments to required type for change_octave
  */
@@ -162,7 +566,9 @@ int octave_helper(event_t *event, void *octave) {
  */
 
 int warp_time(song_data_t *song, float multiplier) {
+  STAT_START(start);
   int size_difference = time_helper(song, multiplier);
+  STAT_STOP(TIMER_WARP_TIME, start);
   return size_difference;
 } /* warp_time() */
 
@@ -172,30 +578,79 @@ int warp_time(song_data_t *song, float multiplier) {
 
 int time_helper(song_data_t *song, float multiplier) {
   assert(song);
+  invalidate_tempo_map(song);
+  invalidate_note_table(song);
+  uint64_t scale = warp_scale(multiplier);
   track_node_t *track_list = song->track_list;
   int total_change = 0;
   while (track_list) {
-    int track_length = 0;
-    event_node_t *event_list = track_list->track->event_list;
-    while (event_list) {
-      track_length += change_event_time(event_list->event, &multiplier);
-      event_list = event_list->next_event;
-    }
-    track_list->track->length += track_length;
-    total_change += track_length;
+    total_change += warp_track(own_track(track_list), scale);
     track_list = track_list->next_track;
   }
+  account_song_caches(song);
   return total_change;
 } /* time_helper() */
 
+/*
+ * scales the delta-times of the track through the warp kernel a column at a
+ * time, keeping an existing tick index valid in the same pass. Returns the
+ * change in the length of the track
+ */
+
+int warp_track(track_t *track, uint64_t scale) {
+  uint32_t deltas[COLUMN_BATCH];
+  event_t *events[COLUMN_BATCH];
+  warp_state_t state = {scale, 0, 0};
+  tick_index_t *index = track->tick_index;
+  uint32_t position = 0;
+  //  Follows the stored delta-times, which warp_column() may have clamped
+  uint64_t tick = 0;
+  int track_length = 0;
+  event_node_t *event_list = track->event_list;
+  while (event_list) {
+    uint32_t count = 0;
+    while ((event_list) && (count < COLUMN_BATCH)) {
+      events[count] = event_list->event;
+      deltas[count++] = event_list->event->delta_time;
+      event_list = event_list->next_event;
+    }
+    track_length += warp_column(deltas, count, &state);
+    for (uint32_t i = 0; i < count; i++) {
+      events[i]->delta_time = deltas[i];
+    }
+    if (index) {
+      for (uint32_t i = 0; i < count; i++) {
+        tick += deltas[i];
+        index->ticks[position++] = tick;
+      }
+    }
+  }
+  track->length += track_length;
+  return track_length;
+} /* warp_track() */
+
 /*
  * remaps all the instruments according to the table
  */
 
 int remap_instruments(song_data_t *song, remapping_t table) {
-  return apply_to_events(song, instruments_helper, (void *) table);
+  STAT_START(start);
+  int result = apply_to_changed_tracks(song, instruments_helper,
+      instruments_column_helper, (void *) table);
+  STAT_STOP(TIMER_REMAP_INSTRUMENTS, start);
+  return result;
 } /* remap_instruments() */
 
+/*
+ * applies the remapping kernel to a column of program change events
+ */
+
+int instruments_column_helper(const uint8_t *status, uint8_t *data,
+    uint32_t count, void *table) {
+  return remap_column(status, data, count, table, PROGRAM_CHANGE_MIN,
+      PROGRAM_CHANGE_MAX);
+} /* instruments_column_helper() */
+
 /*
  * casts the arguments to the required type for change_event_instrument
  */
@@ -209,9 +664,22 @@ int instruments_helper(event_t *event, void *table) {
  */
 
 int remap_notes(song_data_t *song, remapping_t table) {
-  return apply_to_events(song, notes_helper, table);
+  STAT_START(start);
+  int result = apply_to_changed_tracks(song, notes_helper,
+      notes_column_helper, (void *) table);
+  STAT_STOP(TIMER_REMAP_NOTES, start);
+  return result;
 } /* remap_notes() */
 
+/*
+ * applies the remapping kernel to a column of note events
+ */
+
+int notes_column_helper(const uint8_t *status, uint8_t *data,
+    uint32_t count, void *table) {
+  return remap_column(status, data, count, table, MIDI_MIN, NOTE_EVENT_MAX);
+} /* notes_column_helper() */
+
 /*
  * casts the arguments to required type for change_event_note
  */
@@ -220,6 +688,150 @@ int notes_helper(event_t *event, void *table) {
   return change_event_note(event, table);
 } /* notes_helper() */
 
+/*
+ * empties the pipeline
+ */
+
+void init_pipeline(transform_pipeline_t *pipeline) {
+  assert(pipeline);
+  pipeline->num_stages = 0;
+} /* init_pipeline() */
+
+/*
+ * appends a stage to the pipeline and returns its index
+ */
+
+int pipeline_add_stage(transform_pipeline_t *pipeline,
+    pipeline_stage_t stage) {
+  assert(pipeline);
+  assert(pipeline->num_stages < PIPELINE_MAX_STAGES);
+  stage.result = 0;
+  pipeline->stages[pipeline->num_stages] = stage;
+  return pipeline->num_stages++;
+} /* pipeline_add_stage() */
+
+/*
+ * adds a change_octave stage to the pipeline
+ */
+
+int pipeline_add_octave(transform_pipeline_t *pipeline, int octave_change) {
+  pipeline_stage_t stage = { .kind = STAGE_OCTAVE };
+  stage.octaves = octave_change;
+  return pipeline_add_stage(pipeline, stage);
+} /* pipeline_add_octave() */
+
+/*
+ * adds a warp_time stage to the pipeline
+ */
+
+int pipeline_add_warp(transform_pipeline_t *pipeline, float multiplier) {
+  pipeline_stage_t stage = { .kind = STAGE_TIME };
+  stage.multiplier = multiplier;
+  return pipeline_add_stage(pipeline, stage);
+} /* pipeline_add_warp() */
+
+/*
+ * adds a remap_instruments stage to the pipeline. The table is not copied
+ */
+
+int pipeline_add_instruments(transform_pipeline_t *pipeline,
+    remapping_t table) {
+  assert(table);
+  pipeline_stage_t stage = { .kind = STAGE_INSTRUMENTS };
+  stage.table = table;
+  return pipeline_add_stage(pipeline, stage);
+} /* pipeline_add_instruments() */
+
+/*
+ * adds a remap_notes stage to the pipeline. The table is not copied
+ */
+
+int pipeline_add_notes(transform_pipeline_t *pipeline, remapping_t table) {
+  assert(table);
+  pipeline_stage_t stage = { .kind = STAGE_NOTES };
+  stage.table = table;
+  return pipeline_add_stage(pipeline, stage);
+} /* pipeline_add_notes() */
+
+/*
+ * adds a stage applying an arbitrary event function, as apply_to_events
+ * would, to the pipeline
+ */
+
+int pipeline_add_function(transform_pipeline_t *pipeline,
+    event_func_t function, void *data) {
+  assert(function);
+  pipeline_stage_t stage = { .kind = STAGE_FUNCTION };
+  stage.function = function;
+  stage.data = data;
+  return pipeline_add_stage(pipeline, stage);
+} /* pipeline_add_function() */
+
+/*
+ * runs every stage of the pipeline over the song in a single pass per track.
+ * Each stage's result is set to what its wrapper would have returned, and
+ * the total change in track length is returned
+ */
+
+int run_pipeline(song_data_t *song, transform_pipeline_t *pipeline) {
+  assert(song);
+  assert(pipeline);
+  int num_stages = pipeline->num_stages;
+  pipeline_stage_t *stages = pipeline->stages;
+  invalidate_tempo_map(song);
+  invalidate_note_table(song);
+  for (int i = 0; i < num_stages; i++) {
+    stages[i].result = 0;
+  }
+  warp_state_t warps[PIPELINE_MAX_STAGES];
+  int total_change = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    int track_length = 0;
+    event_node_t *event_list = own_track(track_list)->event_list;
+    //  Warp stages follow absolute ticks, so restart them on every track
+    for (int i = 0; i < num_stages; i++) {
+      if (stages[i].kind == STAGE_TIME) {
+        init_warp_state(&warps[i], stages[i].multiplier);
+      }
+    }
+    while (event_list) {
+      event_t *event = event_list->event;
+      for (int i = 0; i < num_stages; i++) {
+        switch (stages[i].kind) {
+          case STAGE_OCTAVE:
+            stages[i].result += change_event_octave(event,
+                &stages[i].octaves);
+            break;
+          case STAGE_TIME: {
+            int difference = warp_column(&event->delta_time, 1, &warps[i]);
+            stages[i].result += difference;
+            track_length += difference;
+            break;
+          }
+          case STAGE_INSTRUMENTS:
+            stages[i].result += change_event_instrument(event,
+                stages[i].table);
+            break;
+          case STAGE_NOTES:
+            stages[i].result += change_event_note(event, stages[i].table);
+            break;
+          case STAGE_FUNCTION:
+            stages[i].result += stages[i].function(event, stages[i].data);
+            break;
+        }
+      }
+      event_list = event_list->next_event;
+    }
+    track_list->track->length += track_length;
+    refresh_tick_index(track_list->track);
+    total_change += track_length;
+    track_list = track_list->next_track;
+  }
+  account_song_caches(song);
+  return total_change;
+} /* run_pipeline() */
+
 /*
  * adds the track at the given index wtih the given changes to the end of the
  * track list
@@ -227,110 +839,231 @@ int notes_helper(event_t *event, void *table) {
 
 void add_round(song_data_t *song, int track_index, int octave_difference,
     unsigned int time_delay, uint8_t instrument) {
-  assert(song);
-  assert(track_index < song->num_tracks);
-  assert(song->format != 2);
-  track_node_t *round = song->track_list;
-  for (int i = 0; i < track_index; i++) {
-    round = round->next_track;
-  }
-  int channels[CHANNEL_MAX + 1];
-  for (int i = 0; i <= CHANNEL_MAX; i++) {
-    channels[i] = 0;
-  }
-  event_node_t *events = round->track->event_list;
+  round_voice_t voice = {
+    track_index, octave_difference, time_delay, instrument
+  };
+  add_rounds(song, &voice, 1);
+} /* add_round() */
+
+/*
+ * returns a bit mask of the channels used by the track
+ */
+
+uint16_t track_channels(track_t *track) {
+  uint16_t channels = 0;
+  event_node_t *events = track->event_list;
   while (events) {
     if ((events->event->type >= MIDI_MIN) && (events->event->type <=
           MIDI_MAX)) {
-      channels[events->event->type & (~CLEAR_FOUR_MASK)] = 1;
+      channels |= 1 << (events->event->type & (~CLEAR_FOUR_MASK));
     }
     events = events->next_event;
   }
-  int lowest_channel = CHANNEL_MAX + 1;
-  for (int i = 0; i <= CHANNEL_MAX; i++) {
-    if (!channels[i]) {
-      lowest_channel = i;
-      break;
+  return channels;
+} /* track_channels() */
+
+/*
+ * builds the tracks of the voices listed in members, which all copy the
+ * source track, in a single pass over it. The data of events without a
+ * channel is copied once and shared by the new tracks
+ */
+
+void build_voices(track_t *source, round_voice_t *voices, int *channels,
+    int *members, int num_members, track_node_t **rounds) {
+  uint32_t num_events = 0;
+  uint32_t shared_size = 0;
+  uint32_t channel_size = 0;
+  event_node_t *event_list = source->event_list;
+  while (event_list) {
+    event_t *event = event_list->event;
+    uint32_t data_len = 0;
+    event_data(event, &data_len);
+    if ((event_type(event) == MIDI_EVENT_T) &&
+        (event->midi_event.status < SYS_EVENT_1)) {
+      channel_size += data_len;
+    }
+    else {
+      shared_size += data_len;
     }
+    num_events++;
+    event_list = event_list->next_event;
   }
-  assert(lowest_channel <= CHANNEL_MAX);
-  track_node_t *duplicate = malloc(sizeof(track_node_t));
-  assert(duplicate);
-  duplicate->track = malloc(sizeof(track_t));
-  assert(duplicate->track);
-  duplicate->next_track = NULL;
-  printf("%x\n", lowest_channel);
-  //printf("%x\n", round->track->event_list->event->type);
-  duplicate->track->event_list = duplicate_events(round->track->event_list,
-      lowest_channel);
-  song_data_t *temp_song = malloc(sizeof(song_data_t));
-  temp_song->track_list = duplicate;
-  change_octave(temp_song, octave_difference);
-  remapping_t instrument_change = {0};
-  for (int i = 0; i <= 0xFF; i++) {
-    instrument_change[i] = instrument;
-  }
-  remap_instruments(temp_song, instrument_change);
-  free(temp_song);
-  temp_song = NULL;
-  uint32_t old_delta = duplicate->track->event_list->event->delta_time;
-  duplicate->track->event_list->event->delta_time += time_delay;
-  duplicate->track->length = vlq_size_difference(old_delta,
-      duplicate->track->event_list->event->delta_time);
-  printf("%d\n", duplicate->track->event_list->event->delta_time);
-} /* add_round() */
+
+  shared_data_t *shared = NULL;
+  uint8_t *shared_cursor = NULL;
+  if (shared_size) {
+    shared = malloc(sizeof(shared_data_t) + shared_size);
+    assert(shared);
+    shared->ref_count = num_members;
+    shared_cursor = shared->data;
+  }
+  event_node_t *nodes[CHANNEL_MAX + 1];
+  event_t *events[CHANNEL_MAX + 1];
+  uint8_t *data[CHANNEL_MAX + 1];
+  remapping_t tables[CHANNEL_MAX + 1];
+  for (int i = 0; i < num_members; i++) {
+    track_t *track = malloc(sizeof(track_t));
+    assert(track);
+    track->length = source->length;
+    track->event_list = NULL;
+    track->ref_count = 1;
+    track->block = NULL;
+    track->tick_index = NULL;
+    track->shared_data = shared;
+    init_track_memory(track);
+    if (num_events) {
+      track->block = malloc(num_events * (sizeof(event_node_t) +
+            sizeof(event_t)) + channel_size);
+      assert(track->block);
+      track->event_list = track->block;
+    }
+    nodes[i] = track->block;
+    events[i] = (event_t *) (nodes[i] + num_events);
+    data[i] = (uint8_t *) (events[i] + num_events);
+    memset(tables[i], voices[members[i]].instrument, sizeof(remapping_t));
+    rounds[members[i]] = malloc(sizeof(track_node_t));
+    assert(rounds[members[i]]);
+    rounds[members[i]]->next_track = NULL;
+    rounds[members[i]]->track = track;
+  }
+
+  event_list = source->event_list;
+  for (uint32_t position = 0; position < num_events; position++) {
+    event_t *event = event_list->event;
+    uint32_t data_len = 0;
+    uint8_t **source_data = event_data(event, &data_len);
+    bool has_channel = (event_type(event) == MIDI_EVENT_T) &&
+      (event->midi_event.status < SYS_EVENT_1);
+    uint8_t *shared_data = *source_data;
+    if ((!has_channel) && (data_len)) {
+      memcpy(shared_cursor, *source_data, data_len);
+      shared_data = shared_cursor;
+      shared_cursor += data_len;
+    }
+    for (int i = 0; i < num_members; i++) {
+      event_t *copy = &events[i][position];
+      *copy = *event;
+      if (has_channel) {
+        if (data_len) {
+          memcpy(data[i], *source_data, data_len);
+          *event_data(copy, &data_len) = data[i];
+          data[i] += data_len;
+        }
+        copy->midi_event.status = (copy->midi_event.status &
+            CLEAR_FOUR_MASK) | channels[members[i]];
+        if (copy->type & MIDI_MIN) {
+          copy->type = copy->midi_event.status;
+        }
+        change_event_octave(copy, &voices[members[i]].octave_difference);
+        change_event_instrument(copy, tables[i]);
+      }
+      else {
+        *event_data(copy, &data_len) = shared_data;
+      }
+      nodes[i][position].event = copy;
+      account_event(rounds[members[i]]->track, copy);
+      nodes[i][position].next_event = (position + 1 < num_events) ?
+        &nodes[i][position + 1] : NULL;
+    }
+    event_list = event_list->next_event;
+  }
+
+  for (int i = 0; (i < num_members) && (num_events); i++) {
+    uint32_t old_delta = events[i][0].delta_time;
+    events[i][0].delta_time += voices[members[i]].time_delay;
+    rounds[members[i]]->track->length += vlq_size_difference(old_delta,
+        events[i][0].delta_time);
+  }
+} /* build_voices() */
 
 /*
- * duplicates the events from a given event list
+ * adds a copy of a track to the end of the track list for every voice, in
+ * order, as add_round() would. The channels of all voices are picked first,
+ * each the lowest one unused by its source track and by earlier voices, and
+ * each source track is then read once for all of its voices. Returns the
+ * number of tracks added
  */
 
-event_node_t *duplicate_events(event_node_t *list, int lowest_channel) {
-  if (list == NULL) {
-    return NULL;
+int add_rounds(song_data_t *song, round_voice_t *voices, int num_voices) {
+  assert(song);
+  assert(song->format != 2);
+  assert((voices) || (num_voices == 0));
+  assert(num_voices <= CHANNEL_MAX + 1);
+  if (num_voices == 0) {
+    return 0;
   }
-  event_node_t *event = malloc(sizeof(event_node_t));
-  assert(event);
-  event->event = malloc(sizeof(event_t));
-  assert(event->event);
-  event->event = list->event;
-  //printf("%x\n", event->event->type);
-  if (event->event->type == META_EVENT) {
-    if (event->event->meta_event.data_len) {
-      event->event->meta_event.data = malloc(sizeof(uint8_t) *
-          event->event->meta_event.data_len);
-      assert(event->event->meta_event.data);
-      for (int i = 0; i < event->event->meta_event.data_len; i++) {
-        event->event->meta_event.data[i] = list->event->meta_event.data[i];
+  STAT_START(start);
+  track_node_t *sources[CHANNEL_MAX + 1];
+  uint16_t used[CHANNEL_MAX + 1];
+  int channels[CHANNEL_MAX + 1];
+  track_node_t *rounds[CHANNEL_MAX + 1];
+  uint16_t taken = 0;
+  for (int i = 0; i < num_voices; i++) {
+    assert(voices[i].track_index < song->num_tracks);
+    sources[i] = song->track_list;
+    for (int j = 0; j < voices[i].track_index; j++) {
+      sources[i] = sources[i]->next_track;
+    }
+    //  Scan each source track once
+    int scanned = 0;
+    while ((scanned < i) && (sources[scanned] != sources[i])) {
+      scanned++;
+    }
+    used[i] = (scanned < i) ? used[scanned] :
+      track_channels(sources[i]->track);
+    channels[i] = CHANNEL_MAX + 1;
+    for (int channel = 0; channel <= CHANNEL_MAX; channel++) {
+      if (!((used[i] | taken) & (1 << channel))) {
+        channels[i] = channel;
+        break;
       }
     }
+    assert(channels[i] <= CHANNEL_MAX);
+    taken |= 1 << channels[i];
   }
-  else if ((event->event->type == SYS_EVENT_1) || (event->event->type ==
-        SYS_EVENT_2)) {
-    if (event->event->sys_event.data_len) {
-      event->event->sys_event.data = malloc(sizeof(uint8_t) *
-          event->event->sys_event.data_len);
-      assert(event->event->sys_event.data);
-      for (int i = 0; i < event->event->sys_event.data_len; i++) {
-        event->event->sys_event.data[i] = list->event->sys_event.data[i];
+
+  bool built[CHANNEL_MAX + 1] = {false};
+  for (int i = 0; i < num_voices; i++) {
+    if (built[i]) {
+      continue;
+    }
+    int members[CHANNEL_MAX + 1];
+    int num_members = 0;
+    for (int j = i; j < num_voices; j++) {
+      if (sources[j] == sources[i]) {
+        members[num_members++] = j;
+        built[j] = true;
       }
     }
+    build_voices(sources[i]->track, voices, channels, members, num_members,
+        rounds);
   }
-  else {
-    event->event->type = ((CLEAR_FOUR_MASK & event->event->type) |
-        lowest_channel);
-    //printf("%x\n", event->event->type);
-    if (event->event->midi_event.data_len) {
-      event->event->midi_event.data = malloc(sizeof(uint8_t) *
-          event->event->midi_event.data_len);
-      assert(event->event->midi_event.data);
-      for (int i = 0; i < event->event->midi_event.data_len; i++) {
-        event->event->midi_event.data[i] = list->event->midi_event.data[i];
-      }
+
+  track_node_t *tail = song->track_list;
+  while (tail->next_track) {
+    tail = tail->next_track;
+  }
+  for (int i = 0; i < num_voices; i++) {
+    tail->next_track = rounds[i];
+    tail = rounds[i];
+    attach_track_memory(song, rounds[i]->track);
+  }
+  song->num_tracks += num_voices;
+  invalidate_tempo_map(song);
+  //  The notes of the other tracks are unchanged
+  uint64_t first_tick = UINT64_MAX;
+  for (int i = 0; i < num_voices; i++) {
+    event_node_t *event_list = rounds[i]->track->event_list;
+    if ((event_list) && (event_list->event->delta_time < first_tick)) {
+      first_tick = event_list->event->delta_time;
     }
   }
-  event->next_event = duplicate_events(list->next_event, lowest_channel);
-  return event;
-} /* duplicate_events() */
+  if (first_tick != UINT64_MAX) {
+    invalidate_notes_from(song, first_tick);
+  }
+  STAT_STOP(TIMER_ADD_ROUND, start);
+  return num_voices;
+} /* add_rounds() */
 
 /*
  * Function called prior to main that sets up random mapping tables
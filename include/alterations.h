@@ -4,6 +4,13 @@
 #include "parser.h"
 
 #define OCTAVE_STEP (12)
+#define NOTE_MAX (127)
+#define NOTE_MIN (0)
+#define MIDI_MIN (0x80)
+#define NOTE_EVENT_MAX (0xAF)
+#define PROGRAM_CHANGE_MIN (0xC0)
+#define PROGRAM_CHANGE_MAX (0xCF)
+#define PIPELINE_MAX_STAGES (16)
 
 typedef uint8_t remapping_t[0x100];
 
@@ -14,8 +21,16 @@ int change_event_time(event_t *, float *);
 int change_event_instrument(event_t *, remapping_t);
 int change_event_note(event_t *, remapping_t);
 
+//  Column alterations, given the status and first data byte of many events
+typedef int (*column_func_t)(const uint8_t *, uint8_t *, uint32_t, void *);
+
 //  Helpers
 int apply_to_events(song_data_t *, event_func_t, void *);
+int apply_to_columns(song_data_t *, column_func_t, void *);
+
+//  Track-parallel helpers, 0 threads uses one per online processor
+int apply_to_events_parallel(song_data_t *, event_func_t, void *, int);
+int warp_time_parallel(song_data_t *, float, int);
 
 //  Wrappers (song-level event alterations)
 int change_octave(song_data_t *, int);
@@ -23,9 +38,60 @@ int warp_time(song_data_t *, float);
 int remap_instruments(song_data_t *, remapping_t);
 int remap_notes(song_data_t *song, remapping_t instrument_table);
 
+//  Fused transform pipelines
+typedef enum {
+  STAGE_OCTAVE,
+  STAGE_TIME,
+  STAGE_INSTRUMENTS,
+  STAGE_NOTES,
+  STAGE_FUNCTION,
+} stage_kind_t;
+
+typedef struct pipeline_stage_s {
+  stage_kind_t kind;
+  union {
+    //  STAGE_OCTAVE
+    int octaves;
+    //  STAGE_TIME
+    float multiplier;
+    //  STAGE_INSTRUMENTS and STAGE_NOTES
+    uint8_t *table;
+    //  STAGE_FUNCTION
+    struct {
+      event_func_t function;
+      void *data;
+    };
+  };
+  //  What the matching wrapper would have returned after the last run
+  int result;
+} pipeline_stage_t;
+
+typedef struct transform_pipeline_s {
+  int num_stages;
+  pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+} transform_pipeline_t;
+
+void init_pipeline(transform_pipeline_t *);
+int pipeline_add_octave(transform_pipeline_t *, int);
+int pipeline_add_warp(transform_pipeline_t *, float);
+int pipeline_add_instruments(transform_pipeline_t *, remapping_t);
+int pipeline_add_notes(transform_pipeline_t *, remapping_t);
+int pipeline_add_function(transform_pipeline_t *, event_func_t, void *);
+int run_pipeline(song_data_t *, transform_pipeline_t *);
+
 //	Major functions
 void add_round(song_data_t *, int, int, unsigned int, uint8_t);
 
+//  One voice of a canon, the arguments of a single add_round() call
+typedef struct round_voice_s {
+  int track_index;
+  int octave_difference;
+  unsigned int time_delay;
+  uint8_t instrument;
+} round_voice_t;
+
+int add_rounds(song_data_t *, round_voice_t *, int);
+
 //  Remapping tables
 remapping_t I_BRASS_BAND;
 remapping_t I_HELICOPTER;
@@ -0,0 +1,272 @@
+/* Name, compact_track.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "compact_track.h"
+#include "song_pack.h"
+#include "payload_pool.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define VLQ_CONTINUE (0x80)
+#define VLQ_MASK (0x7F)
+#define VLQ_SHIFT (7)
+#define VLQ_MAX_BYTES (5)
+#define STATUS_BIT (0x80)
+
+uint32_t pool_vlq_size(uint32_t value);
+uint32_t pool_write_vlq(uint8_t *pool, uint32_t value);
+uint32_t pool_read_vlq(const uint8_t *pool, uint32_t *position);
+uint32_t payload_offset(compact_event_t *event);
+
+/*
+ * returns the number of bytes of the value as a VLQ
+ */
+
+uint32_t pool_vlq_size(uint32_t value) {
+  uint32_t size = 1;
+  while (value >>= VLQ_SHIFT) {
+    size++;
+  }
+  return size;
+} /* pool_vlq_size() */
+
+/*
+ * writes the value as a VLQ and returns the number of bytes written
+ */
+
+uint32_t pool_write_vlq(uint8_t *pool, uint32_t value) {
+  uint8_t bytes[VLQ_MAX_BYTES];
+  uint32_t count = 0;
+  do {
+    bytes[count++] = value & VLQ_MASK;
+    value >>= VLQ_SHIFT;
+  } while (value);
+  for (uint32_t i = 0; i < count; i++) {
+    pool[i] = bytes[count - 1 - i] | ((i + 1 < count) ? VLQ_CONTINUE : 0);
+  }
+  return count;
+} /* pool_write_vlq() */
+
+/*
+ * reads a VLQ at the position and moves the position past it
+ */
+
+uint32_t pool_read_vlq(const uint8_t *pool, uint32_t *position) {
+  uint32_t value = 0;
+  uint8_t read = 0;
+  do {
+    read = pool[(*position)++];
+    value = (value << VLQ_SHIFT) | (read & VLQ_MASK);
+  } while (read & VLQ_CONTINUE);
+  return value;
+} /* pool_read_vlq() */
+
+/*
+ * returns the pool offset stored in a meta or system event
+ */
+
+uint32_t payload_offset(compact_event_t *event) {
+  return event->data[0] | (event->data[1] << 8) |
+    ((uint32_t) event->data[2] << 16);
+} /* payload_offset() */
+
+/*
+ * builds the compact form of the track. The track is left unchanged
+ */
+
+compact_track_t *compact_track(track_t *track) {
+  assert(track);
+  compact_track_t *compact = malloc(sizeof(compact_track_t));
+  assert(compact);
+  compact->length = track->length;
+  compact->num_events = 0;
+  compact->pool_size = 0;
+  event_node_t *list = track->event_list;
+  while (list) {
+    event_t *event = list->event;
+    if (event->type == META_EVENT) {
+      compact->pool_size += 1 + pool_vlq_size(event->meta_event.data_len) +
+        event->meta_event.data_len;
+    }
+    else if ((event->type == SYS_EVENT_1) || (event->type == SYS_EVENT_2)) {
+      compact->pool_size += pool_vlq_size(event->sys_event.data_len) +
+        event->sys_event.data_len;
+    }
+    compact->num_events++;
+    list = list->next_event;
+  }
+  compact->events = malloc(sizeof(compact_event_t) *
+      (compact->num_events ? compact->num_events : 1));
+  assert(compact->events);
+  compact->pool = malloc(compact->pool_size ? compact->pool_size : 1);
+  assert(compact->pool);
+
+  uint32_t offset = 0;
+  compact_event_t *next = compact->events;
+  list = track->event_list;
+  while (list) {
+    event_t *event = list->event;
+    next->delta_time = event->delta_time;
+    memset(next->data, 0, sizeof(next->data));
+    if ((event->type == META_EVENT) || (event->type == SYS_EVENT_1) ||
+        (event->type == SYS_EVENT_2)) {
+      assert(offset <= POOL_OFFSET_MAX);
+      next->status = event->type;
+      next->data[0] = offset & 0xFF;
+      next->data[1] = (offset >> 8) & 0xFF;
+      next->data[2] = offset >> 16;
+      uint32_t data_len = event->sys_event.data_len;
+      uint8_t *data = event->sys_event.data;
+      if (event->type == META_EVENT) {
+        compact->pool[offset++] = meta_event_type(event);
+        data_len = event->meta_event.data_len;
+        data = event->meta_event.data;
+      }
+      offset += pool_write_vlq(compact->pool + offset, data_len);
+      if (data_len) {
+        memcpy(compact->pool + offset, data, data_len);
+      }
+      offset += data_len;
+    }
+    else {
+      next->status = event->midi_event.status;
+      if (event->midi_event.data_len) {
+        memcpy(next->data, event->midi_event.data,
+            event->midi_event.data_len);
+      }
+      if (!(event->type & STATUS_BIT)) {
+        next->data[2] = RUNNING_STATUS;
+      }
+    }
+    next++;
+    list = list->next_event;
+  }
+  return compact;
+} /* compact_track() */
+
+/*
+ * rebuilds the editable event list of a compact track
+ */
+
+track_t *expand_compact_track(compact_track_t *compact) {
+  assert(compact);
+  track_t *track = malloc(sizeof(track_t));
+  assert(track);
+  track->length = compact->length;
+  track->ref_count = 1;
+  track->block = NULL;
+  track->tick_index = NULL;
+  track->shared_data = NULL;
+  track->event_list = NULL;
+  init_track_memory(track);
+  event_node_t **tail = &track->event_list;
+  for (uint32_t i = 0; i < compact->num_events; i++) {
+    compact_event_t *next = &compact->events[i];
+    event_t *event = malloc(sizeof(event_t));
+    assert(event);
+    memset(event, 0, sizeof(event_t));
+    event->delta_time = next->delta_time;
+    event->type = next->status;
+    const uint8_t *data = NULL;
+    uint32_t data_len = compact_event_data(compact, next, &data);
+    if (next->status == META_EVENT) {
+      uint8_t meta_type = compact_meta_type(compact, next);
+      event->meta_event.name = META_TABLE[meta_type].name;
+      event->meta_event.data_len = data_len;
+      event->meta_event.data = META_TABLE[meta_type].data;
+      if (data_len) {
+        event->meta_event.data = copy_payload(data, data_len);
+      }
+    }
+    else if ((next->status == SYS_EVENT_1) ||
+        (next->status == SYS_EVENT_2)) {
+      event->sys_event.data_len = data_len;
+      if (data_len) {
+        event->sys_event.data = copy_payload(data, data_len);
+      }
+    }
+    else {
+      if (next->data[2] == RUNNING_STATUS) {
+        event->type = next->data[0];
+      }
+      event->midi_event = MIDI_TABLE[next->status];
+      if (data_len) {
+        event->midi_event.data = malloc(data_len);
+        assert(event->midi_event.data);
+        memcpy(event->midi_event.data, data, data_len);
+      }
+    }
+
+    event_node_t *node = malloc(sizeof(event_node_t));
+    assert(node);
+    node->event = event;
+    node->next_event = NULL;
+    *tail = node;
+    tail = &node->next_event;
+    account_event(track, event);
+  }
+  return track;
+} /* expand_compact_track() */
+
+/*
+ * frees the compact track
+ */
+
+void free_compact_track(compact_track_t *compact) {
+  free(compact->events);
+  compact->events = NULL;
+  free(compact->pool);
+  compact->pool = NULL;
+  free(compact);
+  compact = NULL;
+} /* free_compact_track() */
+
+/*
+ * returns the table name of the event, or NULL for system events
+ */
+
+const char *compact_event_name(compact_track_t *compact,
+    compact_event_t *event) {
+  if (event->status == META_EVENT) {
+    return META_TABLE[compact_meta_type(compact, event)].name;
+  }
+  if ((event->status == SYS_EVENT_1) || (event->status == SYS_EVENT_2)) {
+    return NULL;
+  }
+  return MIDI_TABLE[event->status].name;
+} /* compact_event_name() */
+
+/*
+ * returns the meta type of a meta event
+ */
+
+uint8_t compact_meta_type(compact_track_t *compact, compact_event_t *event) {
+  assert(event->status == META_EVENT);
+  return compact->pool[payload_offset(event)];
+} /* compact_meta_type() */
+
+/*
+ * points data at the data bytes of the event and returns how many there are
+ */
+
+uint32_t compact_event_data(compact_track_t *compact, compact_event_t *event,
+    const uint8_t **data) {
+  if ((event->status != META_EVENT) && (event->status != SYS_EVENT_1) &&
+      (event->status != SYS_EVENT_2)) {
+    *data = event->data;
+    return MIDI_TABLE[event->status].data_len;
+  }
+  uint32_t position = payload_offset(event);
+  if (event->status == META_EVENT) {
+    position++;
+  }
+  uint32_t data_len = pool_read_vlq(compact->pool, &position);
+  *data = compact->pool + position;
+  return data_len;
+} /* compact_event_data() */
@@ -0,0 +1,40 @@
+#ifndef _COMPACT_TRACK_H
+#define _COMPACT_TRACK_H
+
+#include "parser.h"
+
+//  Set in data[2] of MIDI events read with running status
+#define RUNNING_STATUS (1)
+#define POOL_OFFSET_MAX ((1 << 24) - 1)
+
+//  Event in 8 bytes. MIDI events keep their data bytes inline, meta and
+//  system events keep the 24 bit offset of their payload in the pool of the
+//  track. Names are looked up from the status and meta type
+typedef struct compact_event_s {
+  uint32_t delta_time;
+  //  META_EVENT, SYS_EVENT_1, SYS_EVENT_2 or a MIDI status
+  uint8_t status;
+  uint8_t data[3];
+} compact_event_t;
+
+//  Fixed size events of a track stored back to back. Each payload in the
+//  pool is its meta type for meta events, then a VLQ length and the bytes
+typedef struct compact_track_s {
+  uint32_t length;
+  uint32_t num_events;
+  compact_event_t *events;
+  uint32_t pool_size;
+  uint8_t *pool;
+} compact_track_t;
+
+compact_track_t *compact_track(track_t *);
+track_t *expand_compact_track(compact_track_t *);
+void free_compact_track(compact_track_t *);
+
+//  Event fields
+const char *compact_event_name(compact_track_t *, compact_event_t *);
+uint8_t compact_meta_type(compact_track_t *, compact_event_t *);
+uint32_t compact_event_data(compact_track_t *, compact_event_t *,
+    const uint8_t **);
+
+#endif // _COMPACT_TRACK_H
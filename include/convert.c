@@ -0,0 +1,335 @@
+/* Name, convert.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "convert.h"
+#include "note_table.h"
+#include "song_pack.h"
+#include "tempo_map.h"
+#include "timeline.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define CHANNEL_MASK (0x0F)
+#define STATUS_BIT (0x80)
+#define VLQ_1_BYTE_MAX (0x7F)
+#define VLQ_2_BYTE_MAX (0x3FFF)
+#define VLQ_3_BYTE_MAX (0x1FFFFF)
+
+//  Output track being filled in, with its nodes, events and data allocated
+//  together in one block
+typedef struct track_builder_s {
+  track_t *track;
+  event_node_t *nodes;
+  event_t *events;
+  uint8_t *data;
+  uint32_t num_events;
+  uint64_t last_tick;
+  //  Status a following event may leave out, 0 if none
+  uint8_t last_status;
+} track_builder_t;
+
+uint32_t vlq_size(uint32_t value);
+bool is_end_of_track(event_t *event);
+int split_track(event_t *event);
+void init_builder(track_builder_t *builder, uint32_t num_events,
+    uint32_t data_size);
+void builder_push(track_builder_t *builder, event_t *event, uint64_t tick);
+track_node_t *finish_builder(track_builder_t *builder);
+void replace_tracks(song_data_t *song, track_node_t *track_list);
+
+/*
+ * returns the number of bytes needed to store the value as a VLQ
+ */
+
+uint32_t vlq_size(uint32_t value) {
+  return 1 + (value > VLQ_1_BYTE_MAX) + (value > VLQ_2_BYTE_MAX) +
+    (value > VLQ_3_BYTE_MAX);
+} /* vlq_size() */
+
+/*
+ * returns the number of bytes the event takes up in a track chunk, counting
+ * its delta-time
+ */
+
+uint32_t event_size(event_t *event) {
+  assert(event);
+  uint32_t size = vlq_size(event->delta_time);
+  uint8_t type = event_type(event);
+  if (type == META_EVENT_T) {
+    //  0xFF and the meta type
+    return size + 2 + vlq_size(event->meta_event.data_len) +
+      event->meta_event.data_len;
+  }
+  else if (type == SYS_EVENT_T) {
+    return size + 1 + vlq_size(event->sys_event.data_len) +
+      event->sys_event.data_len;
+  }
+  //  Events using running status leave out the status byte
+  return size + ((event->type & STATUS_BIT) ? 1 : 0) +
+    event->midi_event.data_len;
+} /* event_size() */
+
+/*
+ * returns true if the event is an end of track meta event
+ */
+
+bool is_end_of_track(event_t *event) {
+  return (event->type == META_EVENT) &&
+    (meta_event_type(event) == END_OF_TRACK);
+} /* is_end_of_track() */
+
+/*
+ * returns the track convert_to_format_1() puts the event in
+ */
+
+int split_track(event_t *event) {
+  if ((event_type(event) == MIDI_EVENT_T) &&
+      (event->midi_event.status < SYS_EVENT_1)) {
+    return 1 + (event->midi_event.status & CHANNEL_MASK);
+  }
+  return CONDUCTOR_TRACK;
+} /* split_track() */
+
+/*
+ * allocates an empty track with room for num_events events and data_size
+ * bytes of event data
+ */
+
+void init_builder(track_builder_t *builder, uint32_t num_events,
+    uint32_t data_size) {
+  track_t *track = malloc(sizeof(track_t));
+  assert(track);
+  track->length = 0;
+  track->event_list = NULL;
+  track->ref_count = 1;
+  track->block = NULL;
+  track->tick_index = NULL;
+  track->shared_data = NULL;
+  init_track_memory(track);
+  if (num_events) {
+    track->block = malloc(num_events * (sizeof(event_node_t) +
+          sizeof(event_t)) + data_size);
+    assert(track->block);
+  }
+  builder->track = track;
+  builder->nodes = track->block;
+  builder->events = (event_t *) (builder->nodes + num_events);
+  builder->data = (uint8_t *) (builder->events + num_events);
+  builder->num_events = 0;
+  builder->last_tick = 0;
+  builder->last_status = 0;
+} /* init_builder() */
+
+/*
+ * appends a copy of the event at the absolute tick to the track. Running
+ * status is only kept where the previous event of the new track has the
+ * same status
+ */
+
+void builder_push(track_builder_t *builder, event_t *event, uint64_t tick) {
+  assert(tick >= builder->last_tick);
+  uint32_t position = builder->num_events++;
+  event_t *copy = &builder->events[position];
+  *copy = *event;
+  copy->delta_time = (uint32_t) (tick - builder->last_tick);
+  builder->last_tick = tick;
+  uint32_t data_len = 0;
+  uint8_t **data = event_data(event, &data_len);
+  if (data_len) {
+    memcpy(builder->data, *data, data_len);
+    *event_data(copy, &data_len) = builder->data;
+    builder->data += data_len;
+  }
+  if (event_type(copy) == MIDI_EVENT_T) {
+    if (((copy->type & STATUS_BIT) == 0) &&
+        (copy->midi_event.status != builder->last_status)) {
+      copy->type = copy->midi_event.status;
+    }
+    builder->last_status = (copy->midi_event.status < SYS_EVENT_1) ?
+      copy->midi_event.status : 0;
+  }
+  else {
+    builder->last_status = 0;
+  }
+  builder->nodes[position].event = copy;
+  builder->nodes[position].next_event = NULL;
+  account_event(builder->track, copy);
+  if (position) {
+    builder->nodes[position - 1].next_event = &builder->nodes[position];
+  }
+  builder->track->length += event_size(copy);
+} /* builder_push() */
+
+/*
+ * returns a new track node holding the built track
+ */
+
+track_node_t *finish_builder(track_builder_t *builder) {
+  track_node_t *node = malloc(sizeof(track_node_t));
+  assert(node);
+  builder->track->event_list = builder->num_events ? builder->nodes : NULL;
+  node->track = builder->track;
+  node->next_track = NULL;
+  return node;
+} /* finish_builder() */
+
+/*
+ * frees the tracks of the song and replaces them with the given list
+ */
+
+void replace_tracks(song_data_t *song, track_node_t *track_list) {
+  while (song->track_list) {
+    track_node_t *track_node = song->track_list;
+    song->track_list = song->track_list->next_track;
+    detach_track_memory(song, track_node->track);
+    free_track_node(track_node);
+  }
+  song->track_list = track_list;
+  song->num_tracks = 0;
+  while (track_list) {
+    attach_track_memory(song, track_list->track);
+    song->num_tracks++;
+    track_list = track_list->next_track;
+  }
+  invalidate_tempo_map(song);
+  invalidate_note_table(song);
+} /* replace_tracks() */
+
+/*
+ * merges every track of the song into a single track in absolute time,
+ * keeping one end of track event at the end, and makes it a format 0 song
+ */
+
+int convert_to_format_0(song_data_t *song) {
+  assert(song);
+  assert(song->format != 2);
+  if ((song->track_list == NULL) || (song->track_list->next_track == NULL)) {
+    song->format = 0;
+    return song->num_tracks;
+  }
+
+  uint32_t num_events = 1;
+  uint32_t data_size = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    event_node_t *event_list = track_list->track->event_list;
+    while (event_list) {
+      uint32_t data_len = 0;
+      event_data(event_list->event, &data_len);
+      data_size += data_len;
+      num_events++;
+      event_list = event_list->next_event;
+    }
+    track_list = track_list->next_track;
+  }
+
+  track_builder_t builder = {0};
+  init_builder(&builder, num_events, data_size);
+  event_t *end = NULL;
+  uint64_t end_tick = 0;
+  timeline_t *timeline = open_timeline(song, 0);
+  timeline_event_t next = {0};
+  while (timeline_next(timeline, &next)) {
+    if (is_end_of_track(next.event)) {
+      if ((end == NULL) || (next.tick >= end_tick)) {
+        end = next.event;
+        end_tick = next.tick;
+      }
+      continue;
+    }
+    builder_push(&builder, next.event, next.tick);
+  }
+  if (end) {
+    builder_push(&builder, end, (end_tick > builder.last_tick) ? end_tick :
+        builder.last_tick);
+  }
+  close_timeline(timeline);
+  timeline = NULL;
+
+  replace_tracks(song, finish_builder(&builder));
+  song->format = 0;
+  return song->num_tracks;
+} /* convert_to_format_0() */
+
+/*
+ * splits the song into a conductor track with every event that has no
+ * channel, followed by one track per channel in use, each ending with an
+ * end of track event, and makes it a format 1 song. Songs with several
+ * tracks are merged first
+ */
+
+int convert_to_format_1(song_data_t *song) {
+  assert(song);
+  assert(song->format != 2);
+  convert_to_format_0(song);
+  if (song->track_list == NULL) {
+    song->format = 1;
+    return 0;
+  }
+
+  uint32_t num_events[SPLIT_TRACKS] = {0};
+  uint32_t data_size[SPLIT_TRACKS] = {0};
+  event_t *end = NULL;
+  uint64_t end_tick = 0;
+  uint64_t tick = 0;
+  event_node_t *event_list = song->track_list->track->event_list;
+  while (event_list) {
+    event_t *event = event_list->event;
+    tick += event->delta_time;
+    if (is_end_of_track(event)) {
+      end = event;
+      end_tick = tick;
+    }
+    else {
+      int split = split_track(event);
+      uint32_t data_len = 0;
+      event_data(event, &data_len);
+      num_events[split]++;
+      data_size[split] += data_len;
+    }
+    event_list = event_list->next_event;
+  }
+
+  track_builder_t builders[SPLIT_TRACKS];
+  for (int i = 0; i < SPLIT_TRACKS; i++) {
+    if ((i == CONDUCTOR_TRACK) || (num_events[i])) {
+      init_builder(&builders[i], num_events[i] + (end ? 1 : 0),
+          data_size[i]);
+    }
+  }
+  tick = 0;
+  event_list = song->track_list->track->event_list;
+  while (event_list) {
+    event_t *event = event_list->event;
+    tick += event->delta_time;
+    if (!is_end_of_track(event)) {
+      builder_push(&builders[split_track(event)], event, tick);
+    }
+    event_list = event_list->next_event;
+  }
+
+  track_node_t *track_list = NULL;
+  track_node_t **tail = &track_list;
+  for (int i = 0; i < SPLIT_TRACKS; i++) {
+    if ((i != CONDUCTOR_TRACK) && (num_events[i] == 0)) {
+      continue;
+    }
+    if (end) {
+      uint64_t last_tick = builders[i].last_tick;
+      builder_push(&builders[i], end, (end_tick > last_tick) ? end_tick :
+          last_tick);
+    }
+    *tail = finish_builder(&builders[i]);
+    tail = &(*tail)->next_track;
+  }
+
+  replace_tracks(song, track_list);
+  song->format = 1;
+  return song->num_tracks;
+} /* convert_to_format_1() */
@@ -0,0 +1,20 @@
+#ifndef _CONVERT_H
+#define _CONVERT_H
+
+#include "parser.h"
+
+#define END_OF_TRACK (0x2F)
+
+//  Tracks a format 0 song is split into: one for events without a channel,
+//  then one per MIDI channel
+#define CONDUCTOR_TRACK (0)
+#define SPLIT_TRACKS (17)
+
+//  Both return the new number of tracks of the song
+int convert_to_format_0(song_data_t *);
+int convert_to_format_1(song_data_t *);
+
+//  Number of bytes the event takes up in a track chunk
+uint32_t event_size(event_t *);
+
+#endif // _CONVERT_H
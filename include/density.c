@@ -0,0 +1,395 @@
+/* Name, density.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "density.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+bool g_density_on_load = false;
+
+//  Note time summed over one base bucket
+typedef struct bucket_sum_s {
+  uint64_t start;
+  uint64_t end;
+  uint64_t bands[PITCH_BANDS];
+  uint64_t programs[NUM_PITCHES];
+} bucket_sum_t;
+
+void size_density_cache(density_cache_t *cache, note_table_t *table);
+void add_note_density(note_interval_t *note, void *sum);
+void fill_base_buckets(density_cache_t *cache, note_table_t *table,
+    uint32_t first, uint32_t last);
+void fill_upper_buckets(density_cache_t *cache, uint32_t first,
+    uint32_t last);
+void *density_worker(void *cache);
+void finish_density_build(density_cache_t *cache);
+bool same_note(note_interval_t *note_1, note_interval_t *note_2);
+void changed_notes_range(note_table_t *old_table, note_table_t *new_table,
+    uint64_t *from, uint64_t *to);
+void keep_filled_notes(density_cache_t *cache, note_table_t *table,
+    bool owned);
+
+/*
+ * allocates the levels of the cache for the notes of the table. Base
+ * buckets are the shortest power of two ticks that keeps their number
+ * under BASE_BUCKETS_MAX
+ */
+
+void size_density_cache(density_cache_t *cache, note_table_t *table) {
+  cache->last_tick = table->last_tick;
+  cache->longest_note = table->longest_note;
+  uint64_t length = table->last_tick + 1;
+  uint8_t shift = 0;
+  while ((length >> shift) >= BASE_BUCKETS_MAX) {
+    shift++;
+  }
+  uint32_t num_base = (uint32_t) (length >> shift) + 1;
+  cache->num_levels = 0;
+  while (cache->num_levels < DENSITY_MAX_LEVELS) {
+    density_level_t *level = &cache->levels[cache->num_levels];
+    level->shift = shift + cache->num_levels;
+    level->num_buckets = ((num_base - 1) >> cache->num_levels) + 1;
+    level->density = malloc(sizeof(uint32_t) * level->num_buckets *
+        PITCH_BANDS);
+    assert(level->density);
+    level->programs = malloc(level->num_buckets);
+    assert(level->programs);
+    cache->num_levels++;
+    if (level->num_buckets == 1) {
+      break;
+    }
+  }
+} /* size_density_cache() */
+
+/*
+ * adds the time the note sounds inside the bucket to its pitch band and
+ * program
+ */
+
+void add_note_density(note_interval_t *note, void *data) {
+  bucket_sum_t *sum = data;
+  uint64_t start = (note->start > sum->start) ? note->start : sum->start;
+  uint64_t end = (note->end < sum->end) ? note->end : sum->end;
+  sum->bands[(note->pitch & (NUM_PITCHES - 1)) / BAND_PITCHES] +=
+    end - start;
+  sum->programs[note->program & (NUM_PITCHES - 1)] += end - start;
+} /* add_note_density() */
+
+/*
+ * recomputes base buckets first to last from the notes of the table, one
+ * interval tree query per bucket
+ */
+
+void fill_base_buckets(density_cache_t *cache, note_table_t *table,
+    uint32_t first, uint32_t last) {
+  density_level_t *level = &cache->levels[0];
+  bucket_sum_t sum = {0};
+  for (uint32_t bucket = first; bucket <= last; bucket++) {
+    memset(&sum, 0, sizeof(bucket_sum_t));
+    sum.start = (uint64_t) bucket << level->shift;
+    sum.end = sum.start + (1ull << level->shift);
+    notes_in_range(table, sum.start, sum.end, add_note_density, &sum);
+    for (int band = 0; band < PITCH_BANDS; band++) {
+      level->density[bucket * PITCH_BANDS + band] = (uint32_t)
+        ((sum.bands[band] * DENSITY_ONE) >> level->shift);
+    }
+    level->programs[bucket] = NO_PROGRAM;
+    uint64_t most = 0;
+    for (int program = 0; program < NUM_PITCHES; program++) {
+      if (sum.programs[program] > most) {
+        most = sum.programs[program];
+        level->programs[bucket] = program;
+      }
+    }
+  }
+} /* fill_base_buckets() */
+
+/*
+ * recomputes the buckets of every upper level covering base buckets first
+ * to last. A bucket averages the density of its two children and takes the
+ * program of the denser one
+ */
+
+void fill_upper_buckets(density_cache_t *cache, uint32_t first,
+    uint32_t last) {
+  for (uint32_t i = 1; i < cache->num_levels; i++) {
+    density_level_t *below = &cache->levels[i - 1];
+    density_level_t *level = &cache->levels[i];
+    first >>= 1;
+    last >>= 1;
+    for (uint32_t bucket = first; bucket <= last; bucket++) {
+      uint32_t *left = &below->density[2 * bucket * PITCH_BANDS];
+      uint32_t *right = left + PITCH_BANDS;
+      bool has_right = 2 * bucket + 1 < below->num_buckets;
+      uint64_t left_total = 0;
+      uint64_t right_total = 0;
+      for (int band = 0; band < PITCH_BANDS; band++) {
+        uint32_t right_density = has_right ? right[band] : 0;
+        level->density[bucket * PITCH_BANDS + band] =
+          (uint32_t) (((uint64_t) left[band] + right_density) / 2);
+        left_total += left[band];
+        right_total += right_density;
+      }
+      level->programs[bucket] = (right_total > left_total) ?
+        below->programs[2 * bucket + 1] : below->programs[2 * bucket];
+    }
+  }
+} /* fill_upper_buckets() */
+
+/*
+ * fills every level of the cache from its snapshot of the notes
+ */
+
+void *density_worker(void *data) {
+  density_cache_t *cache = data;
+  uint32_t last = cache->levels[0].num_buckets - 1;
+  fill_base_buckets(cache, cache->snapshot, 0, last);
+  fill_upper_buckets(cache, 0, last);
+  __atomic_store_n(&cache->ready, 1, __ATOMIC_RELEASE);
+  return NULL;
+} /* density_worker() */
+
+/*
+ * collects the background build if it is done
+ */
+
+void finish_density_build(density_cache_t *cache) {
+  if ((!cache->building) || (!__atomic_load_n(&cache->ready,
+          __ATOMIC_ACQUIRE))) {
+    return;
+  }
+  int join_return = pthread_join(cache->thread, NULL);
+  assert(join_return == 0);
+  keep_filled_notes(cache, cache->snapshot, true);
+  cache->snapshot = NULL;
+  cache->building = false;
+} /* finish_density_build() */
+
+/*
+ * makes table the notes the buckets were filled from, freeing the previous
+ * ones if the cache owned them
+ */
+
+void keep_filled_notes(density_cache_t *cache, note_table_t *table,
+    bool owned) {
+  if ((cache->owns_filled) && (cache->filled != table)) {
+    free_note_table(cache->filled);
+  }
+  cache->filled = table;
+  cache->owns_filled = owned;
+} /* keep_filled_notes() */
+
+/*
+ * returns true if both notes are the same
+ */
+
+bool same_note(note_interval_t *note_1, note_interval_t *note_2) {
+  return (note_1->start == note_2->start) && (note_1->end == note_2->end) &&
+    (note_1->pitch == note_2->pitch) &&
+    (note_1->velocity == note_2->velocity) &&
+    (note_1->channel == note_2->channel) &&
+    (note_1->program == note_2->program) && (note_1->track == note_2->track);
+} /* same_note() */
+
+/*
+ * widens from and to over every note of either table that the other does
+ * not have. Both are ordered by start, so the notes outside the longest
+ * common prefix and suffix are compared
+ */
+
+void changed_notes_range(note_table_t *old_table, note_table_t *new_table,
+    uint64_t *from, uint64_t *to) {
+  uint32_t old_count = old_table->num_notes;
+  uint32_t new_count = new_table->num_notes;
+  uint32_t prefix = 0;
+  while ((prefix < old_count) && (prefix < new_count) &&
+      (same_note(&old_table->notes[prefix], &new_table->notes[prefix]))) {
+    prefix++;
+  }
+  while ((old_count > prefix) && (new_count > prefix) &&
+      (same_note(&old_table->notes[old_count - 1],
+                 &new_table->notes[new_count - 1]))) {
+    old_count--;
+    new_count--;
+  }
+  note_table_t *tables[2] = {old_table, new_table};
+  uint32_t counts[2] = {old_count, new_count};
+  for (int i = 0; i < 2; i++) {
+    for (uint32_t j = prefix; j < counts[i]; j++) {
+      note_interval_t *note = &tables[i]->notes[j];
+      if (note->start < *from) {
+        *from = note->start;
+      }
+      if (note->end > *to) {
+        *to = note->end;
+      }
+    }
+  }
+} /* changed_notes_range() */
+
+/*
+ * replaces the density cache of the song with one built by a background
+ * thread. The notes are paired on the calling thread, since the song may be
+ * altered while the buckets are filled
+ */
+
+density_cache_t *start_density_cache(song_data_t *song) {
+  assert(song);
+  if (song->density) {
+    free_density_cache(song->density);
+    song->density = NULL;
+  }
+  density_cache_t *cache = malloc(sizeof(density_cache_t));
+  assert(cache);
+  memset(cache, 0, sizeof(density_cache_t));
+  cache->snapshot = build_note_table(song);
+  size_density_cache(cache, cache->snapshot);
+  cache->dirty_from = UINT64_MAX;
+  cache->dirty_to = 0;
+  cache->building = true;
+  int create_return = pthread_create(&cache->thread, NULL, density_worker,
+      cache);
+  assert(create_return == 0);
+  song->density = cache;
+  account_song_caches(song);
+  return cache;
+} /* start_density_cache() */
+
+/*
+ * returns the density cache of the song once it is ready, or NULL while it
+ * is being built, starting the build if needed. Buckets holding notes that
+ * changed since are recomputed first: those within a longest note of the
+ * events altered, and those of any later note paired differently, found by
+ * comparing with the notes the buckets were filled from. The whole cache is
+ * rebuilt in the background instead if all of the song changed or it grew
+ * past the last bucket
+ */
+
+density_cache_t *song_density(song_data_t *song) {
+  assert(song);
+  density_cache_t *cache = song->density;
+  if (cache == NULL) {
+    start_density_cache(song);
+    return NULL;
+  }
+  finish_density_build(cache);
+  if (cache->building) {
+    return NULL;
+  }
+  if (cache->dirty_from != UINT64_MAX) {
+    note_table_t *table = song_note_table(song);
+    density_level_t *base = &cache->levels[0];
+    if (((cache->dirty_from == 0) && (cache->dirty_to == UINT64_MAX)) ||
+        (((table->last_tick + 1) >> base->shift) >= base->num_buckets)) {
+      start_density_cache(song);
+      return NULL;
+    }
+    uint64_t longest = (table->longest_note > cache->longest_note) ?
+      table->longest_note : cache->longest_note;
+    uint64_t from = (cache->dirty_from > longest) ?
+      cache->dirty_from - longest : 0;
+    uint64_t to = (cache->dirty_to < UINT64_MAX - longest) ?
+      cache->dirty_to + longest : UINT64_MAX;
+    if (cache->filled) {
+      changed_notes_range(cache->filled, table, &from, &to);
+    }
+    uint32_t first = (uint32_t) (from >> base->shift);
+    uint32_t last = ((to >> base->shift) < base->num_buckets) ?
+      (uint32_t) (to >> base->shift) : base->num_buckets - 1;
+    if (first <= last) {
+      fill_base_buckets(cache, table, first, last);
+      fill_upper_buckets(cache, first, last);
+    }
+    cache->last_tick = table->last_tick;
+    cache->longest_note = table->longest_note;
+    cache->dirty_from = UINT64_MAX;
+    cache->dirty_to = 0;
+    keep_filled_notes(cache, table, false);
+    account_song_caches(song);
+  }
+  return cache;
+} /* song_density() */
+
+/*
+ * marks the buckets out of date after events from tick first to tick last
+ * changed, UINT64_MAX as last if every later tick may have changed. The
+ * buckets are widened by the notes sounding at either end when refilled
+ */
+
+void invalidate_density(density_cache_t *cache, uint64_t first,
+    uint64_t last) {
+  assert(cache);
+  assert(first <= last);
+  if (first < cache->dirty_from) {
+    cache->dirty_from = first;
+  }
+  if (last > cache->dirty_to) {
+    cache->dirty_to = last;
+  }
+} /* invalidate_density() */
+
+/*
+ * frees the cache, waiting for its background build if needed
+ */
+
+void free_density_cache(density_cache_t *cache) {
+  if (cache->building) {
+    int join_return = pthread_join(cache->thread, NULL);
+    assert(join_return == 0);
+    free_note_table(cache->snapshot);
+    cache->snapshot = NULL;
+  }
+  keep_filled_notes(cache, NULL, false);
+  for (uint32_t i = 0; i < cache->num_levels; i++) {
+    free(cache->levels[i].density);
+    cache->levels[i].density = NULL;
+    free(cache->levels[i].programs);
+    cache->levels[i].programs = NULL;
+  }
+  free(cache);
+  cache = NULL;
+} /* free_density_cache() */
+
+/*
+ * returns the number of bytes held by the cache, with the notes it keeps
+ * of its own. 0 if there is none
+ */
+
+uint64_t density_cache_size(density_cache_t *cache) {
+  if (cache == NULL) {
+    return 0;
+  }
+  uint64_t size = sizeof(density_cache_t);
+  for (uint32_t i = 0; i < cache->num_levels; i++) {
+    size += (uint64_t) cache->levels[i].num_buckets *
+      (sizeof(uint32_t) * PITCH_BANDS + sizeof(uint8_t));
+  }
+  if (cache->building) {
+    size += note_table_size(cache->snapshot);
+  }
+  if (cache->owns_filled) {
+    size += note_table_size(cache->filled);
+  }
+  return size;
+} /* density_cache_size() */
+
+/*
+ * returns the coarsest level whose buckets are no longer than the given
+ * number of ticks, so a redraw reads about one bucket per pixel column
+ */
+
+uint32_t density_level_for(density_cache_t *cache, uint64_t ticks) {
+  assert(cache);
+  for (uint32_t i = cache->num_levels; i > 0; i--) {
+    if ((1ull << cache->levels[i - 1].shift) <= ticks) {
+      return i - 1;
+    }
+  }
+  return 0;
+} /* density_level_for() */
@@ -0,0 +1,66 @@
+#ifndef _DENSITY_H
+#define _DENSITY_H
+
+#include <pthread.h>
+
+#include "note_table.h"
+
+#define PITCH_BANDS (16)
+#define BAND_PITCHES (NUM_PITCHES / PITCH_BANDS)
+//  Density of one note sounding through a whole bucket
+#define DENSITY_ONE (256)
+#define NO_PROGRAM (0xFF)
+#define BASE_BUCKETS_MAX (16384)
+#define DENSITY_MAX_LEVELS (64)
+
+//  One resolution of the cache. Buckets are 1 << shift ticks long
+typedef struct density_level_s {
+  uint8_t shift;
+  uint32_t num_buckets;
+  //  Average number of notes sounding, in DENSITY_ONE units, indexed by
+  //  bucket * PITCH_BANDS + band
+  uint32_t *density;
+  //  Program sounding the most in each bucket, or NO_PROGRAM
+  uint8_t *programs;
+} density_level_t;
+
+//  Mipmap of note density. Each level halves the number of buckets of the
+//  one below, down to a single bucket for the whole song
+typedef struct density_cache_s {
+  uint32_t num_levels;
+  density_level_t levels[DENSITY_MAX_LEVELS];
+  uint64_t last_tick;
+  uint64_t longest_note;
+
+  //  Background build from a private note table, see start_density_cache()
+  pthread_t thread;
+  note_table_t *snapshot;
+  int ready;
+  bool building;
+
+  //  Events from dirty_from to dirty_to changed since the buckets were
+  //  filled. dirty_from is UINT64_MAX if none did
+  uint64_t dirty_from;
+  uint64_t dirty_to;
+
+  //  Notes the buckets were filled from. It is the song's own note table
+  //  until that is dropped, the cache then keeps it to compare against
+  note_table_t *filled;
+  bool owns_filled;
+} density_cache_t;
+
+//  Whether parse_file(), parse_unseekable() and node_song() start the
+//  density cache of the songs they hand out. Off by default, the UI turns
+//  it on so the songs it opens are ready to draw
+extern bool g_density_on_load;
+
+density_cache_t *start_density_cache(song_data_t *);
+density_cache_t *song_density(song_data_t *);
+void invalidate_density(density_cache_t *, uint64_t, uint64_t);
+void free_density_cache(density_cache_t *);
+uint64_t density_cache_size(density_cache_t *);
+
+//  Coarsest level whose buckets are no longer than the given ticks
+uint32_t density_level_for(density_cache_t *, uint64_t);
+
+#endif // _DENSITY_H
@@ -21,9 +21,9 @@ typedef struct midi_event_s {
   uint8_t *data;
 } midi_event_t;
 
-meta_event_t META_TABLE[256];
-midi_event_t MIDI_TABLE[256];
-
-void __attribute__ ((constructor)) build_event_tables();
+//  Default event of each meta type and each status byte, see
+//  event_tables.c
+extern const meta_event_t META_TABLE[256];
+extern const midi_event_t MIDI_TABLE[256];
 
 #endif // _TABLES_H
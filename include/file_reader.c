@@ -0,0 +1,444 @@
+/* Name, file_reader.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "file_reader.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <malloc.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//  Largest single read, the kernel caps them a little below 2 GiB
+#define MAX_READ (1 << 30)
+
+bool init_uring(uring_t *ring, uint32_t depth);
+void free_uring(uring_t *ring);
+void queue_read(file_reader_t *reader, uint32_t slot);
+void reap_completions(file_reader_t *reader);
+void init_file_queue(file_queue_t *queue, uint32_t capacity);
+void push_file(file_queue_t *queue, loaded_file_t *file);
+loaded_file_t pop_file(file_queue_t *queue);
+void *reader_worker(void *reader_data);
+
+/*
+ * opens the file and allocates a buffer for all of it, returning the
+ * descriptor, or -1 with file->error set
+ */
+
+int open_loaded_file(loaded_file_t *file) {
+  int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    file->error = errno;
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    file->error = errno;
+    close(fd);
+    return -1;
+  }
+  file->size = info.st_size;
+  file->data = malloc(file->size ? file->size : 1);
+  assert(file->data);
+  return fd;
+} /* open_loaded_file() */
+
+/*
+ * reads the whole file synchronously, for the thread pool
+ */
+
+void load_whole_file(loaded_file_t *file) {
+  int fd = open_loaded_file(file);
+  if (fd < 0) {
+    return;
+  }
+  size_t done = 0;
+  while (done < file->size) {
+    size_t length = file->size - done;
+    ssize_t count = pread(fd, file->data + done,
+        (length > MAX_READ) ? MAX_READ : length, done);
+    if ((count < 0) && (errno == EINTR)) {
+      continue;
+    }
+    if (count < 0) {
+      file->error = errno;
+      break;
+    }
+    if (count == 0) {
+      //  The file shrank since fstat()
+      file->size = done;
+      break;
+    }
+    done += count;
+  }
+  close(fd);
+} /* load_whole_file() */
+
+/*
+ * returns a reader keeping up to depth reads in flight, using the given
+ * backend or, for READER_AUTO, io_uring when it is available
+ */
+
+file_reader_t *create_file_reader(uint32_t depth, int backend) {
+  assert(depth > 0);
+  file_reader_t *reader = malloc(sizeof(file_reader_t));
+  assert(reader);
+  memset(reader, 0, sizeof(file_reader_t));
+  reader->depth = depth;
+  reader->ring.fd = -1;
+  if ((backend != READER_THREADS) && (init_uring(&reader->ring, depth))) {
+    reader->backend = READER_IO_URING;
+    reader->slots = malloc(sizeof(read_slot_t) * depth);
+    assert(reader->slots);
+    memset(reader->slots, 0, sizeof(read_slot_t) * depth);
+    return reader;
+  }
+
+  reader->backend = READER_THREADS;
+  pthread_mutex_init(&reader->lock, NULL);
+  pthread_cond_init(&reader->work_ready, NULL);
+  pthread_cond_init(&reader->file_ready, NULL);
+  init_file_queue(&reader->pending, depth);
+  init_file_queue(&reader->loaded, depth);
+  reader->num_workers = (depth < DEFAULT_READ_THREADS) ? depth :
+    DEFAULT_READ_THREADS;
+  reader->workers = malloc(sizeof(pthread_t) * reader->num_workers);
+  assert(reader->workers);
+  for (int i = 0; i < reader->num_workers; i++) {
+    int create_return = pthread_create(&reader->workers[i], NULL,
+        reader_worker, reader);
+    assert(create_return == 0);
+  }
+  return reader;
+} /* create_file_reader() */
+
+/*
+ * waits for the reads still in flight and frees the reader
+ */
+
+void free_file_reader(file_reader_t *reader) {
+  loaded_file_t file;
+  while (next_loaded_file(reader, &file)) {
+    free_loaded_file(&file);
+  }
+  if (reader->backend == READER_IO_URING) {
+    free_uring(&reader->ring);
+    free(reader->slots);
+    reader->slots = NULL;
+  }
+  else {
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = true;
+    pthread_cond_broadcast(&reader->work_ready);
+    pthread_mutex_unlock(&reader->lock);
+    for (int i = 0; i < reader->num_workers; i++) {
+      pthread_join(reader->workers[i], NULL);
+    }
+    free(reader->workers);
+    reader->workers = NULL;
+    free(reader->pending.files);
+    reader->pending.files = NULL;
+    free(reader->loaded.files);
+    reader->loaded.files = NULL;
+    pthread_cond_destroy(&reader->file_ready);
+    pthread_cond_destroy(&reader->work_ready);
+    pthread_mutex_destroy(&reader->lock);
+  }
+  free(reader);
+  reader = NULL;
+} /* free_file_reader() */
+
+/*
+ * starts reading the file at path. Returns false, without starting it, if
+ * depth reads are already in flight
+ */
+
+bool submit_read(file_reader_t *reader, const char *path) {
+  if (reader->in_flight == reader->depth) {
+    return false;
+  }
+  loaded_file_t file = {0};
+  file.path = malloc(strlen(path) + 1);
+  assert(file.path);
+  strcpy(file.path, path);
+  reader->in_flight++;
+
+  if (reader->backend == READER_THREADS) {
+    pthread_mutex_lock(&reader->lock);
+    push_file(&reader->pending, &file);
+    pthread_cond_signal(&reader->work_ready);
+    pthread_mutex_unlock(&reader->lock);
+    return true;
+  }
+
+  uint32_t slot = 0;
+  while (reader->slots[slot].used) {
+    slot++;
+  }
+  read_slot_t *read = &reader->slots[slot];
+  read->used = true;
+  read->done = 0;
+  read->file = file;
+  read->fd = open_loaded_file(&read->file);
+  if ((read->fd >= 0) && (read->file.size)) {
+    queue_read(reader, slot);
+  }
+  return true;
+} /* submit_read() */
+
+/*
+ * waits for the next read to complete and moves it into file. Returns false
+ * if no read is in flight. The caller frees the file
+ */
+
+bool next_loaded_file(file_reader_t *reader, loaded_file_t *file) {
+  if (reader->in_flight == 0) {
+    return false;
+  }
+  reader->in_flight--;
+
+  if (reader->backend == READER_THREADS) {
+    pthread_mutex_lock(&reader->lock);
+    while (reader->loaded.count == 0) {
+      pthread_cond_wait(&reader->file_ready, &reader->lock);
+    }
+    *file = pop_file(&reader->loaded);
+    pthread_mutex_unlock(&reader->lock);
+    return true;
+  }
+
+  while (1) {
+    for (uint32_t i = 0; i < reader->depth; i++) {
+      read_slot_t *read = &reader->slots[i];
+      if ((read->used) && ((read->fd < 0) ||
+            (read->done == read->file.size))) {
+        if (read->fd >= 0) {
+          close(read->fd);
+          read->fd = -1;
+        }
+        *file = read->file;
+        read->used = false;
+        return true;
+      }
+    }
+    reap_completions(reader);
+  }
+} /* next_loaded_file() */
+
+/*
+ * frees the path and data of the file
+ */
+
+void free_loaded_file(loaded_file_t *file) {
+  free(file->path);
+  file->path = NULL;
+  free(file->data);
+  file->data = NULL;
+} /* free_loaded_file() */
+
+/*
+ * sets up the rings of an io_uring instance with room for depth entries.
+ * Returns false if the kernel does not allow it
+ */
+
+bool init_uring(uring_t *ring, uint32_t depth) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring->fd = syscall(__NR_io_uring_setup, depth, &params);
+  if (ring->fd < 0) {
+    return false;
+  }
+  ring->sq_ring_size = params.sq_off.array +
+    params.sq_entries * sizeof(uint32_t);
+  ring->cq_ring_size = params.cq_off.cqes +
+    params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if ((single_mmap) && (ring->cq_ring_size > ring->sq_ring_size)) {
+    ring->sq_ring_size = ring->cq_ring_size;
+  }
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->cq_ring = MAP_FAILED;
+  ring->sqes = MAP_FAILED;
+  if (ring->sq_ring != MAP_FAILED) {
+    ring->cq_ring = single_mmap ? ring->sq_ring : mmap(NULL,
+        ring->cq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  }
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  if (ring->cq_ring != MAP_FAILED) {
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  }
+  if (ring->sqes == MAP_FAILED) {
+    free_uring(ring);
+    return false;
+  }
+
+  uint8_t *sq = ring->sq_ring;
+  uint8_t *cq = ring->cq_ring;
+  ring->sq_head = (uint32_t *) (sq + params.sq_off.head);
+  ring->sq_tail = (uint32_t *) (sq + params.sq_off.tail);
+  ring->sq_mask = (uint32_t *) (sq + params.sq_off.ring_mask);
+  ring->sq_array = (uint32_t *) (sq + params.sq_off.array);
+  ring->cq_head = (uint32_t *) (cq + params.cq_off.head);
+  ring->cq_tail = (uint32_t *) (cq + params.cq_off.tail);
+  ring->cq_mask = (uint32_t *) (cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+  ring->unsubmitted = 0;
+  return true;
+} /* init_uring() */
+
+/*
+ * unmaps the rings and closes the instance
+ */
+
+void free_uring(uring_t *ring) {
+  if ((ring->sqes) && (ring->sqes != MAP_FAILED)) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if ((ring->cq_ring) && (ring->cq_ring != MAP_FAILED) &&
+      (ring->cq_ring != ring->sq_ring)) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if ((ring->sq_ring) && (ring->sq_ring != MAP_FAILED)) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  ring->sqes = NULL;
+  ring->cq_ring = NULL;
+  ring->sq_ring = NULL;
+  if (ring->fd >= 0) {
+    close(ring->fd);
+    ring->fd = -1;
+  }
+} /* free_uring() */
+
+/*
+ * queues a read of the rest of the slot's file. It is submitted with the
+ * others by the next reap_completions()
+ */
+
+void queue_read(file_reader_t *reader, uint32_t slot) {
+  uring_t *ring = &reader->ring;
+  read_slot_t *read = &reader->slots[slot];
+  uint32_t tail = *ring->sq_tail;
+  uint32_t index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  size_t length = read->file.size - read->done;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = read->fd;
+  sqe->addr = (uint64_t) (uintptr_t) (read->file.data + read->done);
+  sqe->len = (length > MAX_READ) ? MAX_READ : length;
+  sqe->off = read->done;
+  sqe->user_data = slot;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->unsubmitted++;
+} /* queue_read() */
+
+/*
+ * submits the queued reads, waits for at least one to complete and applies
+ * every completion, queueing the rest of reads that came back short
+ */
+
+void reap_completions(file_reader_t *reader) {
+  uring_t *ring = &reader->ring;
+  int enter_return = syscall(__NR_io_uring_enter, ring->fd,
+      ring->unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+  if ((enter_return < 0) && (errno == EINTR)) {
+    return;
+  }
+  assert(enter_return >= 0);
+  ring->unsubmitted -= enter_return;
+
+  uint32_t head = *ring->cq_head;
+  while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    read_slot_t *read = &reader->slots[cqe->user_data];
+    if (cqe->res < 0) {
+      read->file.error = -cqe->res;
+      close(read->fd);
+      read->fd = -1;
+    }
+    else if (cqe->res == 0) {
+      //  The file shrank since fstat()
+      read->file.size = read->done;
+    }
+    else {
+      read->done += cqe->res;
+      if (read->done < read->file.size) {
+        queue_read(reader, cqe->user_data);
+      }
+    }
+    head++;
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+} /* reap_completions() */
+
+/*
+ * allocates an empty queue of files
+ */
+
+void init_file_queue(file_queue_t *queue, uint32_t capacity) {
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->count = 0;
+  queue->files = malloc(sizeof(loaded_file_t) * capacity);
+  assert(queue->files);
+} /* init_file_queue() */
+
+/*
+ * appends a copy of the file to the queue
+ */
+
+void push_file(file_queue_t *queue, loaded_file_t *file) {
+  assert(queue->count < queue->capacity);
+  queue->files[(queue->head + queue->count++) % queue->capacity] = *file;
+} /* push_file() */
+
+/*
+ * removes and returns the oldest file of the queue
+ */
+
+loaded_file_t pop_file(file_queue_t *queue) {
+  assert(queue->count > 0);
+  loaded_file_t file = queue->files[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  return file;
+} /* pop_file() */
+
+/*
+ * thread of the pool, reading the pending files one at a time
+ */
+
+void *reader_worker(void *reader_data) {
+  file_reader_t *reader = reader_data;
+  pthread_mutex_lock(&reader->lock);
+  while (1) {
+    while ((reader->pending.count == 0) && (!reader->stop)) {
+      pthread_cond_wait(&reader->work_ready, &reader->lock);
+    }
+    if (reader->pending.count == 0) {
+      break;
+    }
+    loaded_file_t file = pop_file(&reader->pending);
+    pthread_mutex_unlock(&reader->lock);
+    load_whole_file(&file);
+    pthread_mutex_lock(&reader->lock);
+    push_file(&reader->loaded, &file);
+    pthread_cond_signal(&reader->file_ready);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
+} /* reader_worker() */
@@ -0,0 +1,93 @@
+#ifndef _FILE_READER_H
+#define _FILE_READER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define READER_AUTO (0)
+#define READER_IO_URING (1)
+#define READER_THREADS (2)
+
+#define DEFAULT_READ_DEPTH (32)
+#define DEFAULT_READ_THREADS (8)
+
+//  A whole file read into memory. error is an errno value, 0 on success
+typedef struct loaded_file_s {
+  char *path;
+  uint8_t *data;
+  size_t size;
+  int error;
+} loaded_file_t;
+
+//  One read in flight
+typedef struct read_slot_s {
+  bool used;
+  int fd;
+  //  Bytes read so far of file.size
+  size_t done;
+  loaded_file_t file;
+} read_slot_t;
+
+//  Submission and completion rings shared with the kernel
+typedef struct uring_s {
+  int fd;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  uint32_t *sq_head;
+  uint32_t *sq_tail;
+  uint32_t *sq_mask;
+  uint32_t *sq_array;
+  uint32_t *cq_head;
+  uint32_t *cq_tail;
+  uint32_t *cq_mask;
+  struct io_uring_cqe *cqes;
+  //  Entries queued since the last io_uring_enter
+  uint32_t unsubmitted;
+} uring_t;
+
+//  Files waiting for, or done by, the thread pool
+typedef struct file_queue_s {
+  uint32_t capacity;
+  uint32_t head;
+  uint32_t count;
+  loaded_file_t *files;
+} file_queue_t;
+
+//  Keeps up to depth whole-file reads in flight, through io_uring where the
+//  kernel allows it and a pool of threads otherwise. Files are returned in
+//  the order they complete
+typedef struct file_reader_s {
+  int backend;
+  uint32_t depth;
+  //  Submitted and not yet returned by next_loaded_file()
+  uint32_t in_flight;
+
+  //  READER_IO_URING
+  uring_t ring;
+  read_slot_t *slots;
+
+  //  READER_THREADS
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;
+  pthread_cond_t file_ready;
+  file_queue_t pending;
+  file_queue_t loaded;
+  bool stop;
+  int num_workers;
+  pthread_t *workers;
+} file_reader_t;
+
+file_reader_t *create_file_reader(uint32_t, int);
+void free_file_reader(file_reader_t *);
+bool submit_read(file_reader_t *, const char *);
+bool next_loaded_file(file_reader_t *, loaded_file_t *);
+void free_loaded_file(loaded_file_t *);
+
+#endif // _FILE_READER_H
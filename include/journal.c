@@ -0,0 +1,473 @@
+/* Name, journal.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "journal.h"
+#include "timeline.h"
+#include "tempo_map.h"
+#include "note_table.h"
+#include "remap_kernels.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define CHANNEL_EVENT_MAX (0xEF)
+#define CHANGES_MIN_CAPACITY (64)
+#define STATUS_KIND_MASK (0xF0)
+
+journal_entry_t *journal_entry(journal_t *journal, int position);
+journal_entry_t *push_entry(journal_t *journal, uint8_t kind,
+    song_data_t *song);
+void free_entry(journal_entry_t *entry);
+void add_change(journal_entry_t *entry, uint32_t track, uint32_t index,
+    event_t *event, uint32_t old_value, uint32_t new_value);
+void resolve_tracks(journal_entry_t *entry, song_data_t *song);
+void invalidate_entry_notes(journal_entry_t *entry, song_data_t *song);
+void apply_entry(journal_entry_t *entry, song_data_t *song, bool forwards);
+int journal_octave_helper(event_t *event, void *octave);
+int journal_instruments_helper(event_t *event, void *table);
+int journal_notes_helper(event_t *event, void *table);
+
+/*
+ * creates an empty journal keeping at most depth alterations, or
+ * DEFAULT_JOURNAL_DEPTH if depth is not positive
+ */
+
+journal_t *create_journal(int depth) {
+  journal_t *journal = malloc(sizeof(journal_t));
+  assert(journal);
+  journal->depth = (depth > 0) ? depth : DEFAULT_JOURNAL_DEPTH;
+  journal->first = 0;
+  journal->count = 0;
+  journal->done = 0;
+  journal->entries = malloc(sizeof(journal_entry_t) * journal->depth);
+  assert(journal->entries);
+  return journal;
+} /* create_journal() */
+
+/*
+ * frees the journal and every entry it holds
+ */
+
+void free_journal(journal_t *journal) {
+  clear_journal(journal);
+  free(journal->entries);
+  journal->entries = NULL;
+  free(journal);
+  journal = NULL;
+} /* free_journal() */
+
+/*
+ * forgets every alteration in the journal
+ */
+
+void clear_journal(journal_t *journal) {
+  for (int i = 0; i < journal->count; i++) {
+    free_entry(journal_entry(journal, i));
+  }
+  journal->first = 0;
+  journal->count = 0;
+  journal->done = 0;
+} /* clear_journal() */
+
+/*
+ * returns the entry at the given position, counted from the oldest
+ */
+
+journal_entry_t *journal_entry(journal_t *journal, int position) {
+  return &journal->entries[(journal->first + position) % journal->depth];
+} /* journal_entry() */
+
+/*
+ * frees the memory held by an entry
+ */
+
+void free_entry(journal_entry_t *entry) {
+  free(entry->changes);
+  entry->changes = NULL;
+  free(entry->tracks);
+  entry->tracks = NULL;
+  free(entry->length_deltas);
+  entry->length_deltas = NULL;
+  if (entry->round) {
+    //  The round was undone, so the journal is its only owner
+    free_track_node(entry->round);
+    entry->round = NULL;
+  }
+} /* free_entry() */
+
+/*
+ * drops every alteration that could be redone, makes room if the journal is
+ * full and returns a new entry for the song's current tracks
+ */
+
+journal_entry_t *push_entry(journal_t *journal, uint8_t kind,
+    song_data_t *song) {
+  while (journal->count > journal->done) {
+    free_entry(journal_entry(journal, --journal->count));
+  }
+  if (journal->count == journal->depth) {
+    free_entry(journal_entry(journal, 0));
+    journal->first = (journal->first + 1) % journal->depth;
+    journal->count--;
+    journal->done--;
+  }
+  journal_entry_t *entry = journal_entry(journal, journal->count++);
+  journal->done++;
+  memset(entry, 0, sizeof(journal_entry_t));
+  entry->kind = kind;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    entry->num_tracks++;
+    track_list = track_list->next_track;
+  }
+  entry->tracks = malloc(sizeof(track_t *) *
+      (entry->num_tracks ? entry->num_tracks : 1));
+  assert(entry->tracks);
+  return entry;
+} /* push_entry() */
+
+/*
+ * records that an event changed from old_value to new_value
+ */
+
+void add_change(journal_entry_t *entry, uint32_t track, uint32_t index,
+    event_t *event, uint32_t old_value, uint32_t new_value) {
+  if (entry->num_changes == entry->capacity) {
+    entry->capacity = entry->capacity ? entry->capacity * 2 :
+      CHANGES_MIN_CAPACITY;
+    entry->changes = realloc(entry->changes,
+        sizeof(journal_change_t) * entry->capacity);
+    assert(entry->changes);
+  }
+  entry->changes[entry->num_changes++] = (journal_change_t) {
+    track, index, event, old_value, new_value
+  };
+} /* add_change() */
+
+/*
+ * makes sure the event pointers of the entry point into the song's current
+ * tracks. Tracks that were copied since the entry was recorded, for example
+ * by copy-on-write, are walked once to find their events again
+ */
+
+void resolve_tracks(journal_entry_t *entry, song_data_t *song) {
+  track_node_t *track_list = song->track_list;
+  uint32_t change = 0;
+  for (uint32_t i = 0; i < entry->num_tracks; i++) {
+    assert(track_list);
+    bool has_changes = (change < entry->num_changes) &&
+      (entry->changes[change].track == i);
+    bool has_length = (entry->kind == JOURNAL_TIMES) &&
+      (entry->length_deltas[i] != 0);
+    if (has_changes || has_length) {
+      track_t *track = own_track(track_list);
+      if (track == entry->tracks[i]) {
+        while ((change < entry->num_changes) &&
+            (entry->changes[change].track == i)) {
+          change++;
+        }
+      }
+      else {
+        event_node_t *event_list = track->event_list;
+        uint32_t index = 0;
+        while ((change < entry->num_changes) &&
+            (entry->changes[change].track == i)) {
+          while (index < entry->changes[change].index) {
+            event_list = event_list->next_event;
+            index++;
+          }
+          assert(event_list);
+          entry->changes[change++].event = event_list->event;
+        }
+        entry->tracks[i] = track;
+      }
+    }
+    track_list = track_list->next_track;
+  }
+} /* resolve_tracks() */
+
+/*
+ * drops the song's notes around the events whose data byte the entry
+ * changed. A changed program reaches every later tick
+ */
+
+void invalidate_entry_notes(journal_entry_t *entry, song_data_t *song) {
+  uint64_t first = UINT64_MAX;
+  uint64_t last = 0;
+  tick_index_t *index = NULL;
+  for (uint32_t i = 0; i < entry->num_changes; i++) {
+    journal_change_t *change = &entry->changes[i];
+    //  Changes are grouped by track
+    if ((i == 0) || (change->track != entry->changes[i - 1].track)) {
+      index = track_ticks(entry->tracks[change->track]);
+    }
+    uint64_t tick = index->ticks[change->index];
+    if (tick < first) {
+      first = tick;
+    }
+    if ((change->event->type & STATUS_KIND_MASK) == PROGRAM_CHANGE_MIN) {
+      last = UINT64_MAX;
+    }
+    else if (tick > last) {
+      last = tick;
+    }
+  }
+  if (first != UINT64_MAX) {
+    invalidate_notes_between(song, first, last);
+  }
+} /* invalidate_entry_notes() */
+
+/*
+ * redoes the entry if forwards is set, otherwise undoes it
+ */
+
+void apply_entry(journal_entry_t *entry, song_data_t *song, bool forwards) {
+  if (entry->kind != JOURNAL_BYTES) {
+    invalidate_tempo_map(song);
+    invalidate_note_table(song);
+  }
+  if (entry->kind == JOURNAL_ROUND) {
+    track_node_t **tail = &song->track_list;
+    while (*tail && (*tail)->next_track) {
+      tail = &(*tail)->next_track;
+    }
+    if (forwards) {
+      assert(entry->round);
+      if (*tail) {
+        tail = &(*tail)->next_track;
+      }
+      *tail = entry->round;
+      attach_track_memory(song, entry->round->track);
+      entry->round = NULL;
+      song->num_tracks++;
+    }
+    else {
+      assert(*tail);
+      entry->round = *tail;
+      *tail = NULL;
+      detach_track_memory(song, entry->round->track);
+      song->num_tracks--;
+    }
+    return;
+  }
+
+  resolve_tracks(entry, song);
+  if (entry->kind == JOURNAL_BYTES) {
+    invalidate_entry_notes(entry, song);
+  }
+  for (uint32_t i = 0; i < entry->num_changes; i++) {
+    journal_change_t *change = &entry->changes[i];
+    uint32_t value = forwards ? change->new_value : change->old_value;
+    if (entry->kind == JOURNAL_BYTES) {
+      change->event->midi_event.data[0] = (uint8_t) value;
+    }
+    else {
+      change->event->delta_time = value;
+    }
+  }
+  if (entry->kind == JOURNAL_TIMES) {
+    for (uint32_t i = 0; i < entry->num_tracks; i++) {
+      if (entry->length_deltas[i] == 0) {
+        continue;
+      }
+      if (forwards) {
+        entry->tracks[i]->length += entry->length_deltas[i];
+      }
+      else {
+        entry->tracks[i]->length -= entry->length_deltas[i];
+      }
+    }
+    //  Changes are grouped by track, so each changed track is refreshed once
+    for (uint32_t i = 0; i < entry->num_changes; i++) {
+      if ((i == 0) ||
+          (entry->changes[i].track != entry->changes[i - 1].track)) {
+        refresh_tick_index(entry->tracks[entry->changes[i].track]);
+      }
+    }
+  }
+} /* apply_entry() */
+
+/*
+ * undoes the most recent alteration of the song. Returns false if there is
+ * nothing to undo
+ */
+
+bool undo_alteration(journal_t *journal, song_data_t *song) {
+  assert(journal);
+  assert(song);
+  if (journal->done == 0) {
+    return false;
+  }
+  apply_entry(journal_entry(journal, --journal->done), song, false);
+  return true;
+} /* undo_alteration() */
+
+/*
+ * redoes the most recently undone alteration of the song. Returns false if
+ * there is nothing to redo
+ */
+
+bool redo_alteration(journal_t *journal, song_data_t *song) {
+  assert(journal);
+  assert(song);
+  if (journal->done == journal->count) {
+    return false;
+  }
+  apply_entry(journal_entry(journal, journal->done++), song, true);
+  return true;
+} /* redo_alteration() */
+
+/*
+ * applies the function to every event in the song like apply_to_events,
+ * journaling the first data byte of every channel event it changes
+ */
+
+int journal_apply(journal_t *journal, song_data_t *song,
+    event_func_t function, void *data) {
+  assert(journal);
+  assert(song);
+  assert(function);
+  journal_entry_t *entry = push_entry(journal, JOURNAL_BYTES, song);
+  int function_return = 0;
+  uint32_t track = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    entry->tracks[track] = own_track(track_list);
+    uint32_t index = 0;
+    event_node_t *event_list = track_list->track->event_list;
+    while (event_list) {
+      event_t *event = event_list->event;
+      if ((event->type >= MIDI_MIN) && (event->type <= CHANNEL_EVENT_MAX)) {
+        uint8_t old_value = event->midi_event.data[0];
+        function_return += function(event, data);
+        if (event->midi_event.data[0] != old_value) {
+          add_change(entry, track, index, event, old_value,
+              event->midi_event.data[0]);
+        }
+      }
+      else {
+        function_return += function(event, data);
+      }
+      index++;
+      event_list = event_list->next_event;
+    }
+    track++;
+    track_list = track_list->next_track;
+  }
+  invalidate_entry_notes(entry, song);
+  return function_return;
+} /* journal_apply() */
+
+/*
+ * journaled change_octave()
+ */
+
+int journal_change_octave(journal_t *journal, song_data_t *song,
+    int octave_change) {
+  return journal_apply(journal, song, journal_octave_helper, &octave_change);
+} /* journal_change_octave() */
+
+/*
+ * casts the arguments to the required type for change_event_octave
+ */
+
+int journal_octave_helper(event_t *event, void *octave) {
+  return change_event_octave(event, (int *) octave);
+} /* journal_octave_helper() */
+
+/*
+ * journaled remap_instruments()
+ */
+
+int journal_remap_instruments(journal_t *journal, song_data_t *song,
+    remapping_t table) {
+  return journal_apply(journal, song, journal_instruments_helper, table);
+} /* journal_remap_instruments() */
+
+/*
+ * casts the arguments to the required type for change_event_instrument
+ */
+
+int journal_instruments_helper(event_t *event, void *table) {
+  return change_event_instrument(event, table);
+} /* journal_instruments_helper() */
+
+/*
+ * journaled remap_notes()
+ */
+
+int journal_remap_notes(journal_t *journal, song_data_t *song,
+    remapping_t table) {
+  return journal_apply(journal, song, journal_notes_helper, table);
+} /* journal_remap_notes() */
+
+/*
+ * casts the arguments to the required type for change_event_note
+ */
+
+int journal_notes_helper(event_t *event, void *table) {
+  return change_event_note(event, table);
+} /* journal_notes_helper() */
+
+/*
+ * journaled warp_time(), recording the old delta-time of every event whose
+ * delta-time changes
+ */
+
+int journal_warp_time(journal_t *journal, song_data_t *song,
+    float multiplier) {
+  assert(journal);
+  assert(song);
+  journal_entry_t *entry = push_entry(journal, JOURNAL_TIMES, song);
+  invalidate_tempo_map(song);
+  invalidate_note_table(song);
+  entry->length_deltas = malloc(sizeof(int) *
+      (entry->num_tracks ? entry->num_tracks : 1));
+  assert(entry->length_deltas);
+  int total_change = 0;
+  uint32_t track = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    entry->tracks[track] = own_track(track_list);
+    int track_length = 0;
+    uint32_t index = 0;
+    warp_state_t state = {0};
+    init_warp_state(&state, multiplier);
+    event_node_t *event_list = track_list->track->event_list;
+    while (event_list) {
+      event_t *event = event_list->event;
+      uint32_t old_delta = event->delta_time;
+      track_length += warp_column(&event->delta_time, 1, &state);
+      if (event->delta_time != old_delta) {
+        add_change(entry, track, index, event, old_delta,
+            event->delta_time);
+      }
+      index++;
+      event_list = event_list->next_event;
+    }
+    track_list->track->length += track_length;
+    refresh_tick_index(track_list->track);
+    entry->length_deltas[track] = track_length;
+    total_change += track_length;
+    track++;
+    track_list = track_list->next_track;
+  }
+  return total_change;
+} /* journal_warp_time() */
+
+/*
+ * journaled add_round()
+ */
+
+void journal_add_round(journal_t *journal, song_data_t *song,
+    int track_index, int octave_difference, unsigned int time_delay,
+    uint8_t instrument) {
+  assert(journal);
+  add_round(song, track_index, octave_difference, time_delay, instrument);
+  push_entry(journal, JOURNAL_ROUND, song);
+} /* journal_add_round() */
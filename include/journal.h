@@ -0,0 +1,71 @@
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include "alterations.h"
+
+#define DEFAULT_JOURNAL_DEPTH (64)
+
+//  Kinds of journaled alterations
+#define JOURNAL_BYTES (1)
+#define JOURNAL_TIMES (2)
+#define JOURNAL_ROUND (3)
+
+//  One event changed by an alteration. The value is the first data byte for
+//  JOURNAL_BYTES and the delta-time for JOURNAL_TIMES
+typedef struct journal_change_s {
+  uint32_t track;
+  uint32_t index;
+  event_t *event;
+  uint32_t old_value;
+  uint32_t new_value;
+} journal_change_t;
+
+typedef struct journal_entry_s {
+  uint8_t kind;
+
+  //  Events touched, ordered by track then index
+  uint32_t num_changes;
+  uint32_t capacity;
+  journal_change_t *changes;
+
+  //  The song's tracks as they were when the event pointers were recorded
+  uint32_t num_tracks;
+  track_t **tracks;
+
+  //  JOURNAL_TIMES, change of each track's length
+  int *length_deltas;
+
+  //  JOURNAL_ROUND, the added track while it is undone
+  track_node_t *round;
+} journal_entry_t;
+
+typedef struct journal_s {
+  //  Ring of entries, the oldest is dropped once depth is reached
+  int depth;
+  int first;
+  int count;
+  //  Entries [first, first + done) are applied, the rest can be redone
+  int done;
+  journal_entry_t *entries;
+} journal_t;
+
+journal_t *create_journal(int);
+void free_journal(journal_t *);
+void clear_journal(journal_t *);
+
+//  Journaled versions of the wrappers, returning what they return
+int journal_change_octave(journal_t *, song_data_t *, int);
+int journal_warp_time(journal_t *, song_data_t *, float);
+int journal_remap_instruments(journal_t *, song_data_t *, remapping_t);
+int journal_remap_notes(journal_t *, song_data_t *, remapping_t);
+void journal_add_round(journal_t *, song_data_t *, int, int, unsigned int,
+    uint8_t);
+
+//  Generic journaled byte alteration, for functions that only change the
+//  first data byte of channel events
+int journal_apply(journal_t *, song_data_t *, event_func_t, void *);
+
+bool undo_alteration(journal_t *, song_data_t *);
+bool redo_alteration(journal_t *, song_data_t *);
+
+#endif // _JOURNAL_H
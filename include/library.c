@@ -5,20 +5,37 @@
 /* Add any includes here */
 
 #include "library.h"
+#include "stats.h"
+#include "file_reader.h"
+#include "load_pipeline.h"
+#include "density.h"
+#include "payload_pool.h"
 
 #include <string.h>
 #include <assert.h>
 #include <malloc.h>
-#include <ftw.h>
+#include <stdlib.h>
 #include <limits.h>
 
 #define ERROR (-1)
-#define OK (0)
-#define NO_DIRS (5)
+#define LOAD_MIN_CAPACITY (64)
 
 tree_node_t *g_song_library = NULL;
-
-int ftw_callback(const char *file_path, const struct stat *ptr, int flag);
+melody_index_t *g_melody_index = NULL;
+memory_usage_t g_library_memory = {0};
+int g_read_backend = READER_AUTO;
+
+//  Nodes of the songs parsed by the load pipeline, waiting to be built into
+//  the library, see add_loaded_node()
+tree_node_t **g_loaded_nodes = NULL;
+int g_loaded_count = 0;
+int g_loaded_capacity = 0;
+
+int compare_nodes(const void *node_1, const void *node_2);
+int compare_loaded_nodes(const void *node_1, const void *node_2);
+void add_loaded_node(song_data_t *song);
+tree_node_t **detach_min(tree_node_t **root);
+void record_depths(tree_node_t *tree, int depth);
 
 /*
  * returns the parent's branch pointting to a node with the given song_name
@@ -59,8 +76,11 @@ int tree_insert(tree_node_t **root, tree_node_t *node) {
   tree_node_t *tree = *root;
   if (tree == NULL) {
     *root = node;
+    STAT_ADD(STAT_LIBRARY_INSERTS, 1);
     return INSERT_SUCCESS;
   }
+  //  Depth of the node once linked below tree
+  int depth = 1;
   while (1) {
     if (strcmp(tree->song_name, node->song_name) == 0) {
       return DUPLICATE_SONG;
@@ -68,63 +88,70 @@ int tree_insert(tree_node_t **root, tree_node_t *node) {
     else if (strcmp(tree->song_name, node->song_name) > 0) {
       if (tree->left_child == NULL) {
         tree->left_child = node;
-        return INSERT_SUCCESS;
+        break;
       }
       tree = tree->left_child;
     }
     else {
       if (tree->right_child == NULL) {
         tree->right_child = node;
-        return INSERT_SUCCESS;
+        break;
       }
       tree = tree->right_child;
     }
+    depth++;
   }
+  STAT_ADD(STAT_LIBRARY_INSERTS, 1);
+  STAT_ADD(STAT_INSERT_DEPTH, depth);
+  STAT_MAX(STAT_MAX_INSERT_DEPTH, depth);
   return INSERT_SUCCESS;
 } /* tree_insert() */
 
+/*
+ * unlinks the node with the smallest song_name under root and returns the
+ * pointer that used to point to it
+ */
+
+tree_node_t **detach_min(tree_node_t **root) {
+  while ((*root)->left_child) {
+    root = &((*root)->left_child);
+  }
+  return root;
+} /* detach_min() */
+
 /*
  * removes the node with the given song_name from the tree
  */
 
 int remove_song_from_tree(tree_node_t **root, const char *song_name) {
-  tree_node_t *tree = *root;
-  if (strcmp(tree->song_name, song_name) == 0) {
-    tree_node_t *left_child = tree->left_child;
-    tree_node_t *right_child = tree->right_child;
-    free_node(tree);
-    if (left_child != NULL) {
-      *root = left_child;
+  tree_node_t **link = root;
+  while (*link) {
+    int compare = strcmp((*link)->song_name, song_name);
+    if (compare > 0) {
+      link = &((*link)->left_child);
     }
-    if (right_child != NULL) {
-      if (*root == NULL) {
-        *root = right_child;
-      }
-      else {
-        tree_insert(root, right_child);
-      }
-    }
-    return DELETE_SUCCESS;
-  }
-  while (tree) {
-    if (strcmp(tree->song_name, song_name) > 0) {
-      tree = tree->left_child;
-    }
-    else if (strcmp(tree->song_name, song_name) < 0) {
-      tree = tree->right_child;
+    else if (compare < 0) {
+      link = &((*link)->right_child);
     }
     else {
-      tree_node_t *left_child = tree->left_child;
-      tree_node_t *right_child = tree->right_child;
-      tree_node_t **parent_pointer = (find_parent_pointer(root, song_name));
-      free_node(tree);
-      *parent_pointer = NULL;
-      if (left_child != NULL) {
-        tree_insert(root, left_child);
+      //  Splice in the in-order successor so the rest of the tree keeps its
+      //  shape
+      tree_node_t *tree = *link;
+      if (tree->left_child == NULL) {
+        *link = tree->right_child;
+      }
+      else if (tree->right_child == NULL) {
+        *link = tree->left_child;
       }
-      if (right_child != NULL) {
-        tree_insert(root, right_child);
+      else {
+        tree_node_t **successor_link = detach_min(&(tree->right_child));
+        tree_node_t *successor = *successor_link;
+        *successor_link = successor->right_child;
+        successor->left_child = tree->left_child;
+        successor->right_child = tree->right_child;
+        *link = successor;
       }
+      free_node(tree);
       return DELETE_SUCCESS;
     }
   }
@@ -138,7 +165,21 @@ int remove_song_from_tree(tree_node_t **root, const char *song_name) {
 void free_node(tree_node_t *node) {
   node->left_child = NULL;
   node->right_child = NULL;
-  free_song(node->song);
+  if ((node->melody_id != NO_MELODY_ID) && (g_melody_index)) {
+    remove_indexed_song(g_melody_index, node->melody_id);
+    node->melody_id = NO_MELODY_ID;
+  }
+  memory_usage_t removed = {0};
+  removed.tree_nodes = sizeof(tree_node_t);
+  if (node->packed) {
+    removed.packed = packed_song_size(node->packed);
+    free_packed_song(node->packed);
+    node->packed = NULL;
+  }
+  else {
+    free_song(node->song);
+  }
+  subtract_owner_usage(&g_library_memory, &removed);
   free(node);
   node = NULL;
 } /* free_node() */
@@ -152,6 +193,217 @@ void print_node(tree_node_t *node, FILE *file) {
   //printf("%s\n", node->song_name);
 } /* print_node() */
 
+/*
+ * returns the number of nodes in the tree
+ */
+
+int count_nodes(tree_node_t *tree) {
+  if (tree == NULL) {
+    return 0;
+  }
+  return 1 + count_nodes(tree->left_child) + count_nodes(tree->right_child);
+} /* count_nodes() */
+
+/*
+ * stores the nodes of the tree in order into nodes, unlinking them from each
+ * other, and returns the number stored
+ */
+
+int flatten_tree(tree_node_t *tree, tree_node_t **nodes) {
+  if (tree == NULL) {
+    return 0;
+  }
+  tree_node_t *right_child = tree->right_child;
+  int count = flatten_tree(tree->left_child, nodes);
+  tree->left_child = NULL;
+  tree->right_child = NULL;
+  nodes[count++] = tree;
+  return count + flatten_tree(right_child, nodes + count);
+} /* flatten_tree() */
+
+/*
+ * builds a balanced tree from count nodes sorted by song_name in O(count)
+ */
+
+tree_node_t *build_balanced_tree(tree_node_t **nodes, int count) {
+  if (count <= 0) {
+    return NULL;
+  }
+  int middle = count / 2;
+  tree_node_t *root = nodes[middle];
+  root->left_child = build_balanced_tree(nodes, middle);
+  root->right_child = build_balanced_tree(nodes + middle + 1,
+      count - middle - 1);
+  return root;
+} /* build_balanced_tree() */
+
+/*
+ * records every node under tree, which is at the given depth, as a library
+ * insert at its depth
+ */
+
+void record_depths(tree_node_t *tree, int depth) {
+  if (tree == NULL) {
+    return;
+  }
+  STAT_ADD(STAT_LIBRARY_INSERTS, 1);
+  STAT_ADD(STAT_INSERT_DEPTH, depth);
+  STAT_MAX(STAT_MAX_INSERT_DEPTH, depth);
+  record_depths(tree->left_child, depth + 1);
+  record_depths(tree->right_child, depth + 1);
+} /* record_depths() */
+
+/*
+ * removes every song for which the predicate returns nonzero in one pass,
+ * rebalancing the remaining tree. Returns the number of songs removed
+ */
+
+int remove_matching_songs(tree_node_t **root, song_pred_t predicate,
+    void *data) {
+  assert(root);
+  assert(predicate);
+  int count = count_nodes(*root);
+  if (count == 0) {
+    return 0;
+  }
+  tree_node_t **nodes = malloc(sizeof(tree_node_t *) * count);
+  assert(nodes);
+  flatten_tree(*root, nodes);
+  int kept = 0;
+  for (int i = 0; i < count; i++) {
+    if (predicate(nodes[i], data)) {
+      free_node(nodes[i]);
+    }
+    else {
+      nodes[kept++] = nodes[i];
+    }
+  }
+  *root = build_balanced_tree(nodes, kept);
+  free(nodes);
+  nodes = NULL;
+  return count - kept;
+} /* remove_matching_songs() */
+
+/*
+ * moves every song of source into the tree at root and rebalances it. Songs
+ * of source that are already in root are freed. Returns the number of
+ * duplicates dropped
+ */
+
+int merge_libraries(tree_node_t **root, tree_node_t *source) {
+  assert(root);
+  int root_count = count_nodes(*root);
+  int source_count = count_nodes(source);
+  if (source_count == 0) {
+    return 0;
+  }
+  tree_node_t **nodes = malloc(sizeof(tree_node_t *) *
+      (root_count + source_count) * 2);
+  assert(nodes);
+  tree_node_t **root_nodes = nodes + root_count + source_count;
+  tree_node_t **source_nodes = root_nodes + root_count;
+  flatten_tree(*root, root_nodes);
+  flatten_tree(source, source_nodes);
+  int merged = 0;
+  int duplicates = 0;
+  int i = 0;
+  int j = 0;
+  while ((i < root_count) || (j < source_count)) {
+    if (j == source_count) {
+      nodes[merged++] = root_nodes[i++];
+    }
+    else if (i == root_count) {
+      nodes[merged++] = source_nodes[j++];
+    }
+    else {
+      int compare = strcmp(root_nodes[i]->song_name,
+          source_nodes[j]->song_name);
+      if (compare < 0) {
+        nodes[merged++] = root_nodes[i++];
+      }
+      else if (compare > 0) {
+        nodes[merged++] = source_nodes[j++];
+      }
+      else {
+        free_node(source_nodes[j++]);
+        duplicates++;
+      }
+    }
+  }
+  *root = build_balanced_tree(nodes, merged);
+  free(nodes);
+  nodes = NULL;
+  return duplicates;
+} /* merge_libraries() */
+
+/*
+ * replaces the song of the node with its compact idle form
+ */
+
+void pack_node(tree_node_t *node) {
+  if (node->packed) {
+    return;
+  }
+  node->packed = pack_song(node->song);
+  node->song = NULL;
+  memory_usage_t added = {0};
+  added.packed = packed_song_size(node->packed);
+  add_owner_usage(&g_library_memory, &added);
+} /* pack_node() */
+
+/*
+ * returns the editable song of the node, expanding it if it is idle. An
+ * expanded song starts building its density cache
+ */
+
+song_data_t *node_song(tree_node_t *node) {
+  if (node->packed) {
+    memory_usage_t removed = {0};
+    removed.packed = packed_song_size(node->packed);
+    subtract_owner_usage(&g_library_memory, &removed);
+    node->song = unpack_song(node->packed);
+    node->packed = NULL;
+    adopt_song_memory(node->song, &g_library_memory);
+    if (g_density_on_load) {
+      start_density_cache(node->song);
+    }
+  }
+  return node->song;
+} /* node_song() */
+
+/*
+ * returns the bytes held by the node and its song, in whichever form
+ */
+
+memory_usage_t node_memory(tree_node_t *node) {
+  memory_usage_t usage = {0};
+  if (node->packed) {
+    usage.packed = packed_song_size(node->packed);
+  }
+  else {
+    usage = node->song->memory;
+  }
+  usage.tree_nodes = sizeof(tree_node_t);
+  return usage;
+} /* node_memory() */
+
+/*
+ * returns the bytes held by every node made by make_library(). Payloads
+ * interned in g_payload_pool are counted once under pooled rather than for
+ * every event referencing them
+ */
+
+memory_usage_t library_memory() {
+  memory_usage_t usage = read_owner_usage(&g_library_memory);
+  if (g_payload_pool) {
+    uint64_t referenced = 0;
+    usage.pooled = pool_memory(g_payload_pool, &referenced);
+    usage.payloads -= (referenced < usage.payloads) ? referenced :
+      usage.payloads;
+  }
+  return usage;
+} /* library_memory() */
+
 /*
  * traverses in the pre_order from a given node pointer and calls traversal
  * and passes data to the function
@@ -221,38 +473,123 @@ void write_song_list(FILE *file, tree_node_t *tree) {
 } /* write_song_list() */
 
 /*
- * makes the song library from a directory
+ * packs every song in the library into its compact idle form
+ */
+
+void pack_library(tree_node_t *tree) {
+  traverse_pre_order(tree, NULL, (void *)pack_node);
+} /* pack_library() */
+
+/*
+ * makes the song library from a directory, or adds its songs to the library
+ * already made. Returns the number of songs dropped because a song of the
+ * same name was already loaded
  */
 
-void make_library(const char *directory) {
-  int ftw_return = ftw(directory, ftw_callback, NO_DIRS);
-  if (ftw_return != OK) {
+int make_library(const char *directory) {
+  STAT_START(start);
+  int duplicates = 0;
+  g_loaded_count = 0;
+  if (!run_load_pipeline(&g_last_load, directory, add_loaded_node,
+        g_read_backend, DEFAULT_QUEUE_DEPTH, AUTO_PARSE_THREADS)) {
     printf("error\n");
-    return;
   }
+  if (g_loaded_count) {
+    qsort(g_loaded_nodes, g_loaded_count, sizeof(tree_node_t *),
+        compare_loaded_nodes);
+    //  Files of the same name in different directories, the first path in
+    //  order is kept
+    int kept = 1;
+    for (int i = 1; i < g_loaded_count; i++) {
+      if (compare_nodes(&g_loaded_nodes[kept - 1], &g_loaded_nodes[i]) == 0) {
+        free_node(g_loaded_nodes[i]);
+        g_loaded_nodes[i] = NULL;
+        duplicates++;
+      }
+      else {
+        g_loaded_nodes[kept++] = g_loaded_nodes[i];
+      }
+    }
+    g_loaded_count = kept;
+    if (g_melody_index == NULL) {
+      g_melody_index = create_melody_index();
+    }
+    for (int i = 0; i < g_loaded_count; i++) {
+      tree_node_t *node = g_loaded_nodes[i];
+      node->melody_id = attach_song(g_melody_index, node->song_name,
+          node->song->path);
+      if (node->melody_id == NO_MELODY_ID) {
+        node->melody_id = index_song(g_melody_index, node->song_name,
+            node->song);
+      }
+    }
+    tree_node_t *loaded = build_balanced_tree(g_loaded_nodes,
+        g_loaded_count);
+#ifdef MIDI_STATS
+    //  Depths within the balanced tree of the songs just loaded
+    record_depths(loaded, 0);
+#endif // MIDI_STATS
+    if (g_song_library == NULL) {
+      g_song_library = loaded;
+    }
+    else {
+      duplicates += merge_libraries(&g_song_library, loaded);
+    }
+  }
+  free(g_loaded_nodes);
+  g_loaded_nodes = NULL;
+  g_loaded_count = 0;
+  g_loaded_capacity = 0;
+  STAT_STOP(TIMER_MAKE_LIBRARY, start);
+  return duplicates;
 } /* make_library() */
 
 /*
- * the callback function for ftw
+ * compares two tree node pointers by song_name for qsort
  */
 
-int ftw_callback(const char *file_path, const struct stat *ptr, int flag) {
-  if ((flag == FTW_F) || (flag == FTW_NS)) {
-    if (strrchr(file_path, '.') == NULL) {
-      return OK;
-    }
-    if (strcmp(strrchr(file_path, '.'), ".mid") == 0) {
-      //printf("midi file\n");
-      tree_node_t *new_node = malloc(sizeof(tree_node_t));
-      assert(new_node);
-      memset(new_node, 0, sizeof(tree_node_t));
-      new_node->song = parse_file(file_path);
-      new_node->left_child = NULL;
-      new_node->right_child = NULL;
-      new_node->song_name = strrchr(new_node->song->path, '/') + 1;
-      assert(tree_insert(&g_song_library, new_node) != DUPLICATE_SONG);
-      //printf("%d\n", new_node->song->format);
-    }
+int compare_nodes(const void *node_1, const void *node_2) {
+  return strcmp((*(tree_node_t * const *) node_1)->song_name,
+      (*(tree_node_t * const *) node_2)->song_name);
+} /* compare_nodes() */
+
+/*
+ * compares two loaded nodes by song_name, then by path so that files of the
+ * same name in different directories sort the same way every load
+ */
+
+int compare_loaded_nodes(const void *node_1, const void *node_2) {
+  int compare = compare_nodes(node_1, node_2);
+  if (compare != 0) {
+    return compare;
+  }
+  return strcmp((*(tree_node_t * const *) node_1)->song->path,
+      (*(tree_node_t * const *) node_2)->song->path);
+} /* compare_loaded_nodes() */
+
+/*
+ * makes a node of the parsed song and adds it to the loaded nodes
+ */
+
+void add_loaded_node(song_data_t *song) {
+  tree_node_t *new_node = malloc(sizeof(tree_node_t));
+  assert(new_node);
+  memset(new_node, 0, sizeof(tree_node_t));
+  STAT_ALLOC(sizeof(tree_node_t));
+  new_node->song = song;
+  memory_usage_t added = {0};
+  added.tree_nodes = sizeof(tree_node_t);
+  add_owner_usage(&g_library_memory, &added);
+  adopt_song_memory(new_node->song, &g_library_memory);
+  new_node->left_child = NULL;
+  new_node->right_child = NULL;
+  new_node->song_name = strrchr(new_node->song->path, '/') + 1;
+  if (g_loaded_count == g_loaded_capacity) {
+    g_loaded_capacity = g_loaded_capacity ? g_loaded_capacity * 2 :
+      LOAD_MIN_CAPACITY;
+    g_loaded_nodes = realloc(g_loaded_nodes,
+        sizeof(tree_node_t *) * g_loaded_capacity);
+    assert(g_loaded_nodes);
   }
-  return OK;
-} /* ftw_callback() */
+  g_loaded_nodes[g_loaded_count++] = new_node;
+} /* add_loaded_node() */
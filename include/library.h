@@ -2,6 +2,9 @@
 #define _LIBRARY_H
 
 #include "parser.h"
+#include "song_pack.h"
+#include "melody_index.h"
+#include "memory_usage.h"
 
 #define DUPLICATE_SONG (-1)
 #define INSERT_SUCCESS (0)
@@ -12,16 +15,30 @@
 typedef struct tree_node_s {
   char *song_name;
   song_data_t *song;
+  //  Compact form of the song while it is idle, song is NULL while set
+  packed_song_t *packed;
+  //  Song id in g_melody_index, or NO_MELODY_ID
+  uint32_t melody_id;
 
   struct tree_node_s *left_child;
   struct tree_node_s *right_child;
 } tree_node_t;
 
 extern tree_node_t *g_song_library;
+//  Melodies of the songs added by make_library(). An index read back from a
+//  file may be set before, so its songs are not extracted again
+extern melody_index_t *g_melody_index;
+//  Every node made by make_library() and not yet freed, with its song
+extern memory_usage_t g_library_memory;
+//  Backend make_library() reads files with, see file_reader.h
+extern int g_read_backend;
 
 //  Type of the functions applied by traversals to each node
 typedef void (*traversal_func_t)(tree_node_t *, void *);
 
+//  Type of the predicates used by bulk removal, nonzero selects the node
+typedef int (*song_pred_t)(tree_node_t *, void *);
+
 //  Tree operations
 tree_node_t **find_parent_pointer(tree_node_t **, const char *);
 int tree_insert(tree_node_t **, tree_node_t *);
@@ -29,6 +46,19 @@ int remove_song_from_tree(tree_node_t **, const char *);
 void free_node(tree_node_t *);
 void print_node(tree_node_t *, FILE *);
 
+//  Bulk operations
+int count_nodes(tree_node_t *);
+int flatten_tree(tree_node_t *, tree_node_t **);
+tree_node_t *build_balanced_tree(tree_node_t **, int);
+int remove_matching_songs(tree_node_t **, song_pred_t, void *);
+int merge_libraries(tree_node_t **, tree_node_t *);
+void pack_node(tree_node_t *);
+song_data_t *node_song(tree_node_t *);
+
+//  Memory accounting
+memory_usage_t node_memory(tree_node_t *);
+memory_usage_t library_memory();
+
 //  Traversal functions
 void traverse_pre_order(tree_node_t *, void *, traversal_func_t);
 void traverse_in_order(tree_node_t *, void *, traversal_func_t);
@@ -37,8 +67,9 @@ void traverse_post_order(tree_node_t *, void *, traversal_func_t);
 //  Wrapper functions
 void free_library(tree_node_t *);
 void write_song_list(FILE *fp, tree_node_t *);
+void pack_library(tree_node_t *);
 
 //  Data type specific
-void make_library(const char *);
+int make_library(const char *);
 
 #endif // _LIBRARY_H
@@ -0,0 +1,390 @@
+/* Name, load_pipeline.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "load_pipeline.h"
+#include "file_reader.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <ftw.h>
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NO_DIRS (5)
+#define OK (0)
+#define NS_PER_SEC (1000000000)
+#define NS_PER_MS (1e6)
+#define BYTES_PER_MB (1e6)
+#define PERCENT (100.0)
+
+load_pipeline_t g_last_load = {0};
+
+//  Pipeline whose directory is being walked, for enumerate_callback()
+load_pipeline_t *g_enumerating = NULL;
+
+uint64_t pipeline_clock();
+int enumerate_callback(const char *file_path, const struct stat *ptr,
+    int flag);
+void *enumerate_stage(void *pipeline_data);
+void *load_stage(void *pipeline_data);
+void *parse_stage(void *pipeline_data);
+
+/*
+ * returns the monotonic clock in nanoseconds
+ */
+
+uint64_t pipeline_clock() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+} /* pipeline_clock() */
+
+/*
+ * sets up an empty open queue holding up to capacity items
+ */
+
+void init_work_queue(work_queue_t *queue, uint32_t capacity) {
+  assert(capacity > 0);
+  memset(queue, 0, sizeof(work_queue_t));
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  queue->capacity = capacity;
+  queue->items = malloc(sizeof(void *) * capacity);
+  assert(queue->items);
+} /* init_work_queue() */
+
+/*
+ * frees the queue, which must be empty
+ */
+
+void free_work_queue(work_queue_t *queue) {
+  assert(queue->count == 0);
+  free(queue->items);
+  queue->items = NULL;
+  pthread_cond_destroy(&queue->not_full);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_mutex_destroy(&queue->lock);
+} /* free_work_queue() */
+
+/*
+ * appends the item, waiting while the queue is full. Returns false, without
+ * appending it, if the queue is closed
+ */
+
+bool queue_push(work_queue_t *queue, void *item) {
+  pthread_mutex_lock(&queue->lock);
+  if ((queue->count == queue->capacity) && (!queue->closed)) {
+    uint64_t start = pipeline_clock();
+    while ((queue->count == queue->capacity) && (!queue->closed)) {
+      pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->full_wait_ns += pipeline_clock() - start;
+  }
+  if (queue->closed) {
+    pthread_mutex_unlock(&queue->lock);
+    return false;
+  }
+  queue->items[(queue->head + queue->count++) % queue->capacity] = item;
+  queue->pushes++;
+  queue->occupancy_sum += queue->count;
+  if (queue->count > queue->max_count) {
+    queue->max_count = queue->count;
+  }
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+  return true;
+} /* queue_push() */
+
+/*
+ * removes the oldest item into item, waiting while the queue is empty.
+ * Returns false once the queue is closed and empty
+ */
+
+bool queue_pop(work_queue_t *queue, void **item) {
+  pthread_mutex_lock(&queue->lock);
+  if ((queue->count == 0) && (!queue->closed)) {
+    uint64_t start = pipeline_clock();
+    while ((queue->count == 0) && (!queue->closed)) {
+      pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    queue->empty_wait_ns += pipeline_clock() - start;
+  }
+  if (queue->count == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    return false;
+  }
+  *item = queue->items[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+  return true;
+} /* queue_pop() */
+
+/*
+ * removes the oldest item into item if there is one, without waiting
+ */
+
+bool queue_try_pop(work_queue_t *queue, void **item) {
+  pthread_mutex_lock(&queue->lock);
+  if (queue->count == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    return false;
+  }
+  *item = queue->items[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+  return true;
+} /* queue_try_pop() */
+
+/*
+ * marks the queue as having no more items coming, waking every waiter
+ */
+
+void close_queue(work_queue_t *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = true;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+} /* close_queue() */
+
+/*
+ * loads every .mid file under the directory and passes the parsed songs to
+ * insert. Enumeration, reading and parsing run on threads of their own,
+ * parse_threads of them or AUTO_PARSE_THREADS for parsing, joined by queues
+ * of the given depth, so at most about four times depth files are held at
+ * once. Returns false if the directory could not be walked, after
+ * inserting whatever was found
+ */
+
+bool run_load_pipeline(load_pipeline_t *pipeline, const char *directory,
+    insert_func_t insert, int read_backend, uint32_t depth,
+    int parse_threads) {
+  if (parse_threads == AUTO_PARSE_THREADS) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    parse_threads = (processors < 1) ? 1 : ((processors > MAX_PARSE_THREADS) ?
+        MAX_PARSE_THREADS : processors);
+  }
+  assert(parse_threads > 0);
+  memset(pipeline, 0, sizeof(load_pipeline_t));
+  pipeline->directory = directory;
+  pipeline->insert = insert;
+  pipeline->read_backend = read_backend;
+  pipeline->depth = depth;
+  init_work_queue(&pipeline->paths, depth);
+  init_work_queue(&pipeline->files, depth);
+  init_work_queue(&pipeline->songs, depth);
+  pipeline->parsers_left = parse_threads;
+  pipeline->stages[STAGE_ENUMERATE].threads = 1;
+  pipeline->stages[STAGE_LOAD].threads = 1;
+  pipeline->stages[STAGE_PARSE].threads = parse_threads;
+  pipeline->stages[STAGE_INSERT].threads = 1;
+
+  uint64_t start = pipeline_clock();
+  pthread_t enumerator;
+  pthread_t loader;
+  pthread_t *parsers = malloc(sizeof(pthread_t) * parse_threads);
+  assert(parsers);
+  int create_return = pthread_create(&enumerator, NULL, enumerate_stage,
+      pipeline);
+  assert(create_return == 0);
+  create_return = pthread_create(&loader, NULL, load_stage, pipeline);
+  assert(create_return == 0);
+  for (int i = 0; i < parse_threads; i++) {
+    create_return = pthread_create(&parsers[i], NULL, parse_stage, pipeline);
+    assert(create_return == 0);
+  }
+
+  stage_stats_t *stats = &pipeline->stages[STAGE_INSERT];
+  void *song = NULL;
+  while (queue_pop(&pipeline->songs, &song)) {
+    uint64_t insert_start = pipeline_clock();
+    insert(song);
+    stats->busy_ns += pipeline_clock() - insert_start;
+    stats->items++;
+  }
+
+  pthread_join(enumerator, NULL);
+  pthread_join(loader, NULL);
+  for (int i = 0; i < parse_threads; i++) {
+    pthread_join(parsers[i], NULL);
+  }
+  free(parsers);
+  parsers = NULL;
+  pipeline->wall_ns = pipeline_clock() - start;
+  free_work_queue(&pipeline->paths);
+  free_work_queue(&pipeline->files);
+  free_work_queue(&pipeline->songs);
+  return !pipeline->failed;
+} /* run_load_pipeline() */
+
+/*
+ * the callback function for ftw, queueing the path of every .mid file
+ */
+
+int enumerate_callback(const char *file_path, const struct stat *ptr,
+    int flag) {
+  if ((flag != FTW_F) && (flag != FTW_NS)) {
+    return OK;
+  }
+  const char *extension = strrchr(file_path, '.');
+  if ((extension == NULL) || (strcmp(extension, ".mid") != 0)) {
+    return OK;
+  }
+  char *path = malloc(strlen(file_path) + 1);
+  assert(path);
+  strcpy(path, file_path);
+  g_enumerating->stages[STAGE_ENUMERATE].items++;
+  bool push_return = queue_push(&g_enumerating->paths, path);
+  assert(push_return);
+  return OK;
+} /* enumerate_callback() */
+
+/*
+ * walks the directory, then closes the queue of paths
+ */
+
+void *enumerate_stage(void *pipeline_data) {
+  load_pipeline_t *pipeline = pipeline_data;
+  uint64_t start = pipeline_clock();
+  g_enumerating = pipeline;
+  if (ftw(pipeline->directory, enumerate_callback, NO_DIRS) != OK) {
+    pipeline->failed = true;
+  }
+  g_enumerating = NULL;
+  close_queue(&pipeline->paths);
+  pipeline->stages[STAGE_ENUMERATE].busy_ns = pipeline_clock() - start -
+    pipeline->paths.full_wait_ns;
+  return NULL;
+} /* enumerate_stage() */
+
+/*
+ * keeps up to depth reads of the queued paths in flight and queues every
+ * file once it is read, then closes the queue of files
+ */
+
+void *load_stage(void *pipeline_data) {
+  load_pipeline_t *pipeline = pipeline_data;
+  stage_stats_t *stats = &pipeline->stages[STAGE_LOAD];
+  uint64_t start = pipeline_clock();
+  file_reader_t *reader = create_file_reader(pipeline->depth,
+      pipeline->read_backend);
+  bool more_paths = true;
+  while ((more_paths) || (reader->in_flight)) {
+    while ((more_paths) && (reader->in_flight < reader->depth)) {
+      void *path = NULL;
+      if (reader->in_flight) {
+        if (!queue_try_pop(&pipeline->paths, &path)) {
+          break;
+        }
+      }
+      else if (!queue_pop(&pipeline->paths, &path)) {
+        more_paths = false;
+        break;
+      }
+      submit_read(reader, path);
+      free(path);
+      path = NULL;
+    }
+    loaded_file_t file;
+    if (!next_loaded_file(reader, &file)) {
+      continue;
+    }
+    if ((file.error) || (file.size == 0)) {
+      printf("cannot read %s: %s\n", file.path,
+          strerror(file.error ? file.error : EINVAL));
+      free_loaded_file(&file);
+      continue;
+    }
+    loaded_file_t *queued = malloc(sizeof(loaded_file_t));
+    assert(queued);
+    *queued = file;
+    stats->items++;
+    stats->bytes += file.size;
+    bool push_return = queue_push(&pipeline->files, queued);
+    assert(push_return);
+  }
+  free_file_reader(reader);
+  reader = NULL;
+  close_queue(&pipeline->files);
+  stats->busy_ns = pipeline_clock() - start - pipeline->paths.empty_wait_ns -
+    pipeline->files.full_wait_ns;
+  return NULL;
+} /* load_stage() */
+
+/*
+ * parses queued files into songs until there are no more, the last parser
+ * to finish closing the queue of songs
+ */
+
+void *parse_stage(void *pipeline_data) {
+  load_pipeline_t *pipeline = pipeline_data;
+  stage_stats_t *stats = &pipeline->stages[STAGE_PARSE];
+  void *item = NULL;
+  while (queue_pop(&pipeline->files, &item)) {
+    loaded_file_t *file = item;
+    uint64_t start = pipeline_clock();
+    song_data_t *song = parse_buffer(file->path, file->data, file->size);
+    __atomic_fetch_add(&stats->busy_ns, pipeline_clock() - start,
+        __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->items, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->bytes, file->size, __ATOMIC_RELAXED);
+    free_loaded_file(file);
+    free(file);
+    file = NULL;
+    bool push_return = queue_push(&pipeline->songs, song);
+    assert(push_return);
+  }
+  if (__atomic_sub_fetch(&pipeline->parsers_left, 1, __ATOMIC_ACQ_REL) == 0) {
+    close_queue(&pipeline->songs);
+  }
+  return NULL;
+} /* parse_stage() */
+
+/*
+ * prints the throughput and utilization of every stage and the occupancy of
+ * every queue. The stage closest to full utilization is the bottleneck
+ */
+
+void print_load_stats(FILE *out, load_pipeline_t *pipeline) {
+  static const char *stage_names[NUM_STAGES] = {
+    "enumerate", "load", "parse", "insert"
+  };
+  work_queue_t *queues[] = {
+    &pipeline->paths, &pipeline->files, &pipeline->songs
+  };
+  static const char *queue_names[] = { "paths", "files", "songs" };
+  double wall = pipeline->wall_ns ? pipeline->wall_ns : 1;
+  fprintf(out, "Load pipeline, %.3f ms, depth %u:\n", wall / NS_PER_MS,
+      pipeline->depth);
+  fprintf(out, "  %-10s %7s %8s %12s %10s %8s\n", "stage", "threads",
+      "items", "items/s", "MB/s", "busy");
+  for (int i = 0; i < NUM_STAGES; i++) {
+    stage_stats_t *stats = &pipeline->stages[i];
+    double busy = stats->busy_ns ? stats->busy_ns : 1;
+    fprintf(out, "  %-10s %7d %8lu %12.0f %10.2f %7.1f%%\n", stage_names[i],
+        stats->threads, stats->items,
+        stats->items * stats->threads * (double) NS_PER_SEC / busy,
+        stats->bytes * stats->threads * (NS_PER_SEC / BYTES_PER_MB) / busy,
+        PERCENT * stats->busy_ns / (wall * stats->threads));
+  }
+  fprintf(out, "  %-10s %7s %8s %12s %10s %10s\n", "queue", "depth",
+      "mean", "max", "full ms", "empty ms");
+  for (int i = 0; i < NUM_STAGES - 1; i++) {
+    work_queue_t *queue = queues[i];
+    fprintf(out, "  %-10s %7u %8.2f %12u %10.3f %10.3f\n", queue_names[i],
+        queue->capacity, queue->pushes ?
+        (double) queue->occupancy_sum / queue->pushes : 0,
+        queue->max_count, queue->full_wait_ns / NS_PER_MS,
+        queue->empty_wait_ns / NS_PER_MS);
+  }
+} /* print_load_stats() */
@@ -0,0 +1,92 @@
+#ifndef _LOAD_PIPELINE_H
+#define _LOAD_PIPELINE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "parser.h"
+
+#define DEFAULT_QUEUE_DEPTH (16)
+//  Up to this many parse threads, one per online processor
+#define AUTO_PARSE_THREADS (0)
+#define MAX_PARSE_THREADS (8)
+
+#define STAGE_ENUMERATE (0)
+#define STAGE_LOAD (1)
+#define STAGE_PARSE (2)
+#define STAGE_INSERT (3)
+#define NUM_STAGES (4)
+
+//  Bounded queue between two stages. A full queue blocks its producers, so
+//  a slow stage holds back the ones before it
+typedef struct work_queue_s {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  uint32_t capacity;
+  uint32_t head;
+  uint32_t count;
+  void **items;
+  //  Set once the producers are done
+  bool closed;
+
+  //  Occupancy seen by every push, for the average
+  uint64_t pushes;
+  uint64_t occupancy_sum;
+  uint32_t max_count;
+  //  Time producers waited on a full queue and consumers on an empty one
+  uint64_t full_wait_ns;
+  uint64_t empty_wait_ns;
+} work_queue_t;
+
+typedef struct stage_stats_s {
+  uint64_t items;
+  uint64_t bytes;
+  //  Time spent working rather than waiting on a queue, over all threads
+  uint64_t busy_ns;
+  int threads;
+} stage_stats_t;
+
+//  Called by the insert stage, on the thread that runs the pipeline, for
+//  every song in the order they are parsed
+typedef void (*insert_func_t)(song_data_t *);
+
+typedef struct load_pipeline_s {
+  const char *directory;
+  insert_func_t insert;
+  int read_backend;
+  uint32_t depth;
+
+  //  Paths to the load stage, loaded files to the parse stage and songs to
+  //  the insert stage
+  work_queue_t paths;
+  work_queue_t files;
+  work_queue_t songs;
+  //  Parse threads still running, the last one closes songs
+  int parsers_left;
+  //  Set if the directory could not be walked
+  bool failed;
+
+  stage_stats_t stages[NUM_STAGES];
+  uint64_t wall_ns;
+} load_pipeline_t;
+
+//  Stats of the last make_library()
+extern load_pipeline_t g_last_load;
+
+//  Queue
+void init_work_queue(work_queue_t *, uint32_t);
+void free_work_queue(work_queue_t *);
+bool queue_push(work_queue_t *, void *);
+bool queue_pop(work_queue_t *, void **);
+bool queue_try_pop(work_queue_t *, void **);
+void close_queue(work_queue_t *);
+
+//  Pipeline
+bool run_load_pipeline(load_pipeline_t *, const char *, insert_func_t, int,
+    uint32_t, int);
+void print_load_stats(FILE *, load_pipeline_t *);
+
+#endif // _LOAD_PIPELINE_H
@@ -0,0 +1,862 @@
+/* Name, melody_index.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "melody_index.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define NOTE_ON_STATUS (0x90)
+#define KIND_MASK (0xF0)
+#define CHANNEL_MASK (0x0F)
+#define INTERVAL_BIAS (128)
+#define LISTS_MIN_CAPACITY (256)
+#define SONGS_MIN_CAPACITY (64)
+#define BYTES_MIN_CAPACITY (16)
+#define VARINT_MAX_BYTES (10)
+#define VARINT_MASK (0x7F)
+#define VARINT_MORE (0x80)
+#define MELODY_MAGIC "MIDX"
+
+//  One decoded posting
+typedef struct posting_s {
+  uint32_t song;
+  uint16_t track;
+  uint32_t note;
+  uint64_t tick;
+} posting_t;
+
+//  Query n-gram hit, aligned to where the query would start in the track
+typedef struct candidate_s {
+  uint32_t song;
+  uint16_t track;
+  int64_t start;
+  uint64_t tick;
+} candidate_t;
+
+uint32_t ngram_key(uint8_t *pitches);
+uint32_t hash_name(const char *name);
+posting_list_t *find_list(melody_index_t *index, uint32_t key, bool create);
+void grow_lists(melody_index_t *index, uint32_t capacity);
+void add_song_name(melody_index_t *index, uint32_t id);
+void put_varint(posting_list_t *list, uint64_t value);
+uint64_t get_varint(const uint8_t **cursor);
+void append_posting(posting_list_t *list, posting_t *posting);
+void decode_posting(const uint8_t **cursor, posting_t *posting);
+void stat_song_file(const char *path, uint64_t *size, int64_t *mtime);
+bool valid_posting_list(posting_list_t *list, uint32_t num_songs);
+void compact_melody_index(melody_index_t *index);
+int compare_candidates(const void *candidate_1, const void *candidate_2);
+int compare_matches(const void *match_1, const void *match_2);
+bool write_value(FILE *file, const void *value, size_t size);
+bool read_value(FILE *file, void *value, size_t size);
+
+/*
+ * returns the key of the n-gram starting at pitches, the intervals between
+ * its notes biased into one byte each
+ */
+
+uint32_t ngram_key(uint8_t *pitches) {
+  uint32_t key = 0;
+  for (int i = 1; i < NGRAM_NOTES; i++) {
+    int interval = (int) pitches[i] - (int) pitches[i - 1];
+    if (interval > MAX_INTERVAL) {
+      interval = MAX_INTERVAL;
+    }
+    else if (interval < -MAX_INTERVAL) {
+      interval = -MAX_INTERVAL;
+    }
+    key = (key << 8) | (uint32_t) (interval + INTERVAL_BIAS);
+  }
+  return key;
+} /* ngram_key() */
+
+/*
+ * returns the FNV-1a hash of the name
+ */
+
+uint32_t hash_name(const char *name) {
+  uint32_t hash = 2166136261u;
+  while (*name) {
+    hash = (hash ^ (uint8_t) *name++) * 16777619u;
+  }
+  return hash;
+} /* hash_name() */
+
+/*
+ * returns the posting list of the key, or NULL if there is none and create
+ * is false
+ */
+
+posting_list_t *find_list(melody_index_t *index, uint32_t key, bool create) {
+  if (index->capacity == 0) {
+    if (!create) {
+      return NULL;
+    }
+    grow_lists(index, LISTS_MIN_CAPACITY);
+  }
+  uint32_t mask = index->capacity - 1;
+  uint32_t slot = (key * 2654435761u) & mask;
+  while (index->lists[slot].bytes) {
+    if (index->lists[slot].key == key) {
+      return &index->lists[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  if (!create) {
+    return NULL;
+  }
+  if (2 * (index->num_lists + 1) > index->capacity) {
+    grow_lists(index, index->capacity * 2);
+    return find_list(index, key, create);
+  }
+  posting_list_t *list = &index->lists[slot];
+  memset(list, 0, sizeof(posting_list_t));
+  list->key = key;
+  list->capacity = BYTES_MIN_CAPACITY;
+  list->bytes = malloc(list->capacity);
+  assert(list->bytes);
+  index->num_lists++;
+  return list;
+} /* find_list() */
+
+/*
+ * moves the posting lists into a table of the given capacity
+ */
+
+void grow_lists(melody_index_t *index, uint32_t capacity) {
+  posting_list_t *old_lists = index->lists;
+  uint32_t old_capacity = index->capacity;
+  index->lists = malloc(sizeof(posting_list_t) * capacity);
+  assert(index->lists);
+  memset(index->lists, 0, sizeof(posting_list_t) * capacity);
+  index->capacity = capacity;
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    if (old_lists[i].bytes == NULL) {
+      continue;
+    }
+    uint32_t slot = (old_lists[i].key * 2654435761u) & (capacity - 1);
+    while (index->lists[slot].bytes) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    index->lists[slot] = old_lists[i];
+  }
+  free(old_lists);
+  old_lists = NULL;
+} /* grow_lists() */
+
+/*
+ * makes the song findable by name, growing the name table if needed
+ */
+
+void add_song_name(melody_index_t *index, uint32_t id) {
+  if (2 * index->num_songs > index->names_capacity) {
+    free(index->names);
+    index->names_capacity = index->names_capacity ?
+      index->names_capacity * 2 : SONGS_MIN_CAPACITY;
+    index->names = malloc(sizeof(uint32_t) * index->names_capacity);
+    assert(index->names);
+    memset(index->names, 0, sizeof(uint32_t) * index->names_capacity);
+    for (uint32_t i = 1; i <= index->num_songs; i++) {
+      if ((i != id) && (index->songs[i].name)) {
+        add_song_name(index, i);
+      }
+    }
+  }
+  uint32_t mask = index->names_capacity - 1;
+  uint32_t slot = hash_name(index->songs[id].name) & mask;
+  while (index->names[slot] != NO_MELODY_ID) {
+    slot = (slot + 1) & mask;
+  }
+  index->names[slot] = id;
+} /* add_song_name() */
+
+/*
+ * appends the value to the list as a varint
+ */
+
+void put_varint(posting_list_t *list, uint64_t value) {
+  if (list->size + VARINT_MAX_BYTES > list->capacity) {
+    list->capacity *= 2;
+    list->bytes = realloc(list->bytes, list->capacity);
+    assert(list->bytes);
+  }
+  while (value > VARINT_MASK) {
+    list->bytes[list->size++] = (value & VARINT_MASK) | VARINT_MORE;
+    value >>= 7;
+  }
+  list->bytes[list->size++] = value;
+} /* put_varint() */
+
+/*
+ * reads a varint and moves the cursor past it
+ */
+
+uint64_t get_varint(const uint8_t **cursor) {
+  uint64_t value = 0;
+  int shift = 0;
+  while (**cursor & VARINT_MORE) {
+    value |= (uint64_t) (*(*cursor)++ & VARINT_MASK) << shift;
+    shift += 7;
+  }
+  return value | ((uint64_t) *(*cursor)++ << shift);
+} /* get_varint() */
+
+/*
+ * appends the posting, which must come after the last one of the list. It
+ * is stored as the song difference, then the track difference within the
+ * same song, then the note and tick differences within the same track.
+ * Fields after the first that differs are stored whole
+ */
+
+void append_posting(posting_list_t *list, posting_t *posting) {
+  bool same_song = list->count && (posting->song == list->last_song);
+  bool same_track = same_song && (posting->track == list->last_track);
+  put_varint(list, posting->song - (list->count ? list->last_song : 0));
+  put_varint(list, posting->track - (same_song ? list->last_track : 0));
+  put_varint(list, posting->note - (same_track ? list->last_note : 0));
+  put_varint(list, posting->tick - (same_track ? list->last_tick : 0));
+  list->count++;
+  list->last_song = posting->song;
+  list->last_track = posting->track;
+  list->last_note = posting->note;
+  list->last_tick = posting->tick;
+} /* append_posting() */
+
+/*
+ * decodes the posting at the cursor over the previous one, which must be
+ * zeroed before the first posting of a list
+ */
+
+void decode_posting(const uint8_t **cursor, posting_t *posting) {
+  uint32_t song = get_varint(cursor);
+  uint16_t track = get_varint(cursor);
+  uint32_t note = get_varint(cursor);
+  uint64_t tick = get_varint(cursor);
+  if (song) {
+    posting->song += song;
+    posting->track = track;
+    posting->note = note;
+    posting->tick = tick;
+  }
+  else if (track) {
+    posting->track += track;
+    posting->note = note;
+    posting->tick = tick;
+  }
+  else {
+    posting->note += note;
+    posting->tick += tick;
+  }
+} /* decode_posting() */
+
+/*
+ * returns an empty index
+ */
+
+melody_index_t *create_melody_index() {
+  melody_index_t *index = malloc(sizeof(melody_index_t));
+  assert(index);
+  memset(index, 0, sizeof(melody_index_t));
+  return index;
+} /* create_melody_index() */
+
+/*
+ * frees the index and every posting list
+ */
+
+void free_melody_index(melody_index_t *index) {
+  if (index == NULL) {
+    return;
+  }
+  for (uint32_t i = 0; i < index->capacity; i++) {
+    free(index->lists[i].bytes);
+    index->lists[i].bytes = NULL;
+  }
+  free(index->lists);
+  index->lists = NULL;
+  for (uint32_t i = 1; i <= index->num_songs; i++) {
+    free(index->songs[i].name);
+    index->songs[i].name = NULL;
+  }
+  free(index->songs);
+  index->songs = NULL;
+  free(index->names);
+  index->names = NULL;
+  free(index);
+  index = NULL;
+} /* free_melody_index() */
+
+/*
+ * stores the melody of the track in pitches and the tick of each note in
+ * ticks, if set, and returns its number of notes
+ */
+
+uint32_t track_melody(track_t *track, uint8_t *pitches, uint64_t *ticks) {
+  assert(track);
+  uint32_t count = 0;
+  uint64_t tick = 0;
+  uint64_t last_tick = 0;
+  uint8_t last_pitch = 0;
+  event_node_t *event_list = track->event_list;
+  while (event_list) {
+    event_t *event = event_list->event;
+    event_list = event_list->next_event;
+    tick += event->delta_time;
+    if ((event_type(event) != MIDI_EVENT_T) ||
+        ((event->midi_event.status & KIND_MASK) != NOTE_ON_STATUS) ||
+        ((event->midi_event.status & CHANNEL_MASK) == DRUM_CHANNEL) ||
+        (event->midi_event.data_len < 2) ||
+        (event->midi_event.data[1] == 0)) {
+      continue;
+    }
+    uint8_t pitch = event->midi_event.data[0];
+    if (count && (tick == last_tick)) {
+      if (pitch <= last_pitch) {
+        continue;
+      }
+      count--;
+    }
+    if (pitches) {
+      pitches[count] = pitch;
+    }
+    if (ticks) {
+      ticks[count] = tick;
+    }
+    count++;
+    last_tick = tick;
+    last_pitch = pitch;
+  }
+  return count;
+} /* track_melody() */
+
+/*
+ * adds the n-grams of every track of the song to the index under the name
+ * and returns the new id of the song
+ */
+
+uint32_t index_song(melody_index_t *index, const char *name,
+    song_data_t *song) {
+  assert(index);
+  assert(name);
+  assert(song);
+  if (index->num_songs + 1 >= index->songs_capacity) {
+    index->songs_capacity = index->songs_capacity ?
+      index->songs_capacity * 2 : SONGS_MIN_CAPACITY;
+    index->songs = realloc(index->songs,
+        sizeof(indexed_song_t) * index->songs_capacity);
+    assert(index->songs);
+  }
+  uint32_t id = ++index->num_songs;
+  indexed_song_t *indexed = &index->songs[id];
+  indexed->name = strdup(name);
+  assert(indexed->name);
+  indexed->num_postings = 0;
+  indexed->attached = true;
+  stat_song_file(song->path, &indexed->file_size, &indexed->file_mtime);
+  add_song_name(index, id);
+
+  uint16_t track_number = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    track_t *track = track_list->track;
+    uint32_t count = track_melody(track, NULL, NULL);
+    if (count >= NGRAM_NOTES) {
+      uint8_t *pitches = malloc(count);
+      assert(pitches);
+      uint64_t *ticks = malloc(sizeof(uint64_t) * count);
+      assert(ticks);
+      track_melody(track, pitches, ticks);
+      for (uint32_t i = 0; i + NGRAM_NOTES <= count; i++) {
+        posting_t posting = { id, track_number, i, ticks[i] };
+        append_posting(find_list(index, ngram_key(&pitches[i]), true),
+            &posting);
+      }
+      indexed->num_postings += count - NGRAM_NOTES + 1;
+      free(pitches);
+      pitches = NULL;
+      free(ticks);
+      ticks = NULL;
+    }
+    track_number++;
+    track_list = track_list->next_track;
+  }
+  index->live_postings += indexed->num_postings;
+  return id;
+} /* index_song() */
+
+/*
+ * stores the size and modification time of the file at path, or 0 for both
+ * if it cannot be read
+ */
+
+void stat_song_file(const char *path, uint64_t *size, int64_t *mtime) {
+  struct stat info;
+  if ((path == NULL) || (stat(path, &info) != 0)) {
+    *size = 0;
+    *mtime = 0;
+    return;
+  }
+  *size = info.st_size;
+  *mtime = (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+} /* stat_song_file() */
+
+/*
+ * returns the id of an indexed song with the name that no library node
+ * holds yet, such as one read back from a file, and marks it held. A song
+ * indexed from a different version of the file at path is removed instead.
+ * Returns NO_MELODY_ID if there is none
+ */
+
+uint32_t attach_song(melody_index_t *index, const char *name,
+    const char *path) {
+  assert(index);
+  assert(name);
+  if (index->names_capacity == 0) {
+    return NO_MELODY_ID;
+  }
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  stat_song_file(path, &size, &mtime);
+  uint32_t mask = index->names_capacity - 1;
+  uint32_t slot = hash_name(name) & mask;
+  while (index->names[slot] != NO_MELODY_ID) {
+    uint32_t id = index->names[slot];
+    indexed_song_t *indexed = &index->songs[id];
+    slot = (slot + 1) & mask;
+    if ((indexed->name == NULL) || (indexed->attached) ||
+        (strcmp(indexed->name, name) != 0)) {
+      continue;
+    }
+    if ((indexed->file_size != size) || (indexed->file_mtime != mtime)) {
+      remove_indexed_song(index, id);
+      continue;
+    }
+    indexed->attached = true;
+    return id;
+  }
+  return NO_MELODY_ID;
+} /* attach_song() */
+
+/*
+ * removes the song from search results. Its postings are dropped once the
+ * postings of removed songs outnumber the others
+ */
+
+void remove_indexed_song(melody_index_t *index, uint32_t id) {
+  assert(index);
+  assert((id != NO_MELODY_ID) && (id <= index->num_songs));
+  indexed_song_t *indexed = &index->songs[id];
+  assert(indexed->name);
+  free(indexed->name);
+  indexed->name = NULL;
+  indexed->attached = false;
+  index->live_postings -= indexed->num_postings;
+  index->dead_postings += indexed->num_postings;
+  if (index->dead_postings > index->live_postings) {
+    compact_melody_index(index);
+  }
+} /* remove_indexed_song() */
+
+/*
+ * re-encodes every posting list without the postings of removed songs,
+ * dropping lists left empty
+ */
+
+void compact_melody_index(melody_index_t *index) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < index->capacity; i++) {
+    posting_list_t *list = &index->lists[i];
+    if (list->bytes == NULL) {
+      continue;
+    }
+    posting_list_t compact = { list->key, 0, 0, list->capacity };
+    compact.bytes = malloc(compact.capacity);
+    assert(compact.bytes);
+    const uint8_t *cursor = list->bytes;
+    posting_t posting = {0};
+    for (uint32_t j = 0; j < list->count; j++) {
+      decode_posting(&cursor, &posting);
+      if (index->songs[posting.song].name) {
+        append_posting(&compact, &posting);
+      }
+    }
+    free(list->bytes);
+    list->bytes = NULL;
+    if (compact.count) {
+      *list = compact;
+      kept++;
+    }
+    else {
+      free(compact.bytes);
+      compact.bytes = NULL;
+    }
+  }
+  index->num_lists = kept;
+  //  Emptied slots may break probe sequences, so every list is placed again
+  grow_lists(index, index->capacity);
+  index->dead_postings = 0;
+} /* compact_melody_index() */
+
+/*
+ * orders candidates by song, track, start and tick
+ */
+
+int compare_candidates(const void *candidate_1, const void *candidate_2) {
+  const candidate_t *first = candidate_1;
+  const candidate_t *second = candidate_2;
+  if (first->song != second->song) {
+    return (first->song > second->song) - (first->song < second->song);
+  }
+  if (first->track != second->track) {
+    return (first->track > second->track) - (first->track < second->track);
+  }
+  if (first->start != second->start) {
+    return (first->start > second->start) - (first->start < second->start);
+  }
+  return (first->tick > second->tick) - (first->tick < second->tick);
+} /* compare_candidates() */
+
+/*
+ * orders matches by decreasing score, then decreasing number of positions,
+ * then name
+ */
+
+int compare_matches(const void *match_1, const void *match_2) {
+  const melody_match_t *first = match_1;
+  const melody_match_t *second = match_2;
+  if (first->score != second->score) {
+    return (first->score < second->score) - (first->score > second->score);
+  }
+  if (first->num_positions != second->num_positions) {
+    return (first->num_positions < second->num_positions) -
+      (first->num_positions > second->num_positions);
+  }
+  return strcmp(first->song_name, second->song_name);
+} /* compare_matches() */
+
+/*
+ * finds the songs sharing n-grams with the pitches. Every hit votes for the
+ * place the query would start in its track, and a song scores the most
+ * votes any such place gets. Its positions are the places with that score
+ */
+
+melody_results_t *query_melody(melody_index_t *index, uint8_t *pitches,
+    uint32_t count) {
+  assert(index);
+  assert(pitches);
+  assert(count >= NGRAM_NOTES);
+  uint32_t num_candidates = 0;
+  uint32_t capacity = 0;
+  candidate_t *candidates = NULL;
+  for (uint32_t i = 0; i + NGRAM_NOTES <= count; i++) {
+    posting_list_t *list = find_list(index, ngram_key(&pitches[i]), false);
+    if (list == NULL) {
+      continue;
+    }
+    if (num_candidates + list->count > capacity) {
+      capacity = num_candidates + list->count;
+      capacity += capacity / 2;
+      candidates = realloc(candidates, sizeof(candidate_t) * capacity);
+      assert(candidates);
+    }
+    const uint8_t *cursor = list->bytes;
+    posting_t posting = {0};
+    for (uint32_t j = 0; j < list->count; j++) {
+      decode_posting(&cursor, &posting);
+      if ((index->songs[posting.song].name == NULL) ||
+          (!index->songs[posting.song].attached)) {
+        continue;
+      }
+      candidates[num_candidates++] = (candidate_t) {
+        posting.song, posting.track, (int64_t) posting.note - i,
+        posting.tick
+      };
+    }
+  }
+  if (num_candidates) {
+    qsort(candidates, num_candidates, sizeof(candidate_t),
+        compare_candidates);
+  }
+
+  melody_results_t *results = malloc(sizeof(melody_results_t));
+  assert(results);
+  results->num_matches = 0;
+  results->matches = NULL;
+  uint32_t matches_capacity = 0;
+  uint32_t i = 0;
+  while (i < num_candidates) {
+    //  Two passes over the candidates of one song, to find the best score
+    //  and then collect its positions
+    uint32_t song = candidates[i].song;
+    uint32_t end = i;
+    uint32_t best = 0;
+    uint32_t num_best = 0;
+    while ((end < num_candidates) && (candidates[end].song == song)) {
+      uint32_t group = end;
+      while ((end < num_candidates) && (candidates[end].song == song) &&
+          (candidates[end].track == candidates[group].track) &&
+          (candidates[end].start == candidates[group].start)) {
+        end++;
+      }
+      if (end - group > best) {
+        best = end - group;
+        num_best = 0;
+      }
+      num_best += (end - group == best);
+    }
+    if (results->num_matches == matches_capacity) {
+      matches_capacity = matches_capacity ? matches_capacity * 2 :
+        SONGS_MIN_CAPACITY;
+      results->matches = realloc(results->matches,
+          sizeof(melody_match_t) * matches_capacity);
+      assert(results->matches);
+    }
+    melody_match_t *match = &results->matches[results->num_matches++];
+    match->song_name = index->songs[song].name;
+    match->score = best;
+    match->num_positions = 0;
+    match->positions = malloc(sizeof(melody_position_t) * num_best);
+    assert(match->positions);
+    while (i < end) {
+      uint32_t group = i;
+      while ((i < end) && (candidates[i].track == candidates[group].track) &&
+          (candidates[i].start == candidates[group].start)) {
+        i++;
+      }
+      if (i - group == best) {
+        match->positions[match->num_positions++] = (melody_position_t) {
+          candidates[group].track, candidates[group].tick
+        };
+      }
+    }
+  }
+  free(candidates);
+  candidates = NULL;
+  if (results->num_matches) {
+    qsort(results->matches, results->num_matches, sizeof(melody_match_t),
+        compare_matches);
+  }
+  return results;
+} /* query_melody() */
+
+/*
+ * frees the results of a query
+ */
+
+void free_melody_results(melody_results_t *results) {
+  for (uint32_t i = 0; i < results->num_matches; i++) {
+    free(results->matches[i].positions);
+    results->matches[i].positions = NULL;
+  }
+  free(results->matches);
+  results->matches = NULL;
+  free(results);
+  results = NULL;
+} /* free_melody_results() */
+
+/*
+ * writes size bytes of the value, returning false on failure
+ */
+
+bool write_value(FILE *file, const void *value, size_t size) {
+  return fwrite(value, size, 1, file) == 1;
+} /* write_value() */
+
+/*
+ * reads size bytes into the value, returning false on failure
+ */
+
+bool read_value(FILE *file, void *value, size_t size) {
+  return fread(value, size, 1, file) == 1;
+} /* read_value() */
+
+/*
+ * writes the index to the file at path. Removed songs are kept as empty
+ * names so ids stay the same. Songs read back are not attached to any
+ * library node
+ */
+
+int write_melody_index(melody_index_t *index, const char *path) {
+  assert(index);
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return WRITE_INDEX_ERROR;
+  }
+  uint32_t version = MELODY_INDEX_VERSION;
+  bool written = write_value(file, MELODY_MAGIC, strlen(MELODY_MAGIC)) &&
+    write_value(file, &version, sizeof(version)) &&
+    write_value(file, &index->num_songs, sizeof(index->num_songs));
+  for (uint32_t i = 1; written && (i <= index->num_songs); i++) {
+    indexed_song_t *indexed = &index->songs[i];
+    uint32_t length = indexed->name ? strlen(indexed->name) : 0;
+    written = write_value(file, &length, sizeof(length)) &&
+      ((length == 0) || write_value(file, indexed->name, length)) &&
+      write_value(file, &indexed->num_postings,
+          sizeof(indexed->num_postings)) &&
+      write_value(file, &indexed->file_size, sizeof(indexed->file_size)) &&
+      write_value(file, &indexed->file_mtime, sizeof(indexed->file_mtime));
+  }
+  written = written &&
+    write_value(file, &index->num_lists, sizeof(index->num_lists));
+  for (uint32_t i = 0; written && (i < index->capacity); i++) {
+    posting_list_t *list = &index->lists[i];
+    if (list->bytes == NULL) {
+      continue;
+    }
+    written = write_value(file, &list->key, sizeof(list->key)) &&
+      write_value(file, &list->count, sizeof(list->count)) &&
+      write_value(file, &list->size, sizeof(list->size)) &&
+      write_value(file, &list->last_song, sizeof(list->last_song)) &&
+      write_value(file, &list->last_track, sizeof(list->last_track)) &&
+      write_value(file, &list->last_note, sizeof(list->last_note)) &&
+      write_value(file, &list->last_tick, sizeof(list->last_tick)) &&
+      write_value(file, list->bytes, list->size);
+  }
+  if (fclose(file) != 0) {
+    written = false;
+  }
+  file = NULL;
+  return written ? WRITE_INDEX_SUCCESS : WRITE_INDEX_ERROR;
+} /* write_melody_index() */
+
+/*
+ * returns whether the list read from a file decodes to exactly count
+ * postings inside its bytes, of songs 1 to num_songs in order, ending at
+ * its last posting
+ */
+
+bool valid_posting_list(posting_list_t *list, uint32_t num_songs) {
+  if (list->count == 0) {
+    return false;
+  }
+  //  Each posting is four varints, which are checked to end inside the list
+  //  before any is decoded
+  const uint8_t *cursor = list->bytes;
+  const uint8_t *end = list->bytes + list->size;
+  for (uint64_t i = 0; i < (uint64_t) list->count * 4; i++) {
+    int length = 1;
+    while ((cursor < end) && (*cursor & VARINT_MORE) &&
+        (length < VARINT_MAX_BYTES)) {
+      cursor++;
+      length++;
+    }
+    if ((cursor == end) || (*cursor & VARINT_MORE)) {
+      return false;
+    }
+    cursor++;
+  }
+  if (cursor != end) {
+    return false;
+  }
+  cursor = list->bytes;
+  posting_t posting = {0};
+  for (uint32_t i = 0; i < list->count; i++) {
+    uint32_t last_song = posting.song;
+    decode_posting(&cursor, &posting);
+    if ((posting.song == NO_MELODY_ID) || (posting.song > num_songs) ||
+        (posting.song < last_song)) {
+      return false;
+    }
+  }
+  return (posting.song == list->last_song) &&
+    (posting.track == list->last_track) &&
+    (posting.note == list->last_note) && (posting.tick == list->last_tick);
+} /* valid_posting_list() */
+
+/*
+ * reads an index written by write_melody_index(), returning NULL if the
+ * file cannot be read, is not an index or is corrupt
+ */
+
+melody_index_t *read_melody_index(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+  //  No count or size read back can exceed the file, which bounds every
+  //  allocation made for a corrupt one
+  uint64_t file_size = 0;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long end = ftell(file);
+    file_size = (end > 0) ? end : 0;
+  }
+  rewind(file);
+  melody_index_t *index = create_melody_index();
+  char magic[sizeof(MELODY_MAGIC)] = {0};
+  uint32_t version = 0;
+  uint32_t num_songs = 0;
+  bool read = read_value(file, magic, strlen(MELODY_MAGIC)) &&
+    (strcmp(magic, MELODY_MAGIC) == 0) &&
+    read_value(file, &version, sizeof(version)) &&
+    (version == MELODY_INDEX_VERSION) &&
+    read_value(file, &num_songs, sizeof(num_songs)) &&
+    (num_songs <= file_size);
+  if (read) {
+    index->songs_capacity = num_songs + SONGS_MIN_CAPACITY;
+    index->songs = malloc(sizeof(indexed_song_t) * index->songs_capacity);
+    assert(index->songs);
+    memset(index->songs, 0, sizeof(indexed_song_t) * index->songs_capacity);
+  }
+  for (uint32_t i = 1; read && (i <= num_songs); i++) {
+    indexed_song_t *indexed = &index->songs[i];
+    uint32_t length = 0;
+    read = read_value(file, &length, sizeof(length)) &&
+      (length <= file_size);
+    if (read && length) {
+      indexed->name = malloc(length + 1);
+      assert(indexed->name);
+      read = read_value(file, indexed->name, length);
+      indexed->name[length] = '\0';
+    }
+    read = read && read_value(file, &indexed->num_postings,
+        sizeof(indexed->num_postings)) &&
+      read_value(file, &indexed->file_size, sizeof(indexed->file_size)) &&
+      read_value(file, &indexed->file_mtime, sizeof(indexed->file_mtime));
+    index->num_songs = i;
+    if (read && indexed->name) {
+      add_song_name(index, i);
+      index->live_postings += indexed->num_postings;
+    }
+    else {
+      index->dead_postings += indexed->num_postings;
+    }
+  }
+  uint32_t num_lists = 0;
+  read = read && read_value(file, &num_lists, sizeof(num_lists));
+  for (uint32_t i = 0; read && (i < num_lists); i++) {
+    posting_list_t loaded = {0};
+    read = read_value(file, &loaded.key, sizeof(loaded.key)) &&
+      read_value(file, &loaded.count, sizeof(loaded.count)) &&
+      read_value(file, &loaded.size, sizeof(loaded.size)) &&
+      read_value(file, &loaded.last_song, sizeof(loaded.last_song)) &&
+      read_value(file, &loaded.last_track, sizeof(loaded.last_track)) &&
+      read_value(file, &loaded.last_note, sizeof(loaded.last_note)) &&
+      read_value(file, &loaded.last_tick, sizeof(loaded.last_tick)) &&
+      (loaded.size <= file_size);
+    if (!read) {
+      break;
+    }
+    posting_list_t *list = find_list(index, loaded.key, true);
+    free(list->bytes);
+    loaded.capacity = loaded.size + BYTES_MIN_CAPACITY;
+    loaded.bytes = malloc(loaded.capacity);
+    assert(loaded.bytes);
+    *list = loaded;
+    read = read_value(file, list->bytes, list->size) &&
+      valid_posting_list(list, num_songs);
+  }
+  fclose(file);
+  file = NULL;
+  if (!read) {
+    free_melody_index(index);
+    index = NULL;
+  }
+  return index;
+} /* read_melody_index() */
@@ -0,0 +1,105 @@
+#ifndef _MELODY_INDEX_H
+#define _MELODY_INDEX_H
+
+#include "parser.h"
+
+//  Notes per n-gram. Its key is made of the NGRAM_NOTES - 1 intervals
+//  between them, one byte each
+#define NGRAM_NOTES (5)
+#define MAX_INTERVAL (127)
+#define DRUM_CHANNEL (9)
+#define NO_MELODY_ID (0)
+#define MELODY_INDEX_VERSION (2)
+
+#define WRITE_INDEX_SUCCESS (0)
+#define WRITE_INDEX_ERROR (-1)
+
+//  Every place an n-gram occurs, by increasing song, track and note. Each
+//  posting is stored as varints relative to the one before it, see
+//  append_posting()
+typedef struct posting_list_s {
+  uint32_t key;
+  uint32_t count;
+  uint32_t size;
+  uint32_t capacity;
+  uint8_t *bytes;
+
+  //  Last posting, the base of the next append
+  uint32_t last_song;
+  uint16_t last_track;
+  uint32_t last_note;
+  uint64_t last_tick;
+} posting_list_t;
+
+typedef struct indexed_song_s {
+  //  NULL once the song is removed
+  char *name;
+  uint32_t num_postings;
+  //  Set while a library node holds the id, see attach_song(). Only
+  //  attached songs are returned by queries
+  bool attached;
+  //  Of the file the song was indexed from, so an index read back is not
+  //  reused for a file that changed since. 0 if it could not be read
+  uint64_t file_size;
+  int64_t file_mtime;
+} indexed_song_t;
+
+typedef struct melody_index_s {
+  //  Open addressing by key, empty slots have no bytes
+  uint32_t num_lists;
+  uint32_t capacity;
+  posting_list_t *lists;
+
+  //  Indexed by song id, starting from 1. Ids are never reused
+  uint32_t num_songs;
+  uint32_t songs_capacity;
+  indexed_song_t *songs;
+  //  Open addressing of song ids by name, 0 for empty slots
+  uint32_t names_capacity;
+  uint32_t *names;
+
+  //  Postings of removed songs are dropped once they outnumber the others
+  uint64_t live_postings;
+  uint64_t dead_postings;
+} melody_index_t;
+
+typedef struct melody_position_s {
+  uint16_t track;
+  //  Tick of the first matching n-gram
+  uint64_t tick;
+} melody_position_t;
+
+typedef struct melody_match_s {
+  const char *song_name;
+  //  Query n-grams matching in order at the best positions
+  uint32_t score;
+  uint32_t num_positions;
+  melody_position_t *positions;
+} melody_match_t;
+
+typedef struct melody_results_s {
+  //  By decreasing score
+  uint32_t num_matches;
+  melody_match_t *matches;
+} melody_results_t;
+
+//  Index
+melody_index_t *create_melody_index();
+void free_melody_index(melody_index_t *);
+uint32_t index_song(melody_index_t *, const char *, song_data_t *);
+uint32_t attach_song(melody_index_t *, const char *, const char *);
+void remove_indexed_song(melody_index_t *, uint32_t);
+
+//  Melody of a track, the highest Note On of each tick outside the drum
+//  channel. Returns the number of notes, storing them if pitches is set
+uint32_t track_melody(track_t *, uint8_t *, uint64_t *);
+
+//  Search. The query needs at least NGRAM_NOTES pitches
+melody_results_t *query_melody(melody_index_t *, uint8_t *, uint32_t);
+void free_melody_results(melody_results_t *);
+
+//  Persistence
+int write_melody_index(melody_index_t *, const char *);
+melody_index_t *read_melody_index(const char *);
+
+#endif // _MELODY_INDEX_H
@@ -0,0 +1,228 @@
+/* Name, memory_usage.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "memory_usage.h"
+#include "timeline.h"
+#include "tempo_map.h"
+#include "density.h"
+
+#include <assert.h>
+#include <string.h>
+
+//  Every field of memory_usage_t is a uint64_t
+#define USAGE_FIELDS (sizeof(memory_usage_t) / sizeof(uint64_t))
+
+/*
+ * adds every field of from to usage
+ */
+
+void add_usage(memory_usage_t *usage, const memory_usage_t *from) {
+  uint64_t *fields = (uint64_t *) usage;
+  const uint64_t *from_fields = (const uint64_t *) from;
+  for (int i = 0; i < USAGE_FIELDS; i++) {
+    fields[i] += from_fields[i];
+  }
+} /* add_usage() */
+
+/*
+ * subtracts every field of from from usage
+ */
+
+void subtract_usage(memory_usage_t *usage, const memory_usage_t *from) {
+  uint64_t *fields = (uint64_t *) usage;
+  const uint64_t *from_fields = (const uint64_t *) from;
+  for (int i = 0; i < USAGE_FIELDS; i++) {
+    assert(fields[i] >= from_fields[i]);
+    fields[i] -= from_fields[i];
+  }
+} /* subtract_usage() */
+
+/*
+ * returns the bytes of every kind together
+ */
+
+uint64_t usage_total(const memory_usage_t *usage) {
+  const uint64_t *fields = (const uint64_t *) usage;
+  uint64_t total = 0;
+  for (int i = 0; i < USAGE_FIELDS; i++) {
+    total += fields[i];
+  }
+  return total;
+} /* usage_total() */
+
+/*
+ * atomically adds every field of from to the owner
+ */
+
+void add_owner_usage(memory_usage_t *owner, const memory_usage_t *from) {
+  uint64_t *fields = (uint64_t *) owner;
+  const uint64_t *from_fields = (const uint64_t *) from;
+  for (int i = 0; i < USAGE_FIELDS; i++) {
+    if (from_fields[i]) {
+      __atomic_fetch_add(&fields[i], from_fields[i], __ATOMIC_RELAXED);
+    }
+  }
+} /* add_owner_usage() */
+
+/*
+ * atomically subtracts every field of from from the owner
+ */
+
+void subtract_owner_usage(memory_usage_t *owner,
+    const memory_usage_t *from) {
+  uint64_t *fields = (uint64_t *) owner;
+  const uint64_t *from_fields = (const uint64_t *) from;
+  for (int i = 0; i < USAGE_FIELDS; i++) {
+    if (from_fields[i]) {
+      __atomic_fetch_sub(&fields[i], from_fields[i], __ATOMIC_RELAXED);
+    }
+  }
+} /* subtract_owner_usage() */
+
+/*
+ * returns a copy of the owner, each field read atomically
+ */
+
+memory_usage_t read_owner_usage(memory_usage_t *owner) {
+  memory_usage_t usage = {0};
+  uint64_t *fields = (uint64_t *) owner;
+  uint64_t *copy = (uint64_t *) &usage;
+  for (int i = 0; i < USAGE_FIELDS; i++) {
+    copy[i] = __atomic_load_n(&fields[i], __ATOMIC_RELAXED);
+  }
+  return usage;
+} /* read_owner_usage() */
+
+/*
+ * starts the usage of a new track holding no events
+ */
+
+void init_track_memory(track_t *track) {
+  memset(&track->memory, 0, sizeof(memory_usage_t));
+  track->memory.tracks = sizeof(track_t);
+} /* init_track_memory() */
+
+/*
+ * adds an event appended to the track to its usage, with its node and data
+ */
+
+void account_event(track_t *track, event_t *event) {
+  uint32_t data_len = 0;
+  event_data(event, &data_len);
+  track->memory.event_nodes += sizeof(event_node_t);
+  track->memory.events += sizeof(event_t);
+  track->memory.payloads += data_len;
+} /* account_event() */
+
+/*
+ * starts the usage of a new song holding no tracks, its path already set
+ */
+
+void init_song_memory(song_data_t *song) {
+  memset(&song->memory, 0, sizeof(memory_usage_t));
+  song->memory.songs = sizeof(song_data_t);
+  if (song->path) {
+    song->memory.songs += strlen(song->path) + 1;
+  }
+  song->memory_owner = NULL;
+} /* init_song_memory() */
+
+/*
+ * adds a track linked into the song, with its node, to the song's usage
+ */
+
+void attach_track_memory(song_data_t *song, track_t *track) {
+  memory_usage_t added = track->memory;
+  added.tracks += sizeof(track_node_t);
+  added.caches += tick_index_size(track->tick_index);
+  add_usage(&song->memory, &added);
+  if (song->memory_owner) {
+    add_owner_usage(song->memory_owner, &added);
+  }
+} /* attach_track_memory() */
+
+/*
+ * removes a track unlinked from the song from the song's usage
+ */
+
+void detach_track_memory(song_data_t *song, track_t *track) {
+  memory_usage_t removed = track->memory;
+  removed.tracks += sizeof(track_node_t);
+  removed.caches += tick_index_size(track->tick_index);
+  subtract_usage(&song->memory, &removed);
+  if (song->memory_owner) {
+    subtract_owner_usage(song->memory_owner, &removed);
+  }
+} /* detach_track_memory() */
+
+/*
+ * makes owner hold the usage of the song, and every later change to it
+ */
+
+void adopt_song_memory(song_data_t *song, memory_usage_t *owner) {
+  assert(song->memory_owner == NULL);
+  song->memory_owner = owner;
+  add_owner_usage(owner, &song->memory);
+} /* adopt_song_memory() */
+
+/*
+ * takes the usage of the song back from its owner, if it has one
+ */
+
+void release_song_memory(song_data_t *song) {
+  if (song->memory_owner) {
+    subtract_owner_usage(song->memory_owner, &song->memory);
+    song->memory_owner = NULL;
+  }
+} /* release_song_memory() */
+
+/*
+ * brings the song's usage of its caches up to date after one of them was
+ * built or dropped: the tick indexes of its tracks, its tempo map, its note
+ * table and its density cache
+ */
+
+void account_song_caches(song_data_t *song) {
+  uint64_t bytes = tempo_map_size(song->tempo_map) +
+    note_table_size(song->note_table) + density_cache_size(song->density);
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    bytes += tick_index_size(track_list->track->tick_index);
+    track_list = track_list->next_track;
+  }
+  memory_usage_t change = {0};
+  if (bytes >= song->memory.caches) {
+    change.caches = bytes - song->memory.caches;
+    add_usage(&song->memory, &change);
+    if (song->memory_owner) {
+      add_owner_usage(song->memory_owner, &change);
+    }
+  }
+  else {
+    change.caches = song->memory.caches - bytes;
+    subtract_usage(&song->memory, &change);
+    if (song->memory_owner) {
+      subtract_owner_usage(song->memory_owner, &change);
+    }
+  }
+} /* account_song_caches() */
+
+/*
+ * prints the usage by kind of structure
+ */
+
+void print_memory_usage(FILE *file, const memory_usage_t *usage) {
+  fprintf(file, "  songs:       %12lu bytes\n", usage->songs);
+  fprintf(file, "  tracks:      %12lu bytes\n", usage->tracks);
+  fprintf(file, "  event nodes: %12lu bytes\n", usage->event_nodes);
+  fprintf(file, "  events:      %12lu bytes\n", usage->events);
+  fprintf(file, "  payloads:    %12lu bytes\n", usage->payloads);
+  fprintf(file, "  pooled:      %12lu bytes\n", usage->pooled);
+  fprintf(file, "  caches:      %12lu bytes\n", usage->caches);
+  fprintf(file, "  tree nodes:  %12lu bytes\n", usage->tree_nodes);
+  fprintf(file, "  packed:      %12lu bytes\n", usage->packed);
+  fprintf(file, "  total:       %12lu bytes\n", usage_total(usage));
+} /* print_memory_usage() */
@@ -0,0 +1,38 @@
+#ifndef _MEMORY_USAGE_H
+#define _MEMORY_USAGE_H
+
+#include "parser.h"
+
+//  Usages are kept up to date as tracks are built and attached to songs, so
+//  reading one never walks the events. Songs in the library forward their
+//  changes to g_library_memory, see library.h
+
+//  Arithmetic
+void add_usage(memory_usage_t *, const memory_usage_t *);
+void subtract_usage(memory_usage_t *, const memory_usage_t *);
+uint64_t usage_total(const memory_usage_t *);
+
+//  Owners may be updated by several threads at once
+void add_owner_usage(memory_usage_t *, const memory_usage_t *);
+void subtract_owner_usage(memory_usage_t *, const memory_usage_t *);
+memory_usage_t read_owner_usage(memory_usage_t *);
+
+//  Track level
+void init_track_memory(track_t *);
+void account_event(track_t *, event_t *);
+
+//  Song level
+void init_song_memory(song_data_t *);
+void attach_track_memory(song_data_t *, track_t *);
+void detach_track_memory(song_data_t *, track_t *);
+void adopt_song_memory(song_data_t *, memory_usage_t *);
+void release_song_memory(song_data_t *);
+
+//  Caches built on demand are counted again, in O(tracks), whenever one of
+//  them is built or dropped
+void account_song_caches(song_data_t *);
+
+//  Reports
+void print_memory_usage(FILE *, const memory_usage_t *);
+
+#endif // _MEMORY_USAGE_H
@@ -0,0 +1,385 @@
+/* Name, note_table.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "note_table.h"
+#include "timeline.h"
+#include "density.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_NOTE (UINT32_MAX)
+#define KIND_MASK (0xF0)
+#define CHANNEL_MASK (0x0F)
+
+//  Sort key used to order the notes of a tree node by end
+typedef struct note_key_s {
+  uint64_t end;
+  uint32_t position;
+} note_key_t;
+
+bool is_note_on(event_t *event);
+int compare_note_keys(const void *key_1, const void *key_2);
+int32_t build_note_tree(note_table_t *table, uint32_t *positions,
+    uint32_t count, uint32_t *scratch, note_key_t *keys, uint32_t *filled);
+uint32_t query_note_tree(note_table_t *table, int32_t node, uint64_t start,
+    uint64_t end, note_func_t function, void *data);
+
+/*
+ * returns true if the event starts a note
+ */
+
+bool is_note_on(event_t *event) {
+  return (event_type(event) == MIDI_EVENT_T) &&
+    ((event->midi_event.status & KIND_MASK) == NOTE_ON) &&
+    (event->midi_event.data_len >= 2) && (event->midi_event.data[1]);
+} /* is_note_on() */
+
+/*
+ * orders note keys by decreasing end
+ */
+
+int compare_note_keys(const void *key_1, const void *key_2) {
+  uint64_t end_1 = ((const note_key_t *) key_1)->end;
+  uint64_t end_2 = ((const note_key_t *) key_2)->end;
+  return (end_1 < end_2) - (end_1 > end_2);
+} /* compare_note_keys() */
+
+/*
+ * pairs the Note On and Note Off events of the song into note intervals and
+ * indexes them by time. A Note Off ends the earliest unfinished note of its
+ * channel and pitch, and notes still sounding at the end of the song end
+ * there. Every note lasts at least one tick
+ */
+
+note_table_t *build_note_table(song_data_t *song) {
+  assert(song);
+  note_table_t *table = malloc(sizeof(note_table_t));
+  assert(table);
+  memset(table, 0, sizeof(note_table_t));
+
+  uint32_t capacity = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    event_node_t *event_list = track_list->track->event_list;
+    while (event_list) {
+      capacity += is_note_on(event_list->event);
+      event_list = event_list->next_event;
+    }
+    track_list = track_list->next_track;
+  }
+  uint32_t size = capacity ? capacity : 1;
+  table->notes = malloc(sizeof(note_interval_t) * size);
+  assert(table->notes);
+  uint32_t *next_pending = malloc(sizeof(uint32_t) * size);
+  assert(next_pending);
+  uint32_t first_pending[NUM_CHANNELS * NUM_PITCHES];
+  uint32_t last_pending[NUM_CHANNELS * NUM_PITCHES];
+  for (int i = 0; i < NUM_CHANNELS * NUM_PITCHES; i++) {
+    first_pending[i] = NO_NOTE;
+    last_pending[i] = NO_NOTE;
+  }
+  uint8_t programs[NUM_CHANNELS] = {0};
+
+  timeline_t *timeline = open_timeline(song, 0);
+  timeline_event_t next = {0};
+  while (timeline_next(timeline, &next)) {
+    table->last_tick = next.tick;
+    event_t *event = next.event;
+    if ((event_type(event) != MIDI_EVENT_T) ||
+        (event->midi_event.status >= SYS_EVENT_1)) {
+      continue;
+    }
+    uint8_t kind = event->midi_event.status & KIND_MASK;
+    uint8_t channel = event->midi_event.status & CHANNEL_MASK;
+    uint8_t *data = event->midi_event.data;
+    if (kind == PROGRAM_CHANGE) {
+      programs[channel] = data[0];
+    }
+    else if (is_note_on(event)) {
+      uint32_t key = channel * NUM_PITCHES + (data[0] & (NUM_PITCHES - 1));
+      uint32_t position = table->num_notes++;
+      table->notes[position] = (note_interval_t) {
+        next.tick, UINT64_MAX, data[0], data[1], channel, programs[channel],
+        next.track
+      };
+      next_pending[position] = NO_NOTE;
+      if (last_pending[key] == NO_NOTE) {
+        first_pending[key] = position;
+      }
+      else {
+        next_pending[last_pending[key]] = position;
+      }
+      last_pending[key] = position;
+    }
+    else if (((kind == NOTE_OFF) || (kind == NOTE_ON)) &&
+        (event->midi_event.data_len >= 1)) {
+      uint32_t key = channel * NUM_PITCHES + (data[0] & (NUM_PITCHES - 1));
+      uint32_t position = first_pending[key];
+      if (position != NO_NOTE) {
+        table->notes[position].end = next.tick;
+        first_pending[key] = next_pending[position];
+        if (first_pending[key] == NO_NOTE) {
+          last_pending[key] = NO_NOTE;
+        }
+      }
+    }
+  }
+  close_timeline(timeline);
+  timeline = NULL;
+  free(next_pending);
+  next_pending = NULL;
+
+  table->lowest_pitch = table->num_notes ? NUM_PITCHES - 1 : 0;
+  for (uint32_t i = 0; i < table->num_notes; i++) {
+    note_interval_t *note = &table->notes[i];
+    if (note->end == UINT64_MAX) {
+      note->end = table->last_tick;
+    }
+    if (note->end <= note->start) {
+      note->end = note->start + 1;
+    }
+    if (note->pitch < table->lowest_pitch) {
+      table->lowest_pitch = note->pitch;
+    }
+    if (note->pitch > table->highest_pitch) {
+      table->highest_pitch = note->pitch;
+    }
+    if (note->end - note->start > table->longest_note) {
+      table->longest_note = note->end - note->start;
+    }
+  }
+
+  table->nodes = malloc(sizeof(note_node_t) * size);
+  assert(table->nodes);
+  table->by_start = malloc(sizeof(uint32_t) * size);
+  assert(table->by_start);
+  table->by_end = malloc(sizeof(uint32_t) * size);
+  assert(table->by_end);
+  uint32_t *positions = malloc(sizeof(uint32_t) * size);
+  assert(positions);
+  uint32_t *scratch = malloc(sizeof(uint32_t) * size);
+  assert(scratch);
+  note_key_t *keys = malloc(sizeof(note_key_t) * size);
+  assert(keys);
+  for (uint32_t i = 0; i < table->num_notes; i++) {
+    positions[i] = i;
+  }
+  uint32_t filled = 0;
+  build_note_tree(table, positions, table->num_notes, scratch, keys,
+      &filled);
+  free(positions);
+  positions = NULL;
+  free(scratch);
+  scratch = NULL;
+  free(keys);
+  keys = NULL;
+  return table;
+} /* build_note_table() */
+
+/*
+ * builds the subtree holding the notes at the given positions, which are in
+ * order of start, and returns its root. The notes containing the median
+ * start are kept at the root, those ending before it go left and those
+ * starting after it go right, so every level halves the notes
+ */
+
+int32_t build_note_tree(note_table_t *table, uint32_t *positions,
+    uint32_t count, uint32_t *scratch, note_key_t *keys, uint32_t *filled) {
+  if (count == 0) {
+    return NO_NODE;
+  }
+  note_interval_t *notes = table->notes;
+  int32_t node = table->num_nodes++;
+  uint64_t center = notes[positions[count / 2]].start;
+  uint32_t first = *filled;
+  uint32_t num_middle = 0;
+  uint32_t num_left = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    note_interval_t *note = &notes[positions[i]];
+    if (note->end <= center) {
+      scratch[num_left++] = positions[i];
+    }
+    else if (note->start <= center) {
+      table->by_start[first + num_middle] = positions[i];
+      keys[num_middle].end = note->end;
+      keys[num_middle].position = positions[i];
+      num_middle++;
+    }
+  }
+  uint32_t num_right = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (notes[positions[i]].start > center) {
+      scratch[num_left + num_right++] = positions[i];
+    }
+  }
+  qsort(keys, num_middle, sizeof(note_key_t), compare_note_keys);
+  for (uint32_t i = 0; i < num_middle; i++) {
+    table->by_end[first + i] = keys[i].position;
+  }
+  table->nodes[node].center = center;
+  table->nodes[node].first = first;
+  table->nodes[node].count = num_middle;
+  *filled += num_middle;
+
+  memcpy(positions, scratch, sizeof(uint32_t) * (num_left + num_right));
+  int32_t left = build_note_tree(table, positions, num_left, scratch, keys,
+      filled);
+  int32_t right = build_note_tree(table, positions + num_left, num_right,
+      scratch, keys, filled);
+  table->nodes[node].left = left;
+  table->nodes[node].right = right;
+  return node;
+} /* build_note_tree() */
+
+/*
+ * returns the note table of the song, building it if needed
+ */
+
+note_table_t *song_note_table(song_data_t *song) {
+  assert(song);
+  if (song->note_table == NULL) {
+    song->note_table = build_note_table(song);
+    account_song_caches(song);
+  }
+  return song->note_table;
+} /* song_note_table() */
+
+/*
+ * drops the note table of the song after its events changed. It is rebuilt
+ * on the next call to song_note_table()
+ */
+
+void invalidate_note_table(song_data_t *song) {
+  invalidate_notes_from(song, 0);
+} /* invalidate_note_table() */
+
+/*
+ * drops the note table of the song after events from the given tick on
+ * changed, and marks the density cache out of date from there
+ */
+
+void invalidate_notes_from(song_data_t *song, uint64_t tick) {
+  invalidate_notes_between(song, tick, UINT64_MAX);
+} /* invalidate_notes_from() */
+
+/*
+ * drops the note table of the song after events from tick first to tick
+ * last changed, and marks the density cache out of date around them
+ */
+
+void invalidate_notes_between(song_data_t *song, uint64_t first,
+    uint64_t last) {
+  if (song->note_table) {
+    if ((song->density) && (song->density->filled == song->note_table)) {
+      //  The density cache compares its next refill against it
+      song->density->owns_filled = true;
+    }
+    else {
+      free_note_table(song->note_table);
+    }
+    song->note_table = NULL;
+  }
+  if (song->density) {
+    invalidate_density(song->density, first, last);
+  }
+  account_song_caches(song);
+} /* invalidate_notes_between() */
+
+/*
+ * frees the note table
+ */
+
+void free_note_table(note_table_t *table) {
+  free(table->notes);
+  table->notes = NULL;
+  free(table->nodes);
+  table->nodes = NULL;
+  free(table->by_start);
+  table->by_start = NULL;
+  free(table->by_end);
+  table->by_end = NULL;
+  free(table);
+  table = NULL;
+} /* free_note_table() */
+
+/*
+ * returns the number of bytes held by a note table, 0 if there is none
+ */
+
+uint64_t note_table_size(note_table_t *table) {
+  if (table == NULL) {
+    return 0;
+  }
+  uint32_t size = table->num_notes ? table->num_notes : 1;
+  return sizeof(note_table_t) + (uint64_t) size * (sizeof(note_interval_t) +
+    sizeof(note_node_t) + sizeof(uint32_t) * 2);
+} /* note_table_size() */
+
+/*
+ * reports the notes of the subtree overlapping [start, end). Only one child
+ * is visited unless center is inside the range, in which case every note of
+ * the node is reported
+ */
+
+uint32_t query_note_tree(note_table_t *table, int32_t node, uint64_t start,
+    uint64_t end, note_func_t function, void *data) {
+  note_interval_t *notes = table->notes;
+  uint32_t found = 0;
+  while (node != NO_NODE) {
+    note_node_t *current = &table->nodes[node];
+    uint32_t last = current->first + current->count;
+    if (end <= current->center) {
+      for (uint32_t i = current->first; (i < last) &&
+          (notes[table->by_start[i]].start < end); i++) {
+        if (function) {
+          function(&notes[table->by_start[i]], data);
+        }
+        found++;
+      }
+      node = current->left;
+    }
+    else if (start > current->center) {
+      for (uint32_t i = current->first; (i < last) &&
+          (notes[table->by_end[i]].end > start); i++) {
+        if (function) {
+          function(&notes[table->by_end[i]], data);
+        }
+        found++;
+      }
+      node = current->right;
+    }
+    else {
+      for (uint32_t i = current->first; i < last; i++) {
+        if (function) {
+          function(&notes[table->by_start[i]], data);
+        }
+        found++;
+      }
+      found += query_note_tree(table, current->left, start, end, function,
+          data);
+      node = current->right;
+    }
+  }
+  return found;
+} /* query_note_tree() */
+
+/*
+ * calls the function, if any, on every note sounding in [start, end) and
+ * returns how many there are
+ */
+
+uint32_t notes_in_range(note_table_t *table, uint64_t start, uint64_t end,
+    note_func_t function, void *data) {
+  assert(table);
+  if ((start >= end) || (table->num_nodes == 0)) {
+    return 0;
+  }
+  return query_note_tree(table, 0, start, end, function, data);
+} /* notes_in_range() */
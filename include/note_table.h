@@ -0,0 +1,68 @@
+#ifndef _NOTE_TABLE_H
+#define _NOTE_TABLE_H
+
+#include "parser.h"
+
+#define NOTE_OFF (0x80)
+#define NOTE_ON (0x90)
+#define PROGRAM_CHANGE (0xC0)
+#define NUM_CHANNELS (16)
+#define NUM_PITCHES (128)
+#define NO_NODE (-1)
+
+//  One sounding note, from its Note On to its Note Off, in absolute ticks
+typedef struct note_interval_s {
+  uint64_t start;
+  uint64_t end;
+  uint8_t pitch;
+  uint8_t velocity;
+  uint8_t channel;
+  //  Program of the channel when the note started
+  uint8_t program;
+  uint16_t track;
+} note_interval_t;
+
+//  Node of a centered interval tree. Its notes all contain center and are
+//  stored at [first, first + count) of both by_start and by_end
+typedef struct note_node_s {
+  uint64_t center;
+  uint32_t first;
+  uint32_t count;
+  int32_t left;
+  int32_t right;
+} note_node_t;
+
+typedef struct note_table_s {
+  //  Sorted by start
+  uint32_t num_notes;
+  note_interval_t *notes;
+
+  //  Interval tree, rooted at nodes[0] if there are any notes
+  uint32_t num_nodes;
+  note_node_t *nodes;
+  //  Positions in notes, by increasing start and by decreasing end
+  uint32_t *by_start;
+  uint32_t *by_end;
+
+  uint8_t lowest_pitch;
+  uint8_t highest_pitch;
+  uint64_t last_tick;
+  uint64_t longest_note;
+} note_table_t;
+
+typedef void (*note_func_t)(note_interval_t *, void *);
+
+note_table_t *build_note_table(song_data_t *);
+note_table_t *song_note_table(song_data_t *);
+void invalidate_note_table(song_data_t *);
+void invalidate_notes_from(song_data_t *, uint64_t);
+void invalidate_notes_between(song_data_t *, uint64_t, uint64_t);
+void free_note_table(note_table_t *);
+uint64_t note_table_size(note_table_t *);
+
+//  Calls the function, if any, on every note sounding in [start, end) and
+//  returns how many there are, in O(log n + k)
+uint32_t notes_in_range(note_table_t *, uint64_t, uint64_t, note_func_t,
+    void *);
+
+#endif // _NOTE_TABLE_H
@@ -5,6 +5,13 @@
 /* Add any includes here */
 
 #include "parser.h"
+#include "timeline.h"
+#include "tempo_map.h"
+#include "note_table.h"
+#include "density.h"
+#include "payload_pool.h"
+#include "stats.h"
+#include "memory_usage.h"
 
 #include <malloc.h>
 #include <string.h>
@@ -13,8 +20,13 @@
 #define MTHD "MThd"
 #define MTRK "MTrk"
 #define HEADER_LENGTH (0x06000000)
+#define CHANNEL_MASK (0x0F)
+#define STATUS_BIT (0x80)
+//  Set in the division of the header if it is in SMPTE frames
+#define SMPTE_DIVISION_BIT (0x8000)
 
-uint8_t g_last_status = 0;
+//  Per thread, so songs can be parsed in parallel, see load_pipeline.h
+__thread uint8_t g_last_status = 0;
 
 /*
  * Parses the given midi file
@@ -24,22 +36,65 @@ song_data_t *parse_file(const char *midi_file_name) {
   assert(midi_file_name != NULL);
   FILE *file = fopen(midi_file_name, "r");
   assert(file != NULL);
+  song_data_t *song_data = parse_stream(file, midi_file_name);
+  fclose(file);
+  file = NULL;
+  if (g_density_on_load) {
+    start_density_cache(song_data);
+  }
+  return song_data;
+} /* parse_file() */
+
+/*
+ * Parses a midi file already read into memory, named midi_file_name
+ */
+
+song_data_t *parse_buffer(const char *midi_file_name, uint8_t *data,
+    size_t size) {
+  assert(midi_file_name != NULL);
+  assert((data != NULL) && (size > 0));
+  FILE *file = fmemopen(data, size, "r");
+  assert(file != NULL);
+  song_data_t *song_data = parse_stream(file, midi_file_name);
+  fclose(file);
+  file = NULL;
+  return song_data;
+} /* parse_buffer() */
+
+/*
+ * Parses a whole midi file from the stream
+ */
+
+song_data_t *parse_stream(FILE *file, const char *midi_file_name) {
+  STAT_START(start);
   song_data_t *song_data = malloc(sizeof(song_data_t));
   assert(song_data);
+  STAT_ALLOC(sizeof(song_data_t));
   song_data->track_list = NULL;
   song_data->path = malloc((strlen(midi_file_name) + 1) * sizeof(char));
   assert(song_data->path);
+  STAT_ALLOC(strlen(midi_file_name) + 1);
   strcpy(song_data->path, midi_file_name);
   song_data->track_list = NULL;
+  song_data->tempo_map = NULL;
+  song_data->note_table = NULL;
+  song_data->density = NULL;
+  init_song_memory(song_data);
+  STAT_START(header_start);
   parse_header(file, song_data);
+  STAT_STOP(TIMER_PARSE_HEADER, header_start);
   for (int i = 0; i < song_data->num_tracks; i++) {
+    STAT_START(track_start);
     parse_track(file, song_data);
+    STAT_STOP(TIMER_PARSE_TRACK, track_start);
   }
+  STAT_ADD(STAT_TRACKS_PARSED, song_data->num_tracks);
+  STAT_ADD(STAT_BYTES_READ, ftell(file));
   assert(getc(file) == EOF);
-  fclose(file);
-  file = NULL;
+  STAT_ADD(STAT_SONGS_PARSED, 1);
+  STAT_STOP(TIMER_PARSE_FILE, start);
   return song_data;
-} /* parse_file() */
+} /* parse_stream() */
 
 /*
  * Parses the header of the file into the given song_data_t
@@ -82,16 +137,37 @@ void parse_header(FILE *file, song_data_t *song_data) {
     return;
   }
   division = (division >> 8) | (division << 8);
-  song_data->division.uses_tpq = !(division & (1 << 8) >> 8);
-  if (song_data->division.uses_tpq) {
-    song_data->division.ticks_per_qtr = division;
+  decode_division(&song_data->division, division);
+
+} /* parse_header() */
+
+/*
+ * fills in the division from its value in the header
+ */
+
+void decode_division(division_t *song_division, uint16_t division) {
+  song_division->uses_tpq = !(division & SMPTE_DIVISION_BIT);
+  if (song_division->uses_tpq) {
+    song_division->ticks_per_qtr = division;
   }
   else {
-    song_data->division.frames_per_sec = ((1 << 7) - 1) & (division >> 8);
-    song_data->division.ticks_per_frame = ((1 << 8) - 1) & (division >> 0);
+    song_division->frames_per_sec = ((1 << 7) - 1) & (division >> 8);
+    song_division->ticks_per_frame = ((1 << 8) - 1) & (division >> 0);
   }
+} /* decode_division() */
 
-} /* parse_header() */
+/*
+ * returns the value of the division in the header, the inverse of
+ * decode_division()
+ */
+
+uint16_t encode_division(const division_t *song_division) {
+  if (song_division->uses_tpq) {
+    return song_division->ticks_per_qtr & ~SMPTE_DIVISION_BIT;
+  }
+  return SMPTE_DIVISION_BIT | (song_division->frames_per_sec << 8) |
+    song_division->ticks_per_frame;
+} /* encode_division() */
 
 /*
  * parses tracks from a given file
@@ -109,6 +185,7 @@ void parse_track(FILE *file, song_data_t *song_data) {
   assert(track_node);
   track_t *track = malloc(sizeof(track_t));
   assert(track);
+  STAT_ALLOC(sizeof(track_node_t) + sizeof(track_t));
   uint32_t length = 0x00;
   fread_return = fread(&length, sizeof(uint32_t), 1, file);
   if (fread_return != 1) {
@@ -119,12 +196,19 @@ void parse_track(FILE *file, song_data_t *song_data) {
   length = len;
   assert(length > 0);
   track->length = length;
+  track->ref_count = 1;
+  track->block = NULL;
+  track->tick_index = NULL;
+  track->shared_data = NULL;
+  init_track_memory(track);
   track->event_list = malloc(sizeof(event_node_t));
   assert(track->event_list);
+  STAT_ALLOC(sizeof(event_node_t));
   track->event_list->event = NULL;
   int end_position = ftell(file) + length;
   track->event_list->event = parse_event(file);
   track->event_list->next_event = NULL;
+  account_event(track, track->event_list->event);
   while (ftell(file) < end_position) {
     event_node_t *list = track->event_list;
     while (list->next_event != NULL) {
@@ -132,12 +216,15 @@ void parse_track(FILE *file, song_data_t *song_data) {
     }
     list->next_event = malloc(sizeof(event_node_t));
     assert(list->next_event);
+    STAT_ALLOC(sizeof(event_node_t));
     list->next_event->event = parse_event(file);
     list->next_event->next_event = NULL;
+    account_event(track, list->next_event->event);
     counter++;
   }
   track_node->next_track = NULL;
   track_node->track = track;
+  attach_track_memory(song_data, track);
   if (song_data->track_list == NULL) {
     song_data->track_list = track_node;
     return;
@@ -154,8 +241,10 @@ void parse_track(FILE *file, song_data_t *song_data) {
  */
 
 event_t *parse_event(FILE *file) {
+  STAT_START(start);
   event_t *event = malloc(sizeof(event_t));
   assert(event);
+  STAT_ALLOC(sizeof(event_t));
   event->delta_time = parse_var_len(file);
   int fread_return = fread(&(event->type), sizeof(uint8_t), 1, file);
   if (fread_return != 1) {
@@ -163,12 +252,18 @@ event_t *parse_event(FILE *file) {
   }
   if (event->type == META_EVENT) {
     event->meta_event = parse_meta_event(file);
+    STAT_ADD(STAT_META_EVENTS, 1);
+    STAT_STOP(TIMER_PARSE_META, start);
   }
   else if ((event->type == SYS_EVENT_1) || (event->type == SYS_EVENT_2)) {
     event->sys_event = parse_sys_event(file, event->type);
+    STAT_ADD(STAT_SYS_EVENTS, 1);
+    STAT_STOP(TIMER_PARSE_SYS, start);
   }
   else {
     event->midi_event = parse_midi_event(file, event->type);
+    STAT_ADD(STAT_MIDI_EVENTS, 1);
+    STAT_STOP(TIMER_PARSE_MIDI, start);
   }
   return event;
 } /* parse_event() */
@@ -183,11 +278,13 @@ sys_event_t parse_sys_event(FILE *file, uint8_t type) {
   if (event.data_len) {
     event.data = malloc(event.data_len);
     assert(event.data);
+    STAT_ALLOC(event.data_len);
     int fread_return = fread(event.data, sizeof(uint8_t), event.data_len
         / sizeof(uint8_t), file);
     if (fread_return != (event.data_len / sizeof(uint8_t))) {
       return event;
     }
+    event.data = pool_payload(event.data, event.data_len);
   }
   return event;
 } /* parse_sys_event() */
@@ -216,13 +313,29 @@ meta_event_t parse_meta_event(FILE *file) {
   if (event.data_len) {
     event.data = malloc(event.data_len);
     assert(event.data);
+    STAT_ALLOC(event.data_len);
     fread_return = fread(event.data, sizeof(uint8_t), event.data_len /
         sizeof(uint8_t), file);
     assert(fread_return == event.data_len / sizeof(uint8_t));
+    event.data = pool_payload(event.data, event.data_len);
   }
   return event;
 } /* parse_meta_event() */
 
+/*
+ * swaps a freshly read payload for its copy in g_payload_pool, if it is set
+ */
+
+uint8_t *pool_payload(uint8_t *data, uint32_t data_len) {
+  if (g_payload_pool == NULL) {
+    return data;
+  }
+  uint8_t *pooled = intern_payload(g_payload_pool, data, data_len);
+  free(data);
+  data = NULL;
+  return pooled;
+} /* pool_payload() */
+
 /*
  * parses the midi event
  */
@@ -243,6 +356,7 @@ midi_event_t parse_midi_event(FILE *file, uint8_t status) {
   if (event.data_len) {
     event.data = malloc(event.data_len);
     assert(event.data);
+    STAT_ALLOC(event.data_len);
     int fread_return = fread(event.data, sizeof(uint8_t), event.data_len /
                        sizeof(uint8_t), file);
     assert(fread_return == event.data_len / sizeof(uint8_t));
@@ -288,6 +402,7 @@ uint8_t event_type(event_t *event) {
 
 void free_song(song_data_t *song_data) {
   int counter = 0;
+  release_song_memory(song_data);
   while (song_data->track_list) {
     counter++;
     track_node_t *track_node = song_data->track_list;
@@ -296,6 +411,12 @@ void free_song(song_data_t *song_data) {
   }
   free(song_data->track_list);
   song_data->track_list = NULL;
+  invalidate_tempo_map(song_data);
+  invalidate_note_table(song_data);
+  if (song_data->density) {
+    free_density_cache(song_data->density);
+    song_data->density = NULL;
+  }
   free(song_data->path);
   song_data->path = NULL;
   free(song_data);
@@ -308,6 +429,24 @@ void free_song(song_data_t *song_data) {
 
 void free_track_node(track_node_t *node) {
   int counter = 0;
+  if (--node->track->ref_count > 0) {
+    //  Still used by another clone of the song
+    node->track = NULL;
+    free(node);
+    node = NULL;
+    return;
+  }
+  free_tick_index(node->track);
+  if (node->track->block) {
+    free(node->track->block);
+    node->track->block = NULL;
+    node->track->event_list = NULL;
+  }
+  if ((node->track->shared_data) &&
+      (--node->track->shared_data->ref_count == 0)) {
+    free(node->track->shared_data);
+  }
+  node->track->shared_data = NULL;
   while (node->track->event_list) {
     event_node_t *event_node = node->track->event_list;
     node->track->event_list = node->track->event_list->next_event;
@@ -328,13 +467,15 @@ void free_event_node(event_node_t *node) {
   uint8_t type = event_type(node->event);
   if (type == META_EVENT_T) {
     if (node->event->meta_event.data_len) {
-      free(node->event->meta_event.data);
+      drop_payload(node->event->meta_event.data,
+          node->event->meta_event.data_len);
       node->event->meta_event.data = NULL;
     }
   }
   else if (type == SYS_EVENT_T) {
     if (node->event->sys_event.data_len) {
-      free(node->event->sys_event.data);
+      drop_payload(node->event->sys_event.data,
+          node->event->sys_event.data_len);
       node->event->sys_event.data = NULL;
     }
   }
@@ -350,6 +491,145 @@ void free_event_node(event_node_t *node) {
   node = NULL;
 } /* free_event_node() */
 
+/*
+ * returns a clone of the song that shares its tracks with the original. A
+ * shared track is only copied once one of the songs writes to it, see
+ * own_track()
+ */
+
+song_data_t *clone_song(song_data_t *song) {
+  assert(song);
+  song_data_t *clone = malloc(sizeof(song_data_t));
+  assert(clone);
+  *clone = *song;
+  clone->path = NULL;
+  clone->tempo_map = NULL;
+  clone->note_table = NULL;
+  clone->density = NULL;
+  clone->memory_owner = NULL;
+  if (song->path) {
+    clone->path = malloc((strlen(song->path) + 1) * sizeof(char));
+    assert(clone->path);
+    strcpy(clone->path, song->path);
+  }
+  clone->track_list = NULL;
+  track_node_t **tail = &clone->track_list;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    track_node_t *track_node = malloc(sizeof(track_node_t));
+    assert(track_node);
+    track_node->track = track_list->track;
+    track_node->track->ref_count++;
+    track_node->next_track = NULL;
+    *tail = track_node;
+    tail = &track_node->next_track;
+    track_list = track_list->next_track;
+  }
+  account_song_caches(clone);
+  return clone;
+} /* clone_song() */
+
+/*
+ * makes sure the track of the node is not shared with another song, copying
+ * it if it is, and returns it. Must be called before writing to a track
+ */
+
+track_t *own_track(track_node_t *node) {
+  assert(node);
+  if (node->track->ref_count > 1) {
+    track_t *copy = clone_track(node->track, KEEP_CHANNELS);
+    node->track->ref_count--;
+    node->track = copy;
+  }
+  return node->track;
+} /* own_track() */
+
+/*
+ * returns an unshared deep copy of the track, moving its channel events to
+ * the given channel unless it is KEEP_CHANNELS. The nodes, events and data
+ * of the copy are allocated in a single block
+ */
+
+track_t *clone_track(track_t *track, int channel) {
+  assert(track);
+  assert((channel == KEEP_CHANNELS) || ((channel >= 0) &&
+        (channel <= CHANNEL_MASK)));
+  uint32_t num_events = 0;
+  uint32_t data_size = 0;
+  event_node_t *event_list = track->event_list;
+  while (event_list) {
+    uint32_t data_len = 0;
+    event_data(event_list->event, &data_len);
+    data_size += data_len;
+    num_events++;
+    event_list = event_list->next_event;
+  }
+
+  track_t *copy = malloc(sizeof(track_t));
+  assert(copy);
+  copy->length = track->length;
+  copy->ref_count = 1;
+  copy->event_list = NULL;
+  copy->block = NULL;
+  copy->tick_index = NULL;
+  copy->shared_data = NULL;
+  init_track_memory(copy);
+  if (num_events == 0) {
+    return copy;
+  }
+  copy->block = malloc(num_events * (sizeof(event_node_t) +
+        sizeof(event_t)) + data_size);
+  assert(copy->block);
+  event_node_t *nodes = copy->block;
+  event_t *events = (event_t *) (nodes + num_events);
+  uint8_t *data = (uint8_t *) (events + num_events);
+
+  event_list = track->event_list;
+  for (uint32_t i = 0; i < num_events; i++) {
+    events[i] = *event_list->event;
+    uint32_t data_len = 0;
+    uint8_t **source_data = event_data(event_list->event, &data_len);
+    if (data_len) {
+      memcpy(data, *source_data, data_len);
+      *event_data(&events[i], &data_len) = data;
+      data += data_len;
+    }
+    if ((channel != KEEP_CHANNELS) && (event_type(&events[i]) ==
+          MIDI_EVENT_T) && (events[i].midi_event.status < SYS_EVENT_1)) {
+      events[i].midi_event.status = (events[i].midi_event.status &
+          ~CHANNEL_MASK) | channel;
+      if (events[i].type & STATUS_BIT) {
+        events[i].type = events[i].midi_event.status;
+      }
+    }
+    nodes[i].event = &events[i];
+    nodes[i].next_event = (i + 1 < num_events) ? &nodes[i + 1] : NULL;
+    account_event(copy, &events[i]);
+    event_list = event_list->next_event;
+  }
+  copy->event_list = nodes;
+  return copy;
+} /* clone_track() */
+
+/*
+ * returns a pointer to the data pointer of the event and sets data_len to
+ * the length of its data
+ */
+
+uint8_t **event_data(event_t *event, uint32_t *data_len) {
+  uint8_t type = event_type(event);
+  if (type == META_EVENT_T) {
+    *data_len = event->meta_event.data_len;
+    return &event->meta_event.data;
+  }
+  else if (type == SYS_EVENT_T) {
+    *data_len = event->sys_event.data_len;
+    return &event->sys_event.data;
+  }
+  *data_len = event->midi_event.data_len;
+  return &event->midi_event.data;
+} /* event_data() */
+
 /*
  * swaps the endianness of a given 16 bit int
  */
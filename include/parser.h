@@ -12,6 +12,9 @@
 #define META_EVENT_T (2)
 #define MIDI_EVENT_T (3)
 
+//  Used by clone_track() to leave channels unchanged
+#define KEEP_CHANNELS (-1)
+
 //  Used for parsing
 #define SYS_EVENT_1 (0xF0)
 #define SYS_EVENT_2 (0xF7)
@@ -24,6 +27,30 @@ typedef struct event_s event_t;
 typedef struct track_node_s track_node_t;
 typedef struct event_node_s event_node_t;
 typedef struct song_data_s song_data_t;
+typedef struct shared_data_s shared_data_t;
+typedef struct memory_usage_s memory_usage_t;
+
+//  Bytes held by the structures of a track, song or library, see
+//  memory_usage.h. Shared tracks, caches and payloads count once for each
+//  user, except that library_memory() counts pooled payloads once
+typedef struct memory_usage_s {
+  //  song_data_t and path
+  uint64_t songs;
+  //  track_t and track_node_t
+  uint64_t tracks;
+  uint64_t event_nodes;
+  uint64_t events;
+  //  Data of the events
+  uint64_t payloads;
+  //  Library only, the payload pool with each distinct payload once
+  uint64_t pooled;
+  //  Tick indexes, tempo map, note table and density cache, as built on
+  //  demand, see account_song_caches()
+  uint64_t caches;
+  //  Library only, tree_node_t and the packed form of idle songs
+  uint64_t tree_nodes;
+  uint64_t packed;
+} memory_usage_t;
 
 //  MIDI Structures
 typedef struct division_s {
@@ -42,8 +69,26 @@ typedef struct division_s {
 typedef struct track_s {
   uint32_t length;
   event_node_t *event_list;
+  //  Number of songs sharing this track, see clone_song()
+  uint32_t ref_count;
+  //  If set, the nodes, events and data of the track were allocated together
+  //  in this block by clone_track() and are freed with it
+  void *block;
+  //  Absolute ticks of the events, see track_ticks() in timeline.h
+  struct tick_index_s *tick_index;
+  //  If set, the data of events without a channel is read-only and shared
+  //  with other tracks, see add_rounds() in alterations.h
+  shared_data_t *shared_data;
+  //  Kept up to date by whatever builds the track, see account_event()
+  memory_usage_t memory;
 } track_t;
 
+typedef struct shared_data_s {
+  //  Number of tracks using the data
+  uint32_t ref_count;
+  uint8_t data[];
+} shared_data_t;
+
 typedef struct event_s {
   uint32_t delta_time;
   uint8_t type;
@@ -76,10 +121,24 @@ typedef struct song_data_s {
 
   //  MIDI Track info
   track_node_t *track_list;
+
+  //  Built on demand, see song_tempo_map() in tempo_map.h
+  struct tempo_map_s *tempo_map;
+  //  Built on demand, see song_note_table() in note_table.h
+  struct note_table_s *note_table;
+  //  Built in the background, see song_density() in density.h
+  struct density_cache_s *density;
+
+  //  The song and all of its tracks, see attach_track_memory()
+  memory_usage_t memory;
+  //  Also receives every change to memory, see adopt_song_memory()
+  memory_usage_t *memory_owner;
 } song_data_t;
 
 //  Parsing functions
 song_data_t *parse_file(const char *);
+song_data_t *parse_buffer(const char *, uint8_t *, size_t);
+song_data_t *parse_stream(FILE *, const char *);
 void parse_header(FILE *, song_data_t *);
 void parse_track(FILE *, song_data_t *);
 event_t *parse_event(FILE *);
@@ -90,12 +149,21 @@ uint32_t parse_var_len(FILE *);
 
 //  Interpreting data internally
 uint8_t event_type(event_t *);
+uint8_t **event_data(event_t *, uint32_t *);
+void decode_division(division_t *, uint16_t);
+uint16_t encode_division(const division_t *);
+uint8_t *pool_payload(uint8_t *, uint32_t);
 
 //  Data manipulation
 void free_song(song_data_t *);
 void free_track_node(track_node_t *);
 void free_event_node(event_node_t *);
 
+//  Copy-on-write cloning
+song_data_t *clone_song(song_data_t *);
+track_t *own_track(track_node_t *);
+track_t *clone_track(track_t *, int);
+
 //  Functions for swapping endian-ness
 uint16_t end_swap_16(uint8_t [2]);
 uint32_t end_swap_32(uint8_t [4]);
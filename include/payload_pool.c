@@ -0,0 +1,203 @@
+/* Name, payload_pool.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "payload_pool.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define FNV_OFFSET (2166136261u)
+#define FNV_PRIME (16777619u)
+
+payload_pool_t *g_payload_pool = NULL;
+
+uint32_t hash_payload(const uint8_t *data, uint32_t length);
+void grow_payload_pool(payload_pool_t *pool);
+
+/*
+ * returns the FNV-1a hash of the bytes
+ */
+
+uint32_t hash_payload(const uint8_t *data, uint32_t length) {
+  uint32_t hash = FNV_OFFSET;
+  for (uint32_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+} /* hash_payload() */
+
+/*
+ * doubles the number of buckets of the pool
+ */
+
+void grow_payload_pool(payload_pool_t *pool) {
+  uint32_t num_buckets = pool->num_buckets * 2;
+  payload_t **buckets = malloc(sizeof(payload_t *) * num_buckets);
+  assert(buckets);
+  memset(buckets, 0, sizeof(payload_t *) * num_buckets);
+  for (uint32_t i = 0; i < pool->num_buckets; i++) {
+    payload_t *payload = pool->buckets[i];
+    while (payload) {
+      payload_t *next = payload->next;
+      uint32_t bucket = payload->hash & (num_buckets - 1);
+      payload->next = buckets[bucket];
+      buckets[bucket] = payload;
+      payload = next;
+    }
+  }
+  free(pool->buckets);
+  pool->buckets = buckets;
+  pool->num_buckets = num_buckets;
+} /* grow_payload_pool() */
+
+/*
+ * returns an empty pool
+ */
+
+payload_pool_t *create_payload_pool() {
+  payload_pool_t *pool = malloc(sizeof(payload_pool_t));
+  assert(pool);
+  memset(pool, 0, sizeof(payload_pool_t));
+  int init_return = pthread_mutex_init(&pool->lock, NULL);
+  assert(init_return == 0);
+  pool->num_buckets = POOL_MIN_BUCKETS;
+  pool->buckets = malloc(sizeof(payload_t *) * pool->num_buckets);
+  assert(pool->buckets);
+  memset(pool->buckets, 0, sizeof(payload_t *) * pool->num_buckets);
+  return pool;
+} /* create_payload_pool() */
+
+/*
+ * frees the pool and every payload left in it
+ */
+
+void free_payload_pool(payload_pool_t *pool) {
+  for (uint32_t i = 0; i < pool->num_buckets; i++) {
+    while (pool->buckets[i]) {
+      payload_t *payload = pool->buckets[i];
+      pool->buckets[i] = payload->next;
+      free(payload);
+    }
+  }
+  free(pool->buckets);
+  pool->buckets = NULL;
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+  pool = NULL;
+} /* free_payload_pool() */
+
+/*
+ * returns the pooled copy of the bytes, storing them if they are new. The
+ * copy must not be written to and is given back with release_payload()
+ */
+
+uint8_t *intern_payload(payload_pool_t *pool, const uint8_t *data,
+    uint32_t length) {
+  assert(pool);
+  uint32_t hash = hash_payload(data, length);
+  pthread_mutex_lock(&pool->lock);
+  pool->referenced_bytes += length;
+  payload_t *payload = pool->buckets[hash & (pool->num_buckets - 1)];
+  while (payload) {
+    if ((payload->hash == hash) && (payload->length == length) &&
+        (memcmp(payload->data, data, length) == 0)) {
+      payload->ref_count++;
+      pthread_mutex_unlock(&pool->lock);
+      return payload->data;
+    }
+    payload = payload->next;
+  }
+  if (pool->num_payloads >= pool->num_buckets) {
+    grow_payload_pool(pool);
+  }
+  payload = malloc(sizeof(payload_t) + length);
+  assert(payload);
+  payload->hash = hash;
+  payload->length = length;
+  payload->ref_count = 1;
+  memcpy(payload->data, data, length);
+  uint32_t bucket = hash & (pool->num_buckets - 1);
+  payload->next = pool->buckets[bucket];
+  pool->buckets[bucket] = payload;
+  pool->num_payloads++;
+  pool->stored_bytes += length;
+  pthread_mutex_unlock(&pool->lock);
+  return payload->data;
+} /* intern_payload() */
+
+/*
+ * returns the bytes held by the pool, with its buckets and each distinct
+ * payload once, and sets referenced to the bytes of every reference to them
+ */
+
+uint64_t pool_memory(payload_pool_t *pool, uint64_t *referenced) {
+  assert(pool);
+  pthread_mutex_lock(&pool->lock);
+  uint64_t bytes = sizeof(payload_pool_t) +
+    sizeof(payload_t *) * (uint64_t) pool->num_buckets +
+    sizeof(payload_t) * (uint64_t) pool->num_payloads + pool->stored_bytes;
+  *referenced = pool->referenced_bytes;
+  pthread_mutex_unlock(&pool->lock);
+  return bytes;
+} /* pool_memory() */
+
+/*
+ * drops a reference to the pooled bytes at data, freeing them with the last
+ * one. Returns false if data is not from the pool
+ */
+
+bool release_payload(payload_pool_t *pool, uint8_t *data, uint32_t length) {
+  if (pool == NULL) {
+    return false;
+  }
+  uint32_t hash = hash_payload(data, length);
+  pthread_mutex_lock(&pool->lock);
+  payload_t **link = &pool->buckets[hash & (pool->num_buckets - 1)];
+  while (*link) {
+    payload_t *payload = *link;
+    if (payload->data == data) {
+      pool->referenced_bytes -= length;
+      if (--payload->ref_count == 0) {
+        *link = payload->next;
+        pool->num_payloads--;
+        pool->stored_bytes -= length;
+        free(payload);
+      }
+      pthread_mutex_unlock(&pool->lock);
+      return true;
+    }
+    link = &payload->next;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return false;
+} /* release_payload() */
+
+/*
+ * returns a copy of the payload of an event, shared through g_payload_pool
+ * if it is set
+ */
+
+uint8_t *copy_payload(const uint8_t *data, uint32_t length) {
+  assert(length);
+  if (g_payload_pool) {
+    return intern_payload(g_payload_pool, data, length);
+  }
+  uint8_t *copy = malloc(length);
+  assert(copy);
+  memcpy(copy, data, length);
+  return copy;
+} /* copy_payload() */
+
+/*
+ * frees the payload of an event, whether it was pooled or not
+ */
+
+void drop_payload(uint8_t *data, uint32_t length) {
+  if (!release_payload(g_payload_pool, data, length)) {
+    free(data);
+  }
+} /* drop_payload() */
@@ -0,0 +1,45 @@
+#ifndef _PAYLOAD_POOL_H
+#define _PAYLOAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define POOL_MIN_BUCKETS (1024)
+
+//  One distinct payload, followed by its bytes. Never written once interned
+typedef struct payload_s {
+  struct payload_s *next;
+  uint32_t hash;
+  uint32_t length;
+  uint32_t ref_count;
+  uint8_t data[];
+} payload_t;
+
+//  Content-addressed set of meta and system event payloads
+typedef struct payload_pool_s {
+  pthread_mutex_t lock;
+  uint32_t num_buckets;
+  payload_t **buckets;
+  uint32_t num_payloads;
+
+  //  Bytes of the distinct payloads, and of every reference to them
+  uint64_t stored_bytes;
+  uint64_t referenced_bytes;
+} payload_pool_t;
+
+//  Pool used for the payloads of parsed and unpacked events, if set. It
+//  must stay set until every song loaded while it was set is freed
+extern payload_pool_t *g_payload_pool;
+
+payload_pool_t *create_payload_pool();
+void free_payload_pool(payload_pool_t *);
+uint8_t *intern_payload(payload_pool_t *, const uint8_t *, uint32_t);
+bool release_payload(payload_pool_t *, uint8_t *, uint32_t);
+uint64_t pool_memory(payload_pool_t *, uint64_t *);
+
+//  Payloads of events, interned in g_payload_pool if it is set
+uint8_t *copy_payload(const uint8_t *, uint32_t);
+void drop_payload(uint8_t *, uint32_t);
+
+#endif // _PAYLOAD_POOL_H
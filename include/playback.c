@@ -0,0 +1,410 @@
+/* Name, playback.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "playback.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MICROS_PER_NANO (1000)
+#define NANOS_PER_SECOND (1000000000)
+//  Longest single sleep, so stop requests are seen during long rests
+#define MAX_SLEEP_US (10000)
+#define FULL_RING_SLEEP_US (500)
+#define EMPTY_RING_SLEEP_US (100)
+#define LATE_US (1000)
+
+uint64_t now_us();
+void sleep_until_us(player_t *player, uint64_t time_us);
+void *producer_worker(void *player);
+void *consumer_worker(void *player);
+void file_sink_emit(playback_sink_t *sink, playback_event_t *event,
+    uint64_t now_us);
+
+/*
+ * returns CLOCK_MONOTONIC in microseconds
+ */
+
+uint64_t now_us() {
+  struct timespec spec;
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+  return (uint64_t) spec.tv_sec * MICROS_PER_SECOND +
+    spec.tv_nsec / MICROS_PER_NANO;
+} /* now_us() */
+
+/*
+ * prepares an empty ring with room for at least size events
+ */
+
+void init_event_ring(event_ring_t *ring, uint32_t size) {
+  assert(ring);
+  uint32_t capacity = 1;
+  while (capacity < size) {
+    capacity <<= 1;
+  }
+  ring->mask = capacity - 1;
+  ring->slots = malloc(sizeof(playback_event_t) * capacity);
+  assert(ring->slots);
+  ring->head = 0;
+  ring->tail = 0;
+} /* init_event_ring() */
+
+/*
+ * frees the slots of the ring
+ */
+
+void free_event_ring(event_ring_t *ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+} /* free_event_ring() */
+
+/*
+ * adds the event to the ring. Returns false if it is full. Only called by
+ * the producer
+ */
+
+bool ring_push(event_ring_t *ring, playback_event_t *event) {
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if (tail - head > ring->mask) {
+    return false;
+  }
+  ring->slots[tail & ring->mask] = *event;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+} /* ring_push() */
+
+/*
+ * takes the oldest event out of the ring. Returns false if it is empty.
+ * Only called by the consumer
+ */
+
+bool ring_pop(event_ring_t *ring, playback_event_t *event) {
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (head == tail) {
+    return false;
+  }
+  *event = ring->slots[head & ring->mask];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+} /* ring_pop() */
+
+/*
+ * returns the number of events in the ring
+ */
+
+uint32_t ring_size(event_ring_t *ring) {
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  return tail - head;
+} /* ring_size() */
+
+/*
+ * creates a stopped player for the song, positioned at its start
+ */
+
+player_t *create_player(song_data_t *song, playback_sink_t *sink) {
+  assert(song);
+  assert(sink);
+  assert(sink->emit);
+  player_t *player = malloc(sizeof(player_t));
+  assert(player);
+  memset(player, 0, sizeof(player_t));
+  player->song = song;
+  player->tempo_map = song_tempo_map(song);
+  player->sink = sink;
+  player->speed = 1.0;
+  player->timeline = open_timeline(song, 0);
+  player->loop_end = NO_LOOP;
+  init_event_ring(&player->ring, DEFAULT_RING_SIZE);
+  return player;
+} /* create_player() */
+
+/*
+ * stops the player and frees it. The song and sink are left alone
+ */
+
+void free_player(player_t *player) {
+  stop_playback(player);
+  close_timeline(player->timeline);
+  player->timeline = NULL;
+  free_event_ring(&player->ring);
+  free(player);
+  player = NULL;
+} /* free_player() */
+
+/*
+ * sleeps until playback time time_us or until the player is stopped
+ */
+
+void sleep_until_us(player_t *player, uint64_t time_us) {
+  while (!__atomic_load_n(&player->stop, __ATOMIC_ACQUIRE)) {
+    uint64_t now = now_us() - player->clock_origin_us;
+    if (now >= time_us) {
+      return;
+    }
+    uint64_t wake = player->clock_origin_us + time_us;
+    if (time_us - now > MAX_SLEEP_US) {
+      wake = player->clock_origin_us + now + MAX_SLEEP_US;
+    }
+    struct timespec spec = {
+      wake / MICROS_PER_SECOND, (wake % MICROS_PER_SECOND) * MICROS_PER_NANO
+    };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL);
+  }
+} /* sleep_until_us() */
+
+/*
+ * walks the timeline from the start tick, timestamping every event with the
+ * tempo map and feeding it to the ring. At the loop end, or the end of the
+ * song while looping, it goes back to the loop start
+ */
+
+void *producer_worker(void *data) {
+  player_t *player = data;
+  tempo_map_t *map = player->tempo_map;
+  uint64_t base_us = tick_to_micros(map, player->start_tick);
+  bool looping = (player->loop_end != NO_LOOP) &&
+    (player->loop_start < player->loop_end);
+  uint64_t loop_us = 0;
+  if (looping) {
+    loop_us = tick_to_micros(map, player->loop_end) -
+      tick_to_micros(map, player->loop_start);
+  }
+  bool moved = false;
+  timeline_event_t next = {0};
+  while (!__atomic_load_n(&player->stop, __ATOMIC_ACQUIRE)) {
+    bool has_next = timeline_next(player->timeline, &next);
+    if (looping && ((!has_next) || (next.tick >= player->loop_end))) {
+      //  An empty loop would never produce an event
+      if (!moved) {
+        break;
+      }
+      player->offset_us += loop_us ? loop_us : 1;
+      seek_timeline(player->timeline, player->loop_start);
+      moved = false;
+      continue;
+    }
+    if (!has_next) {
+      break;
+    }
+    moved = true;
+    playback_event_t event = {
+      (uint64_t) ((tick_to_micros(map, next.tick) - base_us +
+          player->offset_us) / player->speed),
+      next.tick, next.track, next.event
+    };
+    while ((!ring_push(&player->ring, &event)) &&
+        (!__atomic_load_n(&player->stop, __ATOMIC_ACQUIRE))) {
+      usleep(FULL_RING_SLEEP_US);
+    }
+  }
+  __atomic_store_n(&player->producer_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+} /* producer_worker() */
+
+/*
+ * takes events out of the ring, waits until each is due and hands it to the
+ * sink, measuring how late it was
+ */
+
+void *consumer_worker(void *data) {
+  player_t *player = data;
+  playback_stats_t *stats = &player->stats;
+  bool starved = false;
+  while (!__atomic_load_n(&player->stop, __ATOMIC_ACQUIRE)) {
+    bool done = __atomic_load_n(&player->producer_done, __ATOMIC_ACQUIRE);
+    playback_event_t event = {0};
+    if (!ring_pop(&player->ring, &event)) {
+      if (done) {
+        break;
+      }
+      if (!starved) {
+        stats->underruns++;
+        starved = true;
+      }
+      usleep(EMPTY_RING_SLEEP_US);
+      continue;
+    }
+    starved = false;
+    uint32_t queued = ring_size(&player->ring) + 1;
+    if (queued > stats->max_queued) {
+      stats->max_queued = queued;
+    }
+    sleep_until_us(player, event.time_us);
+    if (__atomic_load_n(&player->stop, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    uint64_t now = now_us() - player->clock_origin_us;
+    player->sink->emit(player->sink, &event, now);
+    uint64_t lateness = (now > event.time_us) ? now - event.time_us : 0;
+    stats->events++;
+    stats->total_lateness_us += lateness;
+    stats->squared_lateness_us += lateness * lateness;
+    if (lateness > stats->max_lateness_us) {
+      stats->max_lateness_us = lateness;
+    }
+    if (lateness > LATE_US) {
+      stats->late_events++;
+    }
+  }
+  return NULL;
+} /* consumer_worker() */
+
+/*
+ * starts playing from the current start tick on a producer and a consumer
+ * thread. The first event in the song's time is due right away
+ */
+
+void start_playback(player_t *player) {
+  assert(player);
+  assert(player->speed > 0);
+  if (player->playing) {
+    return;
+  }
+  //  The song may have been altered since the player last ran, which frees
+  //  its tempo map and may replace its tracks
+  player->tempo_map = song_tempo_map(player->song);
+  close_timeline(player->timeline);
+  player->timeline = open_timeline(player->song, player->start_tick);
+  player->offset_us = 0;
+  player->ring.head = 0;
+  player->ring.tail = 0;
+  player->stop = 0;
+  player->producer_done = 0;
+  player->clock_origin_us = now_us();
+  player->playing = true;
+  int create_return = pthread_create(&player->producer, NULL,
+      producer_worker, player);
+  assert(create_return == 0);
+  create_return = pthread_create(&player->consumer, NULL, consumer_worker,
+      player);
+  assert(create_return == 0);
+} /* start_playback() */
+
+/*
+ * stops playback and waits for both threads. Events still in the ring are
+ * dropped
+ */
+
+void stop_playback(player_t *player) {
+  assert(player);
+  if (!player->playing) {
+    return;
+  }
+  __atomic_store_n(&player->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(player->producer, NULL);
+  pthread_join(player->consumer, NULL);
+  player->playing = false;
+} /* stop_playback() */
+
+/*
+ * moves playback to the tick, continuing to play if it was playing
+ */
+
+void seek_playback(player_t *player, uint64_t tick) {
+  assert(player);
+  bool was_playing = player->playing;
+  stop_playback(player);
+  player->start_tick = tick;
+  if (was_playing) {
+    start_playback(player);
+  }
+} /* seek_playback() */
+
+/*
+ * makes playback jump back to loop_start whenever it reaches loop_end, or
+ * the end of the song. NO_LOOP as loop_end turns looping off. Takes effect
+ * from the start tick if the player is playing
+ */
+
+void loop_playback(player_t *player, uint64_t loop_start, uint64_t loop_end) {
+  assert(player);
+  bool was_playing = player->playing;
+  stop_playback(player);
+  player->loop_start = loop_start;
+  player->loop_end = loop_end;
+  if (was_playing) {
+    start_playback(player);
+  }
+} /* loop_playback() */
+
+/*
+ * returns true once every event has been emitted
+ */
+
+bool playback_done(player_t *player) {
+  assert(player);
+  return __atomic_load_n(&player->producer_done, __ATOMIC_ACQUIRE) &&
+    (ring_size(&player->ring) == 0);
+} /* playback_done() */
+
+/*
+ * waits until the song has played to its end. Never returns while looping
+ * unless another thread stops the player
+ */
+
+void wait_playback(player_t *player) {
+  assert(player);
+  if (!player->playing) {
+    return;
+  }
+  pthread_join(player->producer, NULL);
+  pthread_join(player->consumer, NULL);
+  player->playing = false;
+} /* wait_playback() */
+
+/*
+ * writes the times, position and bytes of the event as one line
+ */
+
+void file_sink_emit(playback_sink_t *sink, playback_event_t *event,
+    uint64_t now_us) {
+  FILE *file = sink->data;
+  event_t *midi = event->event;
+  fprintf(file, "%lu %lu %lu %u", event->time_us, now_us, event->tick,
+      event->track);
+  uint8_t type = event_type(midi);
+  if (type == META_EVENT_T) {
+    fprintf(file, " FF %s\n", midi->meta_event.name);
+    return;
+  }
+  if (type == SYS_EVENT_T) {
+    fprintf(file, " %02X %u\n", midi->type, midi->sys_event.data_len);
+    return;
+  }
+  fprintf(file, " %02X", midi->midi_event.status);
+  for (uint32_t i = 0; i < midi->midi_event.data_len; i++) {
+    fprintf(file, " %02X", midi->midi_event.data[i]);
+  }
+  fprintf(file, "\n");
+} /* file_sink_emit() */
+
+/*
+ * returns a sink writing every event to the file
+ */
+
+playback_sink_t *create_file_sink(FILE *file) {
+  assert(file);
+  playback_sink_t *sink = malloc(sizeof(playback_sink_t));
+  assert(sink);
+  sink->emit = file_sink_emit;
+  sink->data = file;
+  return sink;
+} /* create_file_sink() */
+
+/*
+ * frees the sink, leaving its file open
+ */
+
+void free_file_sink(playback_sink_t *sink) {
+  free(sink);
+  sink = NULL;
+} /* free_file_sink() */
@@ -0,0 +1,100 @@
+#ifndef _PLAYBACK_H
+#define _PLAYBACK_H
+
+#include <pthread.h>
+
+#include "parser.h"
+#include "timeline.h"
+#include "tempo_map.h"
+
+#define DEFAULT_RING_SIZE (1024)
+#define NO_LOOP (UINT64_MAX)
+
+//  One event of the stream, due time_us microseconds after playback began
+typedef struct playback_event_s {
+  uint64_t time_us;
+  uint64_t tick;
+  uint16_t track;
+  event_t *event;
+} playback_event_t;
+
+//  Lock-free ring with one producer and one consumer. head is only written
+//  by the consumer and tail only by the producer
+typedef struct event_ring_s {
+  uint32_t mask;
+  playback_event_t *slots;
+  uint32_t head __attribute__((aligned(64)));
+  uint32_t tail __attribute__((aligned(64)));
+} event_ring_t;
+
+//  Receives every event when it is due. now_us is when it was actually
+//  emitted, on the same clock as time_us
+typedef struct playback_sink_s {
+  void (*emit)(struct playback_sink_s *, playback_event_t *, uint64_t);
+  void *data;
+} playback_sink_t;
+
+//  Timing of the emitted events, lateness is now_us - time_us
+typedef struct playback_stats_s {
+  uint64_t events;
+  uint64_t total_lateness_us;
+  //  Sum of the squared lateness, for its standard deviation
+  uint64_t squared_lateness_us;
+  uint64_t max_lateness_us;
+  //  Events late by more than a millisecond
+  uint64_t late_events;
+  //  Times the consumer found the ring empty with an event still to come
+  uint64_t underruns;
+  uint32_t max_queued;
+} playback_stats_t;
+
+typedef struct player_s {
+  song_data_t *song;
+  tempo_map_t *tempo_map;
+  playback_sink_t *sink;
+  double speed;
+
+  //  Position of the producer
+  timeline_t *timeline;
+  uint64_t start_tick;
+  uint64_t loop_start;
+  uint64_t loop_end;
+  //  Time added to events of the current pass through the loop
+  uint64_t offset_us;
+
+  event_ring_t ring;
+  pthread_t producer;
+  pthread_t consumer;
+  bool playing;
+  int stop;
+  int producer_done;
+  //  CLOCK_MONOTONIC microseconds matching time_us 0
+  uint64_t clock_origin_us;
+
+  playback_stats_t stats;
+} player_t;
+
+//  Ring
+void init_event_ring(event_ring_t *, uint32_t);
+void free_event_ring(event_ring_t *);
+bool ring_push(event_ring_t *, playback_event_t *);
+bool ring_pop(event_ring_t *, playback_event_t *);
+uint32_t ring_size(event_ring_t *);
+
+//  Player. The song must not be altered while it is playing. It may be
+//  altered while the player is stopped, start_playback() picks the changes
+//  up
+player_t *create_player(song_data_t *, playback_sink_t *);
+void free_player(player_t *);
+void start_playback(player_t *);
+void stop_playback(player_t *);
+void seek_playback(player_t *, uint64_t);
+void loop_playback(player_t *, uint64_t, uint64_t);
+bool playback_done(player_t *);
+void wait_playback(player_t *);
+
+//  Sink writing one line per event to a file
+playback_sink_t *create_file_sink(FILE *);
+void free_file_sink(playback_sink_t *);
+
+#endif // _PLAYBACK_H
@@ -0,0 +1,529 @@
+/* Name, push_parser.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "push_parser.h"
+#include "payload_pool.h"
+#include "stats.h"
+#include "memory_usage.h"
+#include "density.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define MTHD "MThd"
+#define MTRK "MTrk"
+#define CHUNK_TYPE_SIZE (4)
+#define MAX_FORMAT (2)
+#define STATUS_BIT (0x80)
+#define VLQ_MASK (0x7F)
+
+uint16_t read_16(const uint8_t *data);
+uint32_t read_32(const uint8_t *data);
+int fail_push(push_parser_t *parser, const char *error);
+int push_chunk_header(push_parser_t *parser);
+int push_header_body(push_parser_t *parser);
+void start_track(push_parser_t *parser, uint32_t length);
+void finish_track(push_parser_t *parser);
+int push_track_byte(push_parser_t *parser, uint8_t byte);
+int push_vlq_byte(push_parser_t *parser, uint8_t byte);
+int start_event(push_parser_t *parser, uint8_t status);
+int start_meta_event(push_parser_t *parser, uint8_t type);
+int start_payload(push_parser_t *parser);
+size_t push_payload(push_parser_t *parser, const uint8_t *data, size_t len);
+void finish_event(push_parser_t *parser);
+void free_partial_event(push_parser_t *parser);
+
+/*
+ * returns a parser for a midi file named name that has not been read yet.
+ * callback, if set, receives each event as soon as it is complete
+ */
+
+push_parser_t *create_push_parser(const char *name, push_event_func_t callback,
+    void *callback_data) {
+  assert(name != NULL);
+  push_parser_t *parser = malloc(sizeof(push_parser_t));
+  assert(parser);
+  memset(parser, 0, sizeof(push_parser_t));
+  parser->state = PUSH_CHUNK_HEADER;
+  parser->callback = callback;
+  parser->callback_data = callback_data;
+
+  song_data_t *song = malloc(sizeof(song_data_t));
+  assert(song);
+  STAT_ALLOC(sizeof(song_data_t));
+  memset(song, 0, sizeof(song_data_t));
+  song->path = malloc(strlen(name) + 1);
+  assert(song->path);
+  STAT_ALLOC(strlen(name) + 1);
+  strcpy(song->path, name);
+  init_song_memory(song);
+  parser->song = song;
+  parser->track_tail = &song->track_list;
+  return parser;
+} /* create_push_parser() */
+
+/*
+ * parses the next len bytes of the file, which may end anywhere. Returns
+ * PUSH_MORE while the file is incomplete, PUSH_DONE once it is complete and
+ * PUSH_ERROR if it is malformed
+ */
+
+int push_bytes(push_parser_t *parser, const uint8_t *data, size_t len) {
+  assert((data != NULL) || (len == 0));
+  size_t read = 0;
+  while ((read < len) && (parser->state != PUSH_FAILED)) {
+    if (parser->state == PUSH_FINISHED) {
+      return fail_push(parser, "bytes after the last track");
+    }
+    if (parser->state == PUSH_DATA) {
+      //  Payloads are copied in bulk rather than a byte at a time
+      read += push_payload(parser, data + read, len - read);
+      continue;
+    }
+    uint8_t byte = data[read++];
+    if (parser->state == PUSH_CHUNK_HEADER) {
+      parser->header[parser->header_size++] = byte;
+      if (parser->header_size == CHUNK_HEADER_SIZE) {
+        push_chunk_header(parser);
+      }
+    }
+    else if (parser->state == PUSH_HEADER_BODY) {
+      parser->header[parser->header_size++] = byte;
+      if (parser->header_size == MTHD_BODY_SIZE) {
+        push_header_body(parser);
+      }
+    }
+    else {
+      push_track_byte(parser, byte);
+    }
+  }
+  parser->bytes_read += read;
+  if (parser->state == PUSH_FAILED) {
+    return PUSH_ERROR;
+  }
+  return parser->state == PUSH_FINISHED ? PUSH_DONE : PUSH_MORE;
+} /* push_bytes() */
+
+/*
+ * reads a 16 bit value in big endian order
+ */
+
+uint16_t read_16(const uint8_t *data) {
+  return (data[0] << 8) | data[1];
+} /* read_16() */
+
+/*
+ * reads a 32 bit value in big endian order
+ */
+
+uint32_t read_32(const uint8_t *data) {
+  return ((uint32_t) read_16(data) << 16) | read_16(data + 2);
+} /* read_32() */
+
+/*
+ * stops the parse with the given error, returns PUSH_ERROR
+ */
+
+int fail_push(push_parser_t *parser, const char *error) {
+  parser->state = PUSH_FAILED;
+  parser->error = error;
+  return PUSH_ERROR;
+} /* fail_push() */
+
+/*
+ * interprets a complete chunk header, the first must be MThd and the rest
+ * MTrk
+ */
+
+int push_chunk_header(push_parser_t *parser) {
+  uint32_t length = read_32(parser->header + CHUNK_TYPE_SIZE);
+  parser->header_size = 0;
+  if (!parser->have_mthd) {
+    if (memcmp(parser->header, MTHD, CHUNK_TYPE_SIZE) != 0) {
+      return fail_push(parser, "missing MThd chunk");
+    }
+    if (length != MTHD_BODY_SIZE) {
+      return fail_push(parser, "bad MThd length");
+    }
+    parser->have_mthd = true;
+    parser->state = PUSH_HEADER_BODY;
+    return PUSH_MORE;
+  }
+  if (memcmp(parser->header, MTRK, CHUNK_TYPE_SIZE) != 0) {
+    return fail_push(parser, "missing MTrk chunk");
+  }
+  if (length == 0) {
+    return fail_push(parser, "empty MTrk chunk");
+  }
+  start_track(parser, length);
+  parser->state = PUSH_DELTA;
+  return PUSH_MORE;
+} /* push_chunk_header() */
+
+/*
+ * interprets the format, track count and division of the MThd chunk
+ */
+
+int push_header_body(push_parser_t *parser) {
+  song_data_t *song = parser->song;
+  uint16_t format = read_16(parser->header);
+  if (format > MAX_FORMAT) {
+    return fail_push(parser, "unknown format");
+  }
+  song->format = (uint8_t) format;
+  song->num_tracks = read_16(parser->header + 2);
+  decode_division(&song->division, read_16(parser->header + 4));
+  parser->header_size = 0;
+  if (song->num_tracks == 0) {
+    parser->state = PUSH_FINISHED;
+    STAT_ADD(STAT_SONGS_PARSED, 1);
+    return PUSH_DONE;
+  }
+  parser->state = PUSH_CHUNK_HEADER;
+  return PUSH_MORE;
+} /* push_header_body() */
+
+/*
+ * links a new empty track of length bytes at the end of the song
+ */
+
+void start_track(push_parser_t *parser, uint32_t length) {
+  track_node_t *track_node = malloc(sizeof(track_node_t));
+  assert(track_node);
+  track_t *track = malloc(sizeof(track_t));
+  assert(track);
+  STAT_ALLOC(sizeof(track_node_t) + sizeof(track_t));
+  track->length = length;
+  track->event_list = NULL;
+  track->ref_count = 1;
+  track->block = NULL;
+  track->tick_index = NULL;
+  track->shared_data = NULL;
+  init_track_memory(track);
+  track_node->next_track = NULL;
+  track_node->track = track;
+  *parser->track_tail = track_node;
+  parser->track_tail = &track_node->next_track;
+
+  parser->track = track;
+  parser->tail = &track->event_list;
+  parser->track_left = length;
+  parser->tick = 0;
+} /* start_track() */
+
+/*
+ * adds the completed track to the song's usage and moves on to the next
+ * chunk, if there is one
+ */
+
+void finish_track(push_parser_t *parser) {
+  attach_track_memory(parser->song, parser->track);
+  parser->track = NULL;
+  parser->tail = NULL;
+  parser->tracks_done++;
+  STAT_ADD(STAT_TRACKS_PARSED, 1);
+  if (parser->tracks_done == parser->song->num_tracks) {
+    parser->state = PUSH_FINISHED;
+    STAT_ADD(STAT_SONGS_PARSED, 1);
+    return;
+  }
+  parser->state = PUSH_CHUNK_HEADER;
+} /* finish_track() */
+
+/*
+ * parses a byte of an event outside of its payload
+ */
+
+int push_track_byte(push_parser_t *parser, uint8_t byte) {
+  if (parser->track_left == 0) {
+    return fail_push(parser, "event runs past the end of its track");
+  }
+  parser->track_left--;
+  switch (parser->state) {
+    case PUSH_DELTA:
+    case PUSH_LENGTH:
+      return push_vlq_byte(parser, byte);
+    case PUSH_STATUS:
+      return start_event(parser, byte);
+    case PUSH_META_TYPE:
+      return start_meta_event(parser, byte);
+    default:
+      assert(false);
+  }
+  return PUSH_ERROR;
+} /* push_track_byte() */
+
+/*
+ * adds a byte to the delta time or payload length being read, and uses the
+ * value once it is complete
+ */
+
+int push_vlq_byte(push_parser_t *parser, uint8_t byte) {
+  if (parser->vlq_bytes == MAX_VLQ_BYTES) {
+    return fail_push(parser, "variable length quantity too long");
+  }
+  parser->vlq = (parser->vlq << 7) | (byte & VLQ_MASK);
+  parser->vlq_bytes++;
+  if (byte & STATUS_BIT) {
+    return PUSH_MORE;
+  }
+  uint32_t value = parser->vlq;
+  parser->vlq = 0;
+  parser->vlq_bytes = 0;
+
+  if (parser->state == PUSH_DELTA) {
+    parser->event = malloc(sizeof(event_t));
+    assert(parser->event);
+    STAT_ALLOC(sizeof(event_t));
+    memset(parser->event, 0, sizeof(event_t));
+    parser->event->delta_time = value;
+    parser->state = PUSH_STATUS;
+    return PUSH_MORE;
+  }
+
+  event_t *event = parser->event;
+  if (event->type == META_EVENT) {
+    //  Set from META_TABLE if the type has a fixed length
+    if ((event->meta_event.data_len) &&
+        (event->meta_event.data_len != value)) {
+      return fail_push(parser, "bad meta event length");
+    }
+    event->meta_event.data_len = value;
+  }
+  else {
+    event->sys_event.data_len = value;
+  }
+  parser->payload_size = value;
+  return start_payload(parser);
+} /* push_vlq_byte() */
+
+/*
+ * starts an event from its status byte. Like parse_midi_event(), a data
+ * byte repeats the last status and becomes the first byte of the data
+ */
+
+int start_event(push_parser_t *parser, uint8_t status) {
+  event_t *event = parser->event;
+  event->type = status;
+  if (status == META_EVENT) {
+    parser->state = PUSH_META_TYPE;
+    return PUSH_MORE;
+  }
+  if ((status == SYS_EVENT_1) || (status == SYS_EVENT_2)) {
+    parser->state = PUSH_LENGTH;
+    return PUSH_MORE;
+  }
+
+  bool running = !(status & STATUS_BIT);
+  if (running) {
+    status = parser->running_status;
+  }
+  else {
+    parser->running_status = status;
+  }
+  event->midi_event.status = status;
+  event->midi_event.name = MIDI_TABLE[status].name;
+  event->midi_event.data_len = MIDI_TABLE[status].data_len;
+  if (event->midi_event.name == NULL) {
+    return fail_push(parser, "unknown status byte");
+  }
+  if ((running) && (event->midi_event.data_len == 0)) {
+    return fail_push(parser, "running status without data");
+  }
+  parser->payload_size = event->midi_event.data_len;
+  if (start_payload(parser) != PUSH_MORE) {
+    return PUSH_ERROR;
+  }
+  if (running) {
+    parser->payload[parser->payload_read++] = event->type;
+    if (parser->payload_read == parser->payload_size) {
+      finish_event(parser);
+    }
+  }
+  return PUSH_MORE;
+} /* start_event() */
+
+/*
+ * fills in a meta event from the table entry of its type
+ */
+
+int start_meta_event(push_parser_t *parser, uint8_t type) {
+  meta_event_t *event = &parser->event->meta_event;
+  event->name = META_TABLE[type].name;
+  if (event->name == NULL) {
+    return fail_push(parser, "unknown meta event type");
+  }
+  event->data_len = META_TABLE[type].data_len;
+  event->data = META_TABLE[type].data;
+  parser->state = PUSH_LENGTH;
+  return PUSH_MORE;
+} /* start_meta_event() */
+
+/*
+ * allocates the payload of the event once its size is known, or finishes an
+ * event without one
+ */
+
+int start_payload(push_parser_t *parser) {
+  if (parser->payload_size == 0) {
+    finish_event(parser);
+    return PUSH_MORE;
+  }
+  parser->payload = malloc(parser->payload_size);
+  assert(parser->payload);
+  STAT_ALLOC(parser->payload_size);
+  parser->payload_read = 0;
+  parser->state = PUSH_DATA;
+  return PUSH_MORE;
+} /* start_payload() */
+
+/*
+ * copies as much of the payload as there is in data, and returns the number
+ * of bytes used
+ */
+
+size_t push_payload(push_parser_t *parser, const uint8_t *data, size_t len) {
+  size_t wanted = parser->payload_size - parser->payload_read;
+  if (len > wanted) {
+    len = wanted;
+  }
+  if (len > parser->track_left) {
+    fail_push(parser, "event runs past the end of its track");
+    return 0;
+  }
+  memcpy(parser->payload + parser->payload_read, data, len);
+  parser->payload_read += len;
+  parser->track_left -= len;
+  if (parser->payload_read == parser->payload_size) {
+    finish_event(parser);
+  }
+  return len;
+} /* push_payload() */
+
+/*
+ * gives the completed event its payload and appends it to the track
+ */
+
+void finish_event(push_parser_t *parser) {
+  event_t *event = parser->event;
+  uint8_t type = event_type(event);
+  if (type == META_EVENT_T) {
+    if (parser->payload) {
+      event->meta_event.data = pool_payload(parser->payload,
+          parser->payload_size);
+    }
+    STAT_ADD(STAT_META_EVENTS, 1);
+  }
+  else if (type == SYS_EVENT_T) {
+    if (parser->payload) {
+      event->sys_event.data = pool_payload(parser->payload,
+          parser->payload_size);
+    }
+    STAT_ADD(STAT_SYS_EVENTS, 1);
+  }
+  else {
+    event->midi_event.data = parser->payload;
+    STAT_ADD(STAT_MIDI_EVENTS, 1);
+  }
+  parser->payload = NULL;
+  parser->payload_size = 0;
+  parser->payload_read = 0;
+  parser->event = NULL;
+
+  event_node_t *node = malloc(sizeof(event_node_t));
+  assert(node);
+  STAT_ALLOC(sizeof(event_node_t));
+  node->event = event;
+  node->next_event = NULL;
+  *parser->tail = node;
+  parser->tail = &node->next_event;
+  account_event(parser->track, event);
+
+  parser->tick += event->delta_time;
+  if (parser->callback) {
+    parser->callback(parser->callback_data, parser->tracks_done,
+        parser->tick, event);
+  }
+  if (parser->track_left == 0) {
+    finish_track(parser);
+    return;
+  }
+  parser->state = PUSH_DELTA;
+} /* finish_event() */
+
+/*
+ * returns the parsed song once the whole file has been pushed, it then
+ * belongs to the caller. Otherwise returns NULL and sets the error
+ */
+
+song_data_t *finish_push_parser(push_parser_t *parser) {
+  if (parser->state == PUSH_FAILED) {
+    return NULL;
+  }
+  if (parser->state != PUSH_FINISHED) {
+    fail_push(parser, "file ends early");
+    return NULL;
+  }
+  STAT_ADD(STAT_BYTES_READ, parser->bytes_read);
+  song_data_t *song = parser->song;
+  parser->song = NULL;
+  return song;
+} /* finish_push_parser() */
+
+/*
+ * frees the event being built, which is not linked into its track yet
+ */
+
+void free_partial_event(push_parser_t *parser) {
+  free(parser->payload);
+  parser->payload = NULL;
+  free(parser->event);
+  parser->event = NULL;
+} /* free_partial_event() */
+
+/*
+ * frees the parser along with whatever part of the song it has not handed
+ * over
+ */
+
+void free_push_parser(push_parser_t *parser) {
+  free_partial_event(parser);
+  if (parser->song) {
+    //  Partial tracks are already linked into the song
+    free_song(parser->song);
+    parser->song = NULL;
+  }
+  free(parser);
+  parser = NULL;
+} /* free_push_parser() */
+
+/*
+ * parses a midi file from a stream that may not support seeking, such as a
+ * pipe, reading it in fixed size blocks
+ */
+
+song_data_t *parse_unseekable(FILE *file, const char *name,
+    const char **error) {
+  push_parser_t *parser = create_push_parser(name, NULL, NULL);
+  uint8_t block[PUSH_READ_SIZE];
+  size_t len = 0;
+  while ((len = fread(block, 1, sizeof(block), file)) > 0) {
+    if (push_bytes(parser, block, len) == PUSH_ERROR) {
+      break;
+    }
+  }
+  song_data_t *song = finish_push_parser(parser);
+  if ((song == NULL) && (error)) {
+    *error = parser->error;
+  }
+  if ((song) && (g_density_on_load)) {
+    start_density_cache(song);
+  }
+  free_push_parser(parser);
+  parser = NULL;
+  return song;
+} /* parse_unseekable() */
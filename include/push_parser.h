@@ -0,0 +1,87 @@
+#ifndef _PUSH_PARSER_H
+#define _PUSH_PARSER_H
+
+#include "parser.h"
+
+//  Returned by push_bytes()
+#define PUSH_MORE (0)
+#define PUSH_DONE (1)
+#define PUSH_ERROR (-1)
+
+//  Header of a chunk, type and length
+#define CHUNK_HEADER_SIZE (8)
+#define MTHD_BODY_SIZE (6)
+//  Longest variable length quantity
+#define MAX_VLQ_BYTES (4)
+//  Bytes read from the stream at a time by parse_unseekable()
+#define PUSH_READ_SIZE (4096)
+
+//  What the next byte of input is part of
+typedef enum push_state_e {
+  PUSH_CHUNK_HEADER,
+  PUSH_HEADER_BODY,
+  PUSH_DELTA,
+  PUSH_STATUS,
+  PUSH_META_TYPE,
+  PUSH_LENGTH,
+  PUSH_DATA,
+  PUSH_FINISHED,
+  PUSH_FAILED
+} push_state_t;
+
+//  Called for every event as soon as it is complete, with the index of its
+//  track and its absolute tick. The event belongs to the song being built
+typedef void (*push_event_func_t)(void *, uint16_t, uint64_t, event_t *);
+
+//  Everything a parse needs between two chunks of input
+typedef struct push_parser_s {
+  push_state_t state;
+  const char *error;
+  song_data_t *song;
+  //  Where the next track node of the song is linked
+  track_node_t **track_tail;
+  push_event_func_t callback;
+  void *callback_data;
+  uint64_t bytes_read;
+
+  //  Partial chunk header or MThd body
+  uint8_t header[CHUNK_HEADER_SIZE];
+  uint32_t header_size;
+  bool have_mthd;
+
+  //  Track being built, already linked into the song. Its events are
+  //  appended at tail
+  track_t *track;
+  event_node_t **tail;
+  uint16_t tracks_done;
+  //  Bytes of the MTrk chunk not read yet
+  uint32_t track_left;
+  uint64_t tick;
+
+  //  Partial variable length quantity
+  uint32_t vlq;
+  uint8_t vlq_bytes;
+  //  Status of the last channel event, kept across meta and SysEx events
+  //  and across tracks like parse_midi_event()
+  uint8_t running_status;
+
+  //  Event being built and its partial payload, neither is linked into the
+  //  track until the event is complete
+  event_t *event;
+  uint8_t *payload;
+  uint32_t payload_size;
+  uint32_t payload_read;
+} push_parser_t;
+
+//  Builds the same song as parse_file() from input pushed in pieces of any
+//  size. Malformed input fails the parse with an error instead of asserting
+push_parser_t *create_push_parser(const char *, push_event_func_t, void *);
+int push_bytes(push_parser_t *, const uint8_t *, size_t);
+song_data_t *finish_push_parser(push_parser_t *);
+void free_push_parser(push_parser_t *);
+
+//  Parses the whole stream through a push parser, without seeking. On
+//  failure returns NULL and sets the error if it is not NULL
+song_data_t *parse_unseekable(FILE *, const char *, const char **);
+
+#endif // _PUSH_PARSER_H
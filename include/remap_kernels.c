@@ -0,0 +1,269 @@
+/* Name, remap_kernels.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "remap_kernels.h"
+
+#include <assert.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define LANES (16)
+#define SIGN_FLIP (0x80)
+#define LOW_NIBBLE (0x0F)
+#define NIBBLE_SHIFT (4)
+#define WARP_LOW_MASK ((1ull << WARP_SHIFT) - 1)
+#define WARP_HALF (1ull << (WARP_SHIFT - 1))
+#define WARP_BATCH (64)
+#define VLQ_1_BYTE_MAX (0x7F)
+#define VLQ_2_BYTE_MAX (0x3FFF)
+#define VLQ_3_BYTE_MAX (0x1FFFFF)
+#define VLQ_MAX (0x0FFFFFFF)
+
+#ifdef KERNELS_X86
+__m128i status_mask(__m128i status, uint8_t status_min, uint8_t status_max);
+int shift_column_sse2(const uint8_t *status, uint8_t *data, uint32_t count,
+    int shift, uint8_t status_min, uint8_t status_max);
+int remap_column_ssse3(const uint8_t *status, uint8_t *data, uint32_t count,
+    const uint8_t *table, uint8_t status_min, uint8_t status_max);
+#endif
+
+/*
+ * applies table to every data byte whose status is in range
+ */
+
+int remap_column_scalar(const uint8_t *status, uint8_t *data, uint32_t count,
+    const uint8_t *table, uint8_t status_min, uint8_t status_max) {
+  int modified = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if ((status[i] >= status_min) && (status[i] <= status_max)) {
+      data[i] = table[data[i]];
+      modified++;
+    }
+  }
+  return modified;
+} /* remap_column_scalar() */
+
+/*
+ * adds shift to every data byte whose status is in range, as long as the
+ * result stays a valid note
+ */
+
+int shift_column_scalar(const uint8_t *status, uint8_t *data, uint32_t count,
+    int shift, uint8_t status_min, uint8_t status_max) {
+  int modified = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if ((status[i] >= status_min) && (status[i] <= status_max)) {
+      int note_changed = data[i] + shift;
+      if ((note_changed >= NOTE_MIN) && (note_changed <= NOTE_MAX)) {
+        data[i] = (uint8_t) note_changed;
+        modified++;
+      }
+    }
+  }
+  return modified;
+} /* shift_column_scalar() */
+
+#ifdef KERNELS_X86
+
+/*
+ * returns 0xFF in every lane whose status is in [status_min, status_max]
+ */
+
+__m128i status_mask(__m128i status, uint8_t status_min, uint8_t status_max) {
+  //  SSE2 only has signed byte compares, so move the range into signed space
+  __m128i flip = _mm_set1_epi8((char) SIGN_FLIP);
+  __m128i value = _mm_xor_si128(status, flip);
+  __m128i below = _mm_cmplt_epi8(value,
+      _mm_set1_epi8((char) (status_min ^ SIGN_FLIP)));
+  __m128i above = _mm_cmpgt_epi8(value,
+      _mm_set1_epi8((char) (status_max ^ SIGN_FLIP)));
+  return _mm_andnot_si128(_mm_or_si128(below, above), _mm_set1_epi8(-1));
+} /* status_mask() */
+
+/*
+ * SSE2 version of shift_column_scalar, 16 events at a time
+ */
+
+int shift_column_sse2(const uint8_t *status, uint8_t *data, uint32_t count,
+    int shift, uint8_t status_min, uint8_t status_max) {
+  int modified = 0;
+  uint32_t i = 0;
+  __m128i zero = _mm_setzero_si128();
+  __m128i offset = _mm_set1_epi16((short) shift);
+  __m128i lowest = _mm_set1_epi16(NOTE_MIN - 1);
+  __m128i highest = _mm_set1_epi16(NOTE_MAX + 1);
+  for (; i + LANES <= count; i += LANES) {
+    __m128i in_range = status_mask(
+        _mm_loadu_si128((const __m128i *) (status + i)), status_min,
+        status_max);
+    __m128i notes = _mm_loadu_si128((const __m128i *) (data + i));
+    //  Widen to 16 bits so the bound checks see the real sum
+    __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(notes, zero), offset);
+    __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(notes, zero), offset);
+    __m128i low_ok = _mm_and_si128(_mm_cmpgt_epi16(low, lowest),
+        _mm_cmplt_epi16(low, highest));
+    __m128i high_ok = _mm_and_si128(_mm_cmpgt_epi16(high, lowest),
+        _mm_cmplt_epi16(high, highest));
+    __m128i mask = _mm_and_si128(in_range, _mm_packs_epi16(low_ok, high_ok));
+    __m128i changed = _mm_packus_epi16(low, high);
+    __m128i result = _mm_or_si128(_mm_and_si128(mask, changed),
+        _mm_andnot_si128(mask, notes));
+    _mm_storeu_si128((__m128i *) (data + i), result);
+    modified += __builtin_popcount(_mm_movemask_epi8(mask));
+  }
+  return modified + shift_column_scalar(status + i, data + i, count - i,
+      shift, status_min, status_max);
+} /* shift_column_sse2() */
+
+/*
+ * SSSE3 version of remap_column_scalar, 16 events at a time. The 256 entry
+ * table is looked up as 16 shuffles of 16 entries, selected by high nibble
+ */
+
+__attribute__((target("ssse3")))
+int remap_column_ssse3(const uint8_t *status, uint8_t *data, uint32_t count,
+    const uint8_t *table, uint8_t status_min, uint8_t status_max) {
+  int modified = 0;
+  uint32_t i = 0;
+  __m128i rows[LANES];
+  for (int row = 0; row < LANES; row++) {
+    rows[row] = _mm_loadu_si128((const __m128i *) (table + row * LANES));
+  }
+  __m128i nibble = _mm_set1_epi8(LOW_NIBBLE);
+  for (; i + LANES <= count; i += LANES) {
+    __m128i mask = status_mask(
+        _mm_loadu_si128((const __m128i *) (status + i)), status_min,
+        status_max);
+    __m128i values = _mm_loadu_si128((const __m128i *) (data + i));
+    __m128i low = _mm_and_si128(values, nibble);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(values, NIBBLE_SHIFT),
+        nibble);
+    __m128i mapped = _mm_setzero_si128();
+    for (int row = 0; row < LANES; row++) {
+      __m128i selected = _mm_cmpeq_epi8(high, _mm_set1_epi8((char) row));
+      mapped = _mm_or_si128(mapped,
+          _mm_and_si128(selected, _mm_shuffle_epi8(rows[row], low)));
+    }
+    __m128i result = _mm_or_si128(_mm_and_si128(mask, mapped),
+        _mm_andnot_si128(mask, values));
+    _mm_storeu_si128((__m128i *) (data + i), result);
+    modified += __builtin_popcount(_mm_movemask_epi8(mask));
+  }
+  return modified + remap_column_scalar(status + i, data + i, count - i,
+      table, status_min, status_max);
+} /* remap_column_ssse3() */
+
+#endif // KERNELS_X86
+
+/*
+ * returns the fixed point scale for a warp_time multiplier
+ */
+
+uint64_t warp_scale(float multiplier) {
+  assert(multiplier >= 0);
+  return (uint64_t) ((double) multiplier * (1ull << WARP_SHIFT) + 0.5);
+} /* warp_scale() */
+
+/*
+ * prepares the state for warping a track from its start
+ */
+
+void init_warp_state(warp_state_t *state, float multiplier) {
+  state->scale = warp_scale(multiplier);
+  state->old_tick = 0;
+  state->new_tick = 0;
+} /* init_warp_state() */
+
+/*
+ * scales a column of consecutive delta-times of a track in place, and
+ * returns the change in the number of bytes needed to store them as VLQs.
+ * Each event's new absolute tick is its old one times the scale, rounded,
+ * so errors do not build up from event to event. The scale itself is only
+ * within 2^-25 of the multiplier, so an event at tick t lands within
+ * 1/2 + t / 2^25 ticks of the exact warp, which is under a tick only for
+ * tracks shorter than 2^24 ticks. A delta-time longer than a VLQ can hold
+ * is clamped to VLQ_MAX, moving the events after it earlier by the excess.
+ * Apart from the running sum the loops have no branches or cross-iteration
+ * dependencies, so they are left to the vectorizer
+ */
+
+int warp_column(uint32_t *deltas, uint32_t count, warp_state_t *state) {
+  uint64_t ticks[WARP_BATCH];
+  int32_t sizes[WARP_BATCH];
+  int difference = 0;
+  uint64_t scale = state->scale;
+  for (uint32_t start = 0; start < count; start += WARP_BATCH) {
+    uint32_t batch = count - start;
+    if (batch > WARP_BATCH) {
+      batch = WARP_BATCH;
+    }
+    uint32_t *column = deltas + start;
+    uint64_t tick = state->old_tick;
+    for (uint32_t i = 0; i < batch; i++) {
+      tick += column[i];
+      ticks[i] = tick;
+    }
+    state->old_tick = tick;
+    for (uint32_t i = 0; i < batch; i++) {
+      uint32_t old_delta = column[i];
+      sizes[i] = -((old_delta > VLQ_1_BYTE_MAX) +
+          (old_delta > VLQ_2_BYTE_MAX) + (old_delta > VLQ_3_BYTE_MAX));
+      //  Split the tick so the products fit in 64 bits
+      ticks[i] = (ticks[i] >> WARP_SHIFT) * scale +
+        (((ticks[i] & WARP_LOW_MASK) * scale + WARP_HALF) >> WARP_SHIFT);
+    }
+    uint64_t previous = state->new_tick;
+    for (uint32_t i = 0; i < batch; i++) {
+      uint64_t exact = ticks[i] - (i ? ticks[i - 1] : previous);
+      uint32_t new_delta = (exact > VLQ_MAX) ? VLQ_MAX : (uint32_t) exact;
+      column[i] = new_delta;
+      sizes[i] += (new_delta > VLQ_1_BYTE_MAX) +
+        (new_delta > VLQ_2_BYTE_MAX) + (new_delta > VLQ_3_BYTE_MAX);
+    }
+    state->new_tick = ticks[batch - 1];
+    for (uint32_t i = 0; i < batch; i++) {
+      difference += sizes[i];
+    }
+  }
+  return difference;
+} /* warp_column() */
+
+/*
+ * remaps a column with the fastest kernel the processor supports
+ */
+
+int remap_column(const uint8_t *status, uint8_t *data, uint32_t count,
+    const uint8_t *table, uint8_t status_min, uint8_t status_max) {
+  assert(table);
+#ifdef KERNELS_X86
+  if (__builtin_cpu_supports("ssse3")) {
+    return remap_column_ssse3(status, data, count, table, status_min,
+        status_max);
+  }
+#endif
+  return remap_column_scalar(status, data, count, table, status_min,
+      status_max);
+} /* remap_column() */
+
+/*
+ * shifts a column with the fastest kernel the processor supports
+ */
+
+int shift_column(const uint8_t *status, uint8_t *data, uint32_t count,
+    int shift, uint8_t status_min, uint8_t status_max) {
+#ifdef KERNELS_X86
+  //  Larger shifts cannot produce a valid note and would overflow 16 bits
+  if ((shift > -(NOTE_MAX + 0xFF)) && (shift < NOTE_MAX + 0xFF)) {
+    return shift_column_sse2(status, data, count, shift, status_min,
+        status_max);
+  }
+#endif
+  return shift_column_scalar(status, data, count, shift, status_min,
+      status_max);
+} /* shift_column() */
@@ -0,0 +1,37 @@
+#ifndef _REMAP_KERNELS_H
+#define _REMAP_KERNELS_H
+
+#include "alterations.h"
+
+//  Column kernels. Each takes a column of status bytes and a column of the
+//  first data byte of the same events, rewrites the data bytes of events
+//  whose status lies in [status_min, status_max] and returns how many events
+//  it counted as modified, matching the single-event alterations
+int remap_column(const uint8_t *, uint8_t *, uint32_t, const uint8_t *,
+    uint8_t, uint8_t);
+int shift_column(const uint8_t *, uint8_t *, uint32_t, int, uint8_t,
+    uint8_t);
+
+//  Portable versions, also used for the tail of every column
+int remap_column_scalar(const uint8_t *, uint8_t *, uint32_t,
+    const uint8_t *, uint8_t, uint8_t);
+int shift_column_scalar(const uint8_t *, uint8_t *, uint32_t, int, uint8_t,
+    uint8_t);
+
+//  Time warp kernel. Delta-times are scaled as absolute ticks by a fixed
+//  point factor with WARP_SHIFT fraction bits, so rounding never builds up
+#define WARP_SHIFT (24)
+
+typedef struct warp_state_s {
+  uint64_t scale;
+  //  Absolute ticks of the last event before and after warping, the latter
+  //  ignoring delta-times clamped by warp_column()
+  uint64_t old_tick;
+  uint64_t new_tick;
+} warp_state_t;
+
+uint64_t warp_scale(float);
+void init_warp_state(warp_state_t *, float);
+int warp_column(uint32_t *, uint32_t, warp_state_t *);
+
+#endif // _REMAP_KERNELS_H
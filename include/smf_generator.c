@@ -0,0 +1,368 @@
+/* Name, smf_generator.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "smf_generator.h"
+#include "song_writer.h"
+#include "convert.h"
+#include "payload_pool.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define SEQUENCE_NAME (0x03)
+#define SET_TEMPO (0x51)
+#define TIME_SIGNATURE (0x58)
+#define NOTE_ON (0x90)
+#define CONTROL_CHANGE (0xB0)
+#define PROGRAM_CHANGE (0xC0)
+#define PITCH_WHEEL (0xE0)
+#define SYSEX_END (0xF7)
+#define NUM_CHANNELS (16)
+#define DATA_MASK (0x7F)
+#define MAX_SOUNDING (8)
+#define LOWEST_NOTE (36)
+#define NOTE_RANGE (48)
+#define BASE_TEMPO (500000)
+#define TEMPO_RANGE (250000)
+#define BEATS_PER_BAR (4)
+#define PERCENT (100)
+#define PATH_LENGTH (4096)
+
+//  Track being generated, and the state running status depends on
+typedef struct gen_track_s {
+  track_t *track;
+  event_node_t **tail;
+  uint8_t last_status;
+} gen_track_t;
+
+uint32_t gen_random(uint32_t *state);
+void start_gen_track(gen_track_t *gen);
+void push_gen_event(gen_track_t *gen, event_t *event);
+event_t *gen_meta(uint32_t delta, uint8_t meta_type, const uint8_t *data,
+    uint32_t data_len);
+event_t *gen_sysex(uint32_t delta, uint32_t data_len, uint32_t *state);
+void push_channel_event(gen_track_t *gen, uint32_t delta, uint8_t status,
+    uint8_t data_1, uint8_t data_2, smf_params_t *params, uint32_t *state);
+void push_tempo(gen_track_t *gen, uint32_t delta, uint32_t *state);
+void push_track_name(gen_track_t *gen, int number);
+track_t *generate_conductor(smf_params_t *params, uint32_t *state);
+track_t *generate_instrument(smf_params_t *params, int number,
+    uint32_t tempo_every, uint32_t *state);
+
+/*
+ * returns the next value of a xorshift generator
+ */
+
+uint32_t gen_random(uint32_t *state) {
+  uint32_t value = *state;
+  value ^= value << 13;
+  value ^= value >> 17;
+  value ^= value << 5;
+  *state = value;
+  return value;
+} /* gen_random() */
+
+/*
+ * sets gen up to build an empty track
+ */
+
+void start_gen_track(gen_track_t *gen) {
+  gen->track = malloc(sizeof(track_t));
+  assert(gen->track);
+  memset(gen->track, 0, sizeof(track_t));
+  gen->track->ref_count = 1;
+  init_track_memory(gen->track);
+  gen->tail = &gen->track->event_list;
+  gen->last_status = 0;
+} /* start_gen_track() */
+
+/*
+ * appends the event to the track being generated
+ */
+
+void push_gen_event(gen_track_t *gen, event_t *event) {
+  event_node_t *node = malloc(sizeof(event_node_t));
+  assert(node);
+  node->event = event;
+  node->next_event = NULL;
+  *gen->tail = node;
+  gen->tail = &node->next_event;
+  gen->track->length += event_size(event);
+  account_event(gen->track, event);
+} /* push_gen_event() */
+
+/*
+ * returns a meta event of the given type with a copy of the data
+ */
+
+event_t *gen_meta(uint32_t delta, uint8_t meta_type, const uint8_t *data,
+    uint32_t data_len) {
+  event_t *event = malloc(sizeof(event_t));
+  assert(event);
+  memset(event, 0, sizeof(event_t));
+  event->delta_time = delta;
+  event->type = META_EVENT;
+  event->meta_event = META_TABLE[meta_type];
+  assert(event->meta_event.name);
+  event->meta_event.data_len = data_len;
+  if (data_len) {
+    event->meta_event.data = copy_payload(data, data_len);
+  }
+  return event;
+} /* gen_meta() */
+
+/*
+ * returns a SysEx event of data_len random bytes, the last ending it
+ */
+
+event_t *gen_sysex(uint32_t delta, uint32_t data_len, uint32_t *state) {
+  uint8_t *data = malloc(data_len);
+  assert(data);
+  for (uint32_t i = 0; i + 1 < data_len; i++) {
+    data[i] = gen_random(state) & DATA_MASK;
+  }
+  data[data_len - 1] = SYSEX_END;
+  event_t *event = malloc(sizeof(event_t));
+  assert(event);
+  memset(event, 0, sizeof(event_t));
+  event->delta_time = delta;
+  event->type = SYS_EVENT_1;
+  event->sys_event.data_len = data_len;
+  event->sys_event.data = copy_payload(data, data_len);
+  free(data);
+  data = NULL;
+  return event;
+} /* gen_sysex() */
+
+/*
+ * appends a channel event, using running status for the given percent of
+ * the events repeating the previous status
+ */
+
+void push_channel_event(gen_track_t *gen, uint32_t delta, uint8_t status,
+    uint8_t data_1, uint8_t data_2, smf_params_t *params, uint32_t *state) {
+  event_t *event = malloc(sizeof(event_t));
+  assert(event);
+  memset(event, 0, sizeof(event_t));
+  event->delta_time = delta;
+  event->midi_event = MIDI_TABLE[status];
+  event->midi_event.data = malloc(event->midi_event.data_len);
+  assert(event->midi_event.data);
+  event->midi_event.data[0] = data_1;
+  if (event->midi_event.data_len > 1) {
+    event->midi_event.data[1] = data_2;
+  }
+  event->type = status;
+  if ((status == gen->last_status) &&
+      (gen_random(state) % PERCENT < params->running_status)) {
+    //  As the parser stores events read with running status
+    event->type = data_1;
+  }
+  gen->last_status = status;
+  push_gen_event(gen, event);
+} /* push_channel_event() */
+
+/*
+ * appends a Set Tempo event with a random tempo
+ */
+
+void push_tempo(gen_track_t *gen, uint32_t delta, uint32_t *state) {
+  uint32_t tempo = BASE_TEMPO - TEMPO_RANGE / 2 +
+    gen_random(state) % TEMPO_RANGE;
+  uint8_t data[3] = { tempo >> 16, (tempo >> 8) & 0xFF, tempo & 0xFF };
+  push_gen_event(gen, gen_meta(delta, SET_TEMPO, data, sizeof(data)));
+} /* push_tempo() */
+
+/*
+ * appends a track name event naming the track by its number
+ */
+
+void push_track_name(gen_track_t *gen, int number) {
+  char name[32];
+  int length = snprintf(name, sizeof(name), "Track %d", number);
+  push_gen_event(gen, gen_meta(0, SEQUENCE_NAME, (uint8_t *) name,
+        length));
+} /* push_track_name() */
+
+/*
+ * returns the conductor track of a format 1 song, with a tempo change at
+ * the start of each of the first bars
+ */
+
+track_t *generate_conductor(smf_params_t *params, uint32_t *state) {
+  gen_track_t gen = {0};
+  start_gen_track(&gen);
+  push_track_name(&gen, 0);
+  uint8_t time_signature[4] = { BEATS_PER_BAR, 2, 24, 8 };
+  push_gen_event(&gen, gen_meta(0, TIME_SIGNATURE, time_signature,
+        sizeof(time_signature)));
+  push_tempo(&gen, 0, state);
+  for (uint32_t i = 0; i < params->tempo_changes; i++) {
+    push_tempo(&gen, params->division * BEATS_PER_BAR, state);
+  }
+  push_gen_event(&gen, gen_meta(0, END_OF_TRACK, NULL, 0));
+  return gen.track;
+} /* generate_conductor() */
+
+/*
+ * returns an instrument track of random notes, controller changes and
+ * pitch bends on one channel. If tempo_every is set, a tempo change comes
+ * after every tempo_every channel events, as in a format 0 song
+ */
+
+track_t *generate_instrument(smf_params_t *params, int number,
+    uint32_t tempo_every, uint32_t *state) {
+  static const uint32_t deltas[] = { 0, 0, 30, 60, 120, 240, 480 };
+  gen_track_t gen = {0};
+  start_gen_track(&gen);
+  push_track_name(&gen, number);
+  uint8_t channel = (number - 1) % NUM_CHANNELS;
+  push_channel_event(&gen, 0, PROGRAM_CHANGE | channel,
+      gen_random(state) & DATA_MASK, 0, params, state);
+  if (params->sysex_size) {
+    push_gen_event(&gen, gen_sysex(0, params->sysex_size, state));
+  }
+
+  uint8_t sounding[MAX_SOUNDING];
+  int num_sounding = 0;
+  for (uint32_t i = 0; i < params->events_per_track; i++) {
+    if ((tempo_every) && (i) && (i % tempo_every == 0)) {
+      push_tempo(&gen, 0, state);
+    }
+    uint32_t delta = deltas[gen_random(state) % (sizeof(deltas) /
+        sizeof(deltas[0]))];
+    uint32_t kind = gen_random(state) % PERCENT;
+    if (kind < 80) {
+      if ((num_sounding == MAX_SOUNDING) ||
+          ((num_sounding) && (gen_random(state) & 1))) {
+        //  Note Offs as Note Ons with no velocity, so running status applies
+        push_channel_event(&gen, delta, NOTE_ON | channel, sounding[0], 0,
+            params, state);
+        memmove(sounding, sounding + 1, --num_sounding);
+      }
+      else {
+        sounding[num_sounding] = LOWEST_NOTE +
+          gen_random(state) % NOTE_RANGE;
+        push_channel_event(&gen, delta, NOTE_ON | channel,
+            sounding[num_sounding++], 1 + gen_random(state) % DATA_MASK,
+            params, state);
+      }
+    }
+    else if (kind < 95) {
+      push_channel_event(&gen, delta, CONTROL_CHANGE | channel,
+          gen_random(state) % 2 ? 7 : 10, gen_random(state) & DATA_MASK,
+          params, state);
+    }
+    else {
+      push_channel_event(&gen, delta, PITCH_WHEEL | channel,
+          gen_random(state) & DATA_MASK, gen_random(state) & DATA_MASK,
+          params, state);
+    }
+  }
+  while (num_sounding) {
+    push_channel_event(&gen, deltas[3], NOTE_ON | channel,
+        sounding[--num_sounding], 0, params, state);
+  }
+  push_gen_event(&gen, gen_meta(0, END_OF_TRACK, NULL, 0));
+  return gen.track;
+} /* generate_instrument() */
+
+/*
+ * fills params with the default shape
+ */
+
+void init_smf_params(smf_params_t *params) {
+  params->seed = DEFAULT_SEED;
+  params->num_tracks = DEFAULT_GEN_TRACKS;
+  params->events_per_track = DEFAULT_GEN_EVENTS;
+  params->running_status = DEFAULT_RUNNING_STATUS;
+  params->sysex_size = DEFAULT_SYSEX_SIZE;
+  params->tempo_changes = DEFAULT_TEMPO_CHANGES;
+  params->division = DEFAULT_GEN_DIVISION;
+} /* init_smf_params() */
+
+/*
+ * returns a synthetic song of the given shape
+ */
+
+song_data_t *generate_song(smf_params_t *params) {
+  assert(params);
+  assert(params->num_tracks >= 1);
+  assert(params->running_status <= PERCENT);
+  //  Odd divisions would be read back as SMPTE, see parse_header()
+  assert((params->division % 2 == 0) && (params->division < 0x8000));
+  uint32_t state = params->seed * 2654435761u + 1;
+  if (state == 0) {
+    state = 1;
+  }
+  song_data_t *song = malloc(sizeof(song_data_t));
+  assert(song);
+  memset(song, 0, sizeof(song_data_t));
+  init_song_memory(song);
+  song->format = (params->num_tracks == 1) ? 0 : 1;
+  song->num_tracks = params->num_tracks;
+  song->division.uses_tpq = true;
+  song->division.ticks_per_qtr = params->division;
+
+  track_node_t **tail = &song->track_list;
+  for (int i = 0; i < params->num_tracks; i++) {
+    track_node_t *node = malloc(sizeof(track_node_t));
+    assert(node);
+    node->next_track = NULL;
+    if (song->format == 0) {
+      uint32_t tempo_every = params->events_per_track /
+        (params->tempo_changes + 1);
+      node->track = generate_instrument(params, 1,
+          tempo_every ? tempo_every : 1, &state);
+    }
+    else if (i == 0) {
+      node->track = generate_conductor(params, &state);
+    }
+    else {
+      node->track = generate_instrument(params, i, 0, &state);
+    }
+    attach_track_memory(song, node->track);
+    *tail = node;
+    tail = &node->next_track;
+  }
+  return song;
+} /* generate_song() */
+
+/*
+ * writes a synthetic song of the given shape to the path
+ */
+
+void generate_smf(const char *path, smf_params_t *params) {
+  song_data_t *song = generate_song(params);
+  write_song_data(song, (char *) path);
+  free_song(song);
+  song = NULL;
+} /* generate_smf() */
+
+/*
+ * writes count synthetic songs to the directory, creating it if needed. The
+ * songs differ by seed, from params->seed on. Returns the number written
+ */
+
+int generate_corpus(const char *directory, int count, smf_params_t *params) {
+  assert(directory);
+  assert(params);
+  if ((mkdir(directory, 0755) != 0) && (errno != EEXIST)) {
+    return 0;
+  }
+  smf_params_t song_params = *params;
+  char path[PATH_LENGTH];
+  for (int i = 0; i < count; i++) {
+    song_params.seed = params->seed + i;
+    snprintf(path, sizeof(path), "%s/synth_%04d.mid", directory, i);
+    generate_smf(path, &song_params);
+  }
+  return count;
+} /* generate_corpus() */
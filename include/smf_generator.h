@@ -0,0 +1,36 @@
+#ifndef _SMF_GENERATOR_H
+#define _SMF_GENERATOR_H
+
+#include "parser.h"
+
+#define DEFAULT_SEED (1)
+#define DEFAULT_GEN_TRACKS (8)
+#define DEFAULT_GEN_EVENTS (2000)
+#define DEFAULT_RUNNING_STATUS (50)
+#define DEFAULT_SYSEX_SIZE (64)
+#define DEFAULT_TEMPO_CHANGES (16)
+#define DEFAULT_GEN_DIVISION (480)
+
+//  Shape of a synthetic song. The same parameters always give the same song
+typedef struct smf_params_s {
+  uint32_t seed;
+  //  Including the conductor track, a single track song is format 0
+  uint16_t num_tracks;
+  //  Channel events of each instrument track
+  uint32_t events_per_track;
+  //  Percent of the channel events that could use running status that do
+  uint8_t running_status;
+  //  Bytes of the SysEx message at the start of each instrument track, 0
+  //  for none
+  uint32_t sysex_size;
+  //  Set Tempo events spread over the song after the initial one
+  uint32_t tempo_changes;
+  uint16_t division;
+} smf_params_t;
+
+void init_smf_params(smf_params_t *);
+song_data_t *generate_song(smf_params_t *);
+void generate_smf(const char *, smf_params_t *);
+int generate_corpus(const char *, int, smf_params_t *);
+
+#endif // _SMF_GENERATOR_H
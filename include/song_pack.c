@@ -0,0 +1,543 @@
+/* Name, song_pack.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "song_pack.h"
+#include "payload_pool.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define VLQ_CONTINUE (0x80)
+#define VLQ_MASK (0x7F)
+#define VLQ_SHIFT (7)
+#define NOTE_EVENT_MIN (0x80)
+#define NOTE_EVENT_MAX (0xAF)
+#define STATUS_BIT (0x80)
+#define COLUMN_MIN_CAPACITY (64)
+
+//  LZ token layout: a control byte with the high bit clear is followed by
+//  (control + 1) literal bytes, with the high bit set it is a match of
+//  (control & 0x7F) + LZ_MIN_MATCH bytes followed by a 2 byte offset
+#define LZ_MATCH_BIT (0x80)
+#define LZ_MIN_MATCH (4)
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 0x7F)
+#define LZ_MAX_LITERALS (0x80)
+#define LZ_WINDOW (0xFFFF)
+#define LZ_HASH_BITS (12)
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_HASH_MULTIPLIER (2654435761u)
+
+typedef struct pack_column_s {
+  uint8_t *data;
+  uint32_t size;
+  uint32_t capacity;
+} pack_column_t;
+
+void pack_column_reserve(pack_column_t *column, uint32_t extra);
+void pack_column_push(pack_column_t *column, uint8_t byte);
+void pack_column_push_vlq(pack_column_t *column, uint32_t value);
+void pack_column_append(pack_column_t *column, const uint8_t *data,
+    uint32_t len);
+uint32_t pack_read_vlq(const uint8_t *column, uint32_t *position);
+void pack_track(track_t *track, packed_track_t *packed);
+track_t *unpack_track(packed_track_t *packed);
+uint32_t lz_hash(const uint8_t *data);
+uint32_t lz_flush_literals(const uint8_t *literals, uint32_t count,
+    uint8_t *out);
+
+/*
+ * grows the column so that it can hold extra more bytes
+ */
+
+void pack_column_reserve(pack_column_t *column, uint32_t extra) {
+  if (column->size + extra <= column->capacity) {
+    return;
+  }
+  uint32_t capacity = column->capacity ? column->capacity :
+    COLUMN_MIN_CAPACITY;
+  while (capacity < column->size + extra) {
+    capacity *= 2;
+  }
+  column->data = realloc(column->data, capacity);
+  assert(column->data);
+  column->capacity = capacity;
+} /* pack_column_reserve() */
+
+/*
+ * appends a single byte to the column
+ */
+
+void pack_column_push(pack_column_t *column, uint8_t byte) {
+  pack_column_reserve(column, 1);
+  column->data[column->size++] = byte;
+} /* pack_column_push() */
+
+/*
+ * appends a value to the column as a variable length quantity
+ */
+
+void pack_column_push_vlq(pack_column_t *column, uint32_t value) {
+  uint8_t bytes[5];
+  int count = 0;
+  bytes[count++] = value & VLQ_MASK;
+  value >>= VLQ_SHIFT;
+  while (value) {
+    bytes[count++] = (value & VLQ_MASK) | VLQ_CONTINUE;
+    value >>= VLQ_SHIFT;
+  }
+  pack_column_reserve(column, count);
+  while (count) {
+    column->data[column->size++] = bytes[--count];
+  }
+} /* pack_column_push_vlq() */
+
+/*
+ * appends len bytes of data to the column
+ */
+
+void pack_column_append(pack_column_t *column, const uint8_t *data,
+    uint32_t len) {
+  if (len == 0) {
+    return;
+  }
+  pack_column_reserve(column, len);
+  memcpy(column->data + column->size, data, len);
+  column->size += len;
+} /* pack_column_append() */
+
+/*
+ * reads a variable length quantity from the column, advancing position
+ */
+
+uint32_t pack_read_vlq(const uint8_t *column, uint32_t *position) {
+  uint8_t read = column[(*position)++];
+  uint32_t value = read & VLQ_MASK;
+  while (read & VLQ_CONTINUE) {
+    read = column[(*position)++];
+    value = (value << VLQ_SHIFT) | (read & VLQ_MASK);
+  }
+  return value;
+} /* pack_read_vlq() */
+
+/*
+ * returns the meta type byte of a meta event, recovered from its table name
+ */
+
+uint8_t meta_event_type(event_t *event) {
+  assert(event);
+  assert(event->type == META_EVENT);
+  for (int i = 0; i <= 0xFF; i++) {
+    if ((META_TABLE[i].name != NULL) &&
+        (META_TABLE[i].name == event->meta_event.name)) {
+      return (uint8_t) i;
+    }
+  }
+  for (int i = 0; i <= 0xFF; i++) {
+    if ((META_TABLE[i].name != NULL) &&
+        (strcmp(META_TABLE[i].name, event->meta_event.name) == 0)) {
+      return (uint8_t) i;
+    }
+  }
+  assert(0);
+  return 0;
+} /* meta_event_type() */
+
+/*
+ * splits the events of a track into columns and compresses each column
+ */
+
+void pack_track(track_t *track, packed_track_t *packed) {
+  pack_column_t columns[PACK_NUM_COLUMNS];
+  memset(columns, 0, sizeof(columns));
+  memset(packed, 0, sizeof(packed_track_t));
+  packed->length = track->length;
+  uint8_t last_note = 0;
+  event_node_t *list = track->event_list;
+  while (list) {
+    event_t *event = list->event;
+    pack_column_push_vlq(&columns[PACK_DELTA_COLUMN], event->delta_time);
+    pack_column_push(&columns[PACK_TYPE_COLUMN], event->type);
+    if (event->type == META_EVENT) {
+      pack_column_push(&columns[PACK_TYPE_COLUMN], meta_event_type(event));
+      pack_column_push_vlq(&columns[PACK_LENGTH_COLUMN],
+          event->meta_event.data_len);
+      pack_column_append(&columns[PACK_PAYLOAD_COLUMN],
+          event->meta_event.data, event->meta_event.data_len);
+    }
+    else if ((event->type == SYS_EVENT_1) || (event->type == SYS_EVENT_2)) {
+      pack_column_push_vlq(&columns[PACK_LENGTH_COLUMN],
+          event->sys_event.data_len);
+      pack_column_append(&columns[PACK_PAYLOAD_COLUMN],
+          event->sys_event.data, event->sys_event.data_len);
+    }
+    else {
+      uint8_t status = event->midi_event.status;
+      if (!(event->type & STATUS_BIT)) {
+        pack_column_push(&columns[PACK_TYPE_COLUMN], status);
+      }
+      if (event->midi_event.data_len) {
+        //  Note numbers are stored relative to the previous note
+        if ((status >= NOTE_EVENT_MIN) && (status <= NOTE_EVENT_MAX)) {
+          pack_column_push(&columns[PACK_PAYLOAD_COLUMN],
+              (uint8_t) (event->midi_event.data[0] - last_note));
+          last_note = event->midi_event.data[0];
+          pack_column_append(&columns[PACK_PAYLOAD_COLUMN],
+              event->midi_event.data + 1, event->midi_event.data_len - 1);
+        }
+        else {
+          pack_column_append(&columns[PACK_PAYLOAD_COLUMN],
+              event->midi_event.data, event->midi_event.data_len);
+        }
+      }
+    }
+    packed->num_events++;
+    list = list->next_event;
+  }
+
+  uint32_t bound = 0;
+  for (int i = 0; i < PACK_NUM_COLUMNS; i++) {
+    bound += lz_bound(columns[i].size);
+  }
+  uint8_t *buffer = malloc(bound ? bound : 1);
+  assert(buffer);
+  uint32_t offset = 0;
+  for (int i = 0; i < PACK_NUM_COLUMNS; i++) {
+    packed->raw_size[i] = columns[i].size;
+    packed->packed_size[i] = lz_compress(columns[i].data, columns[i].size,
+        buffer + offset);
+    offset += packed->packed_size[i];
+    free(columns[i].data);
+    columns[i].data = NULL;
+  }
+  packed->columns = realloc(buffer, offset ? offset : 1);
+  assert(packed->columns);
+} /* pack_track() */
+
+/*
+ * rebuilds the editable event list of a packed track
+ */
+
+track_t *unpack_track(packed_track_t *packed) {
+  uint8_t *columns[PACK_NUM_COLUMNS];
+  uint32_t positions[PACK_NUM_COLUMNS];
+  uint32_t offset = 0;
+  for (int i = 0; i < PACK_NUM_COLUMNS; i++) {
+    columns[i] = malloc(packed->raw_size[i] ? packed->raw_size[i] : 1);
+    assert(columns[i]);
+    uint32_t decoded = lz_decompress(packed->columns + offset,
+        packed->packed_size[i], columns[i], packed->raw_size[i]);
+    assert(decoded == packed->raw_size[i]);
+    offset += packed->packed_size[i];
+    positions[i] = 0;
+  }
+
+  track_t *track = malloc(sizeof(track_t));
+  assert(track);
+  track->length = packed->length;
+  track->ref_count = 1;
+  track->block = NULL;
+  track->tick_index = NULL;
+  track->shared_data = NULL;
+  track->event_list = NULL;
+  init_track_memory(track);
+  event_node_t **tail = &track->event_list;
+  uint8_t last_note = 0;
+  for (uint32_t i = 0; i < packed->num_events; i++) {
+    event_t *event = malloc(sizeof(event_t));
+    assert(event);
+    memset(event, 0, sizeof(event_t));
+    event->delta_time = pack_read_vlq(columns[PACK_DELTA_COLUMN],
+        &positions[PACK_DELTA_COLUMN]);
+    event->type = columns[PACK_TYPE_COLUMN][positions[PACK_TYPE_COLUMN]++];
+    uint8_t *payload = columns[PACK_PAYLOAD_COLUMN] +
+      positions[PACK_PAYLOAD_COLUMN];
+    uint32_t data_len = 0;
+    if (event->type == META_EVENT) {
+      uint8_t meta_type =
+        columns[PACK_TYPE_COLUMN][positions[PACK_TYPE_COLUMN]++];
+      data_len = pack_read_vlq(columns[PACK_LENGTH_COLUMN],
+          &positions[PACK_LENGTH_COLUMN]);
+      event->meta_event.name = META_TABLE[meta_type].name;
+      event->meta_event.data_len = data_len;
+      event->meta_event.data = META_TABLE[meta_type].data;
+      if (data_len) {
+        event->meta_event.data = copy_payload(payload, data_len);
+      }
+    }
+    else if ((event->type == SYS_EVENT_1) || (event->type == SYS_EVENT_2)) {
+      data_len = pack_read_vlq(columns[PACK_LENGTH_COLUMN],
+          &positions[PACK_LENGTH_COLUMN]);
+      event->sys_event.data_len = data_len;
+      if (data_len) {
+        event->sys_event.data = copy_payload(payload, data_len);
+      }
+    }
+    else {
+      uint8_t status = event->type;
+      if (!(event->type & STATUS_BIT)) {
+        status = columns[PACK_TYPE_COLUMN][positions[PACK_TYPE_COLUMN]++];
+      }
+      event->midi_event = MIDI_TABLE[status];
+      event->midi_event.status = status;
+      data_len = event->midi_event.data_len;
+      if (data_len) {
+        event->midi_event.data = malloc(data_len);
+        assert(event->midi_event.data);
+        memcpy(event->midi_event.data, payload, data_len);
+        if ((status >= NOTE_EVENT_MIN) && (status <= NOTE_EVENT_MAX)) {
+          event->midi_event.data[0] += last_note;
+          last_note = event->midi_event.data[0];
+        }
+      }
+    }
+    positions[PACK_PAYLOAD_COLUMN] += data_len;
+
+    event_node_t *node = malloc(sizeof(event_node_t));
+    assert(node);
+    node->event = event;
+    node->next_event = NULL;
+    *tail = node;
+    tail = &node->next_event;
+    account_event(track, event);
+  }
+
+  for (int i = 0; i < PACK_NUM_COLUMNS; i++) {
+    free(columns[i]);
+    columns[i] = NULL;
+  }
+  return track;
+} /* unpack_track() */
+
+/*
+ * packs the given song into its compact idle form. The song is consumed and
+ * its path is moved into the packed song
+ */
+
+packed_song_t *pack_song(song_data_t *song) {
+  assert(song);
+  packed_song_t *packed = malloc(sizeof(packed_song_t));
+  assert(packed);
+  packed->path = song->path;
+  song->path = NULL;
+  packed->format = song->format;
+  packed->num_tracks = song->num_tracks;
+  packed->division = song->division;
+  packed->track_count = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    packed->track_count++;
+    track_list = track_list->next_track;
+  }
+  packed->tracks = malloc(sizeof(packed_track_t) *
+      (packed->track_count ? packed->track_count : 1));
+  assert(packed->tracks);
+  track_list = song->track_list;
+  for (int i = 0; i < packed->track_count; i++) {
+    pack_track(track_list->track, &packed->tracks[i]);
+    track_list = track_list->next_track;
+  }
+  free_song(song);
+  song = NULL;
+  return packed;
+} /* pack_song() */
+
+/*
+ * expands a packed song back into an editable song. The packed song is
+ * consumed and its path is moved into the new song
+ */
+
+song_data_t *unpack_song(packed_song_t *packed) {
+  assert(packed);
+  song_data_t *song = malloc(sizeof(song_data_t));
+  assert(song);
+  song->path = packed->path;
+  packed->path = NULL;
+  song->format = packed->format;
+  song->num_tracks = packed->num_tracks;
+  song->division = packed->division;
+  song->track_list = NULL;
+  song->tempo_map = NULL;
+  song->note_table = NULL;
+  song->density = NULL;
+  init_song_memory(song);
+  track_node_t **tail = &song->track_list;
+  for (int i = 0; i < packed->track_count; i++) {
+    track_node_t *track_node = malloc(sizeof(track_node_t));
+    assert(track_node);
+    track_node->track = unpack_track(&packed->tracks[i]);
+    track_node->next_track = NULL;
+    attach_track_memory(song, track_node->track);
+    *tail = track_node;
+    tail = &track_node->next_track;
+  }
+  free_packed_song(packed);
+  packed = NULL;
+  return song;
+} /* unpack_song() */
+
+/*
+ * frees the memory associated with a packed_song_t struct
+ */
+
+void free_packed_song(packed_song_t *packed) {
+  for (int i = 0; i < packed->track_count; i++) {
+    free(packed->tracks[i].columns);
+    packed->tracks[i].columns = NULL;
+  }
+  free(packed->tracks);
+  packed->tracks = NULL;
+  free(packed->path);
+  packed->path = NULL;
+  free(packed);
+  packed = NULL;
+} /* free_packed_song() */
+
+/*
+ * returns the number of bytes held by a packed song, excluding its path
+ */
+
+uint32_t packed_song_size(packed_song_t *packed) {
+  uint32_t size = sizeof(packed_song_t) +
+    packed->track_count * sizeof(packed_track_t);
+  for (int i = 0; i < packed->track_count; i++) {
+    for (int j = 0; j < PACK_NUM_COLUMNS; j++) {
+      size += packed->tracks[i].packed_size[j];
+    }
+  }
+  return size;
+} /* packed_song_size() */
+
+/*
+ * returns the number of events stored in a packed song
+ */
+
+uint32_t packed_song_events(packed_song_t *packed) {
+  uint32_t events = 0;
+  for (int i = 0; i < packed->track_count; i++) {
+    events += packed->tracks[i].num_events;
+  }
+  return events;
+} /* packed_song_events() */
+
+/*
+ * returns the largest size lz_compress can produce for len input bytes
+ */
+
+uint32_t lz_bound(uint32_t len) {
+  return len + len / LZ_MAX_LITERALS + 1;
+} /* lz_bound() */
+
+/*
+ * hashes the next LZ_MIN_MATCH bytes of data
+ */
+
+uint32_t lz_hash(const uint8_t *data) {
+  uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16) |
+    ((uint32_t) data[3] << 24);
+  return (value * LZ_HASH_MULTIPLIER) >> (32 - LZ_HASH_BITS);
+} /* lz_hash() */
+
+/*
+ * writes a literal run to out and returns the number of bytes written
+ */
+
+uint32_t lz_flush_literals(const uint8_t *literals, uint32_t count,
+    uint8_t *out) {
+  if (count == 0) {
+    return 0;
+  }
+  out[0] = (uint8_t) (count - 1);
+  memcpy(out + 1, literals, count);
+  return count + 1;
+} /* lz_flush_literals() */
+
+/*
+ * compresses len bytes of in into out, which must hold lz_bound(len) bytes.
+ * Returns the compressed size
+ */
+
+uint32_t lz_compress(const uint8_t *in, uint32_t len, uint8_t *out) {
+  int32_t table[LZ_HASH_SIZE];
+  for (int i = 0; i < LZ_HASH_SIZE; i++) {
+    table[i] = -1;
+  }
+  uint32_t out_size = 0;
+  uint32_t literal_start = 0;
+  uint32_t position = 0;
+  while (position + LZ_MIN_MATCH <= len) {
+    uint32_t hash = lz_hash(in + position);
+    int32_t candidate = table[hash];
+    table[hash] = position;
+    if ((candidate < 0) || (position - candidate > LZ_WINDOW) ||
+        (memcmp(in + candidate, in + position, LZ_MIN_MATCH) != 0)) {
+      position++;
+      if (position - literal_start == LZ_MAX_LITERALS) {
+        out_size += lz_flush_literals(in + literal_start,
+            position - literal_start, out + out_size);
+        literal_start = position;
+      }
+      continue;
+    }
+    uint32_t match = LZ_MIN_MATCH;
+    while ((position + match < len) && (match < LZ_MAX_MATCH) &&
+        (in[candidate + match] == in[position + match])) {
+      match++;
+    }
+    out_size += lz_flush_literals(in + literal_start,
+        position - literal_start, out + out_size);
+    uint32_t distance = position - candidate;
+    out[out_size++] = LZ_MATCH_BIT | (uint8_t) (match - LZ_MIN_MATCH);
+    out[out_size++] = distance & 0xFF;
+    out[out_size++] = (distance >> 8) & 0xFF;
+    position += match;
+    literal_start = position;
+  }
+  while (literal_start < len) {
+    uint32_t count = len - literal_start;
+    if (count > LZ_MAX_LITERALS) {
+      count = LZ_MAX_LITERALS;
+    }
+    out_size += lz_flush_literals(in + literal_start, count, out + out_size);
+    literal_start += count;
+  }
+  return out_size;
+} /* lz_compress() */
+
+/*
+ * decompresses len bytes of in into out, writing at most capacity bytes.
+ * Returns the decompressed size
+ */
+
+uint32_t lz_decompress(const uint8_t *in, uint32_t len, uint8_t *out,
+    uint32_t capacity) {
+  uint32_t in_position = 0;
+  uint32_t out_size = 0;
+  while (in_position < len) {
+    uint8_t control = in[in_position++];
+    if (control & LZ_MATCH_BIT) {
+      uint32_t match = (control & ~LZ_MATCH_BIT) + LZ_MIN_MATCH;
+      uint32_t distance = in[in_position] | (in[in_position + 1] << 8);
+      in_position += 2;
+      assert((distance > 0) && (distance <= out_size));
+      assert(out_size + match <= capacity);
+      //  Matches may overlap their own output, so copy forwards
+      for (uint32_t i = 0; i < match; i++) {
+        out[out_size + i] = out[out_size - distance + i];
+      }
+      out_size += match;
+    }
+    else {
+      uint32_t count = control + 1;
+      assert(out_size + count <= capacity);
+      memcpy(out + out_size, in + in_position, count);
+      in_position += count;
+      out_size += count;
+    }
+  }
+  return out_size;
+} /* lz_decompress() */
@@ -0,0 +1,52 @@
+#ifndef _SONG_PACK_H
+#define _SONG_PACK_H
+
+#include "parser.h"
+
+//  Columns a packed track is split into
+#define PACK_DELTA_COLUMN (0)
+#define PACK_TYPE_COLUMN (1)
+#define PACK_LENGTH_COLUMN (2)
+#define PACK_PAYLOAD_COLUMN (3)
+#define PACK_NUM_COLUMNS (4)
+
+typedef struct packed_track_s {
+  uint32_t length;
+  uint32_t num_events;
+  uint32_t raw_size[PACK_NUM_COLUMNS];
+  uint32_t packed_size[PACK_NUM_COLUMNS];
+  //  All compressed columns, stored back to back
+  uint8_t *columns;
+} packed_track_t;
+
+typedef struct packed_song_s {
+  //  Owned by the packed song while it is idle
+  char *path;
+
+  uint8_t format;
+  uint16_t num_tracks;
+  division_t division;
+
+  //  Number of tracks actually stored, may differ from num_tracks
+  uint16_t track_count;
+  packed_track_t *tracks;
+} packed_song_t;
+
+//  Packing functions
+packed_song_t *pack_song(song_data_t *);
+song_data_t *unpack_song(packed_song_t *);
+void free_packed_song(packed_song_t *);
+
+//  Statistics
+uint32_t packed_song_size(packed_song_t *);
+uint32_t packed_song_events(packed_song_t *);
+
+//  Column compression
+uint32_t lz_compress(const uint8_t *, uint32_t, uint8_t *);
+uint32_t lz_decompress(const uint8_t *, uint32_t, uint8_t *, uint32_t);
+uint32_t lz_bound(uint32_t);
+
+//  Helpers
+uint8_t meta_event_type(event_t *);
+
+#endif // _SONG_PACK_H
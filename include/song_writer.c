@@ -0,0 +1,196 @@
+/* Name, song_writer.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "song_writer.h"
+#include "song_pack.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define MTHD "MThd"
+#define MTRK "MTrk"
+#define HEADER_LENGTH (6)
+#define CHUNK_TYPE_LENGTH (4)
+#define STATUS_BIT (0x80)
+#define VLQ_CONTINUE (0x80)
+#define VLQ_MASK (0x7F)
+#define VLQ_SHIFT (7)
+#define VLQ_MAX_BYTES (5)
+#define BUFFER_MIN_CAPACITY (256)
+
+//  Bytes of one track chunk, built before its length is written
+typedef struct track_buffer_s {
+  uint8_t *data;
+  uint32_t size;
+  uint32_t capacity;
+} track_buffer_t;
+
+void buffer_reserve(track_buffer_t *buffer, uint32_t extra);
+void buffer_push(track_buffer_t *buffer, uint8_t byte);
+void buffer_push_vlq(track_buffer_t *buffer, uint32_t value);
+void buffer_append(track_buffer_t *buffer, const uint8_t *data,
+    uint32_t len);
+void write_track(FILE *file, track_t *track, track_buffer_t *buffer);
+void write_16(FILE *file, uint16_t value);
+void write_32(FILE *file, uint32_t value);
+
+/*
+ * grows the buffer so that it can hold extra more bytes
+ */
+
+void buffer_reserve(track_buffer_t *buffer, uint32_t extra) {
+  if (buffer->size + extra <= buffer->capacity) {
+    return;
+  }
+  uint32_t capacity = buffer->capacity ? buffer->capacity :
+    BUFFER_MIN_CAPACITY;
+  while (buffer->size + extra > capacity) {
+    capacity *= 2;
+  }
+  buffer->data = realloc(buffer->data, capacity);
+  assert(buffer->data);
+  buffer->capacity = capacity;
+} /* buffer_reserve() */
+
+/*
+ * appends one byte to the buffer
+ */
+
+void buffer_push(track_buffer_t *buffer, uint8_t byte) {
+  buffer_reserve(buffer, 1);
+  buffer->data[buffer->size++] = byte;
+} /* buffer_push() */
+
+/*
+ * appends the value to the buffer as a variable length quantity
+ */
+
+void buffer_push_vlq(track_buffer_t *buffer, uint32_t value) {
+  uint8_t bytes[VLQ_MAX_BYTES];
+  int count = 0;
+  do {
+    bytes[count++] = value & VLQ_MASK;
+    value >>= VLQ_SHIFT;
+  } while (value);
+  buffer_reserve(buffer, count);
+  while (count > 1) {
+    buffer->data[buffer->size++] = bytes[--count] | VLQ_CONTINUE;
+  }
+  buffer->data[buffer->size++] = bytes[0];
+} /* buffer_push_vlq() */
+
+/*
+ * appends len bytes of data to the buffer
+ */
+
+void buffer_append(track_buffer_t *buffer, const uint8_t *data,
+    uint32_t len) {
+  if (len == 0) {
+    return;
+  }
+  buffer_reserve(buffer, len);
+  memcpy(buffer->data + buffer->size, data, len);
+  buffer->size += len;
+} /* buffer_append() */
+
+/*
+ * writes a 16 bit value in big endian order
+ */
+
+void write_16(FILE *file, uint16_t value) {
+  uint8_t bytes[2] = { value >> 8, value & 0xFF };
+  int fwrite_return = fwrite(bytes, sizeof(uint8_t), 2, file);
+  assert(fwrite_return == 2);
+} /* write_16() */
+
+/*
+ * writes a 32 bit value in big endian order
+ */
+
+void write_32(FILE *file, uint32_t value) {
+  write_16(file, value >> 16);
+  write_16(file, value & 0xFFFF);
+} /* write_32() */
+
+/*
+ * writes the track as an MTrk chunk. Events read with running status are
+ * written without their status byte when it matches the previous MIDI
+ * event of the track, as they were read
+ */
+
+void write_track(FILE *file, track_t *track, track_buffer_t *buffer) {
+  buffer->size = 0;
+  uint8_t last_status = 0;
+  event_node_t *list = track->event_list;
+  while (list) {
+    event_t *event = list->event;
+    buffer_push_vlq(buffer, event->delta_time);
+    if (event->type == META_EVENT) {
+      buffer_push(buffer, META_EVENT);
+      buffer_push(buffer, meta_event_type(event));
+      buffer_push_vlq(buffer, event->meta_event.data_len);
+      buffer_append(buffer, event->meta_event.data,
+          event->meta_event.data_len);
+    }
+    else if ((event->type == SYS_EVENT_1) || (event->type == SYS_EVENT_2)) {
+      buffer_push(buffer, event->type);
+      buffer_push_vlq(buffer, event->sys_event.data_len);
+      buffer_append(buffer, event->sys_event.data,
+          event->sys_event.data_len);
+    }
+    else {
+      uint8_t status = event->midi_event.status;
+      if ((event->type & STATUS_BIT) || (status != last_status)) {
+        buffer_push(buffer, status);
+      }
+      last_status = status;
+      buffer_append(buffer, event->midi_event.data,
+          event->midi_event.data_len);
+    }
+    list = list->next_event;
+  }
+  int fwrite_return = fwrite(MTRK, sizeof(char), CHUNK_TYPE_LENGTH, file);
+  assert(fwrite_return == CHUNK_TYPE_LENGTH);
+  write_32(file, buffer->size);
+  fwrite_return = fwrite(buffer->data, sizeof(uint8_t), buffer->size,
+      file);
+  assert(fwrite_return == buffer->size);
+} /* write_track() */
+
+/*
+ * writes the song to the file at the given path as a standard MIDI file
+ */
+
+void write_song_data(song_data_t *song, char *path) {
+  assert(song);
+  assert(path);
+  FILE *file = fopen(path, "w");
+  assert(file != NULL);
+  uint16_t num_tracks = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    num_tracks++;
+    track_list = track_list->next_track;
+  }
+  int fwrite_return = fwrite(MTHD, sizeof(char), CHUNK_TYPE_LENGTH, file);
+  assert(fwrite_return == CHUNK_TYPE_LENGTH);
+  write_32(file, HEADER_LENGTH);
+  write_16(file, song->format);
+  write_16(file, num_tracks);
+  write_16(file, encode_division(&song->division));
+
+  track_buffer_t buffer = {0};
+  track_list = song->track_list;
+  while (track_list) {
+    write_track(file, track_list->track, &buffer);
+    track_list = track_list->next_track;
+  }
+  free(buffer.data);
+  buffer.data = NULL;
+  fclose(file);
+  file = NULL;
+} /* write_song_data() */
@@ -0,0 +1,151 @@
+/* Name, stats.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "stats.h"
+
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_SEC (1000000000)
+#define NS_PER_MS (1e6)
+#define NS_PER_US (1e3)
+
+stats_t g_stats = {0};
+
+#ifdef MIDI_STATS
+const bool g_stats_enabled = true;
+#else
+const bool g_stats_enabled = false;
+#endif // MIDI_STATS
+
+const char *COUNTER_NAMES[NUM_STAT_COUNTERS] = {
+  [STAT_SONGS_PARSED] = "songs_parsed",
+  [STAT_TRACKS_PARSED] = "tracks_parsed",
+  [STAT_MIDI_EVENTS] = "midi_events",
+  [STAT_META_EVENTS] = "meta_events",
+  [STAT_SYS_EVENTS] = "sys_events",
+  [STAT_BYTES_READ] = "bytes_read",
+  [STAT_ALLOCATIONS] = "allocations",
+  [STAT_BYTES_ALLOCATED] = "bytes_allocated",
+  [STAT_LIBRARY_INSERTS] = "library_inserts",
+  [STAT_INSERT_DEPTH] = "insert_depth",
+  [STAT_MAX_INSERT_DEPTH] = "max_insert_depth",
+};
+
+const char *TIMER_NAMES[NUM_STAT_TIMERS] = {
+  [TIMER_PARSE_FILE] = "parse_file",
+  [TIMER_PARSE_HEADER] = "parse_header",
+  [TIMER_PARSE_TRACK] = "parse_track",
+  [TIMER_PARSE_MIDI] = "parse_midi_event",
+  [TIMER_PARSE_META] = "parse_meta_event",
+  [TIMER_PARSE_SYS] = "parse_sys_event",
+  [TIMER_MAKE_LIBRARY] = "make_library",
+  [TIMER_CHANGE_OCTAVE] = "change_octave",
+  [TIMER_WARP_TIME] = "warp_time",
+  [TIMER_REMAP_INSTRUMENTS] = "remap_instruments",
+  [TIMER_REMAP_NOTES] = "remap_notes",
+  [TIMER_ADD_ROUND] = "add_round",
+};
+
+/*
+ * returns the monotonic clock in nanoseconds
+ */
+
+uint64_t stat_clock() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+} /* stat_clock() */
+
+/*
+ * raises the counter to value if it is below it
+ */
+
+void stat_max(stat_counter_t counter, uint64_t value) {
+  uint64_t current = __atomic_load_n(&g_stats.counters[counter],
+      __ATOMIC_RELAXED);
+  while ((current < value) &&
+      (!__atomic_compare_exchange_n(&g_stats.counters[counter], &current,
+        value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
+  }
+} /* stat_max() */
+
+/*
+ * records one call of the timer that began at the stat_clock() start
+ */
+
+void stat_stop(stat_timer_t timer, uint64_t start) {
+  uint64_t elapsed = stat_clock() - start;
+  timer_stats_t *stats = &g_stats.timers[timer];
+  __atomic_fetch_add(&stats->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats->total_ns, elapsed, __ATOMIC_RELAXED);
+  uint64_t current = __atomic_load_n(&stats->max_ns, __ATOMIC_RELAXED);
+  while ((current < elapsed) &&
+      (!__atomic_compare_exchange_n(&stats->max_ns, &current, elapsed, true,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
+  }
+} /* stat_stop() */
+
+/*
+ * clears every counter and timer
+ */
+
+void reset_stats() {
+  memset(&g_stats, 0, sizeof(g_stats));
+} /* reset_stats() */
+
+/*
+ * prints the counters and the timers that were called as a table
+ */
+
+void print_stats(FILE *file) {
+  if (!g_stats_enabled) {
+    fprintf(file, "Statistics are disabled, build with -DMIDI_STATS\n");
+    return;
+  }
+  fprintf(file, "Counters:\n");
+  for (int i = 0; i < NUM_STAT_COUNTERS; i++) {
+    fprintf(file, "  %-20s %14lu\n", COUNTER_NAMES[i], g_stats.counters[i]);
+  }
+  fprintf(file, "Timers:%21s %14s %14s %14s\n", "calls", "total ms",
+      "mean us", "max us");
+  for (int i = 0; i < NUM_STAT_TIMERS; i++) {
+    timer_stats_t *timer = &g_stats.timers[i];
+    if (timer->calls == 0) {
+      continue;
+    }
+    fprintf(file, "  %-20s %14lu %14.3f %14.3f %14.3f\n", TIMER_NAMES[i],
+        timer->calls, timer->total_ns / NS_PER_MS,
+        timer->total_ns / NS_PER_US / timer->calls,
+        timer->max_ns / NS_PER_US);
+  }
+} /* print_stats() */
+
+/*
+ * writes every counter and timer as a JSON object
+ */
+
+void write_stats_json(FILE *file) {
+  fprintf(file, "{\n  \"enabled\": %s", g_stats_enabled ? "true" : "false");
+  if (!g_stats_enabled) {
+    fprintf(file, "\n}\n");
+    return;
+  }
+  fprintf(file, ",\n  \"counters\": {\n");
+  for (int i = 0; i < NUM_STAT_COUNTERS; i++) {
+    fprintf(file, "    \"%s\": %lu%s\n", COUNTER_NAMES[i],
+        g_stats.counters[i], (i + 1 < NUM_STAT_COUNTERS) ? "," : "");
+  }
+  fprintf(file, "  },\n  \"timers\": {\n");
+  for (int i = 0; i < NUM_STAT_TIMERS; i++) {
+    timer_stats_t *timer = &g_stats.timers[i];
+    fprintf(file, "    \"%s\": {\"calls\": %lu, \"total_ns\": %lu, "
+        "\"max_ns\": %lu}%s\n", TIMER_NAMES[i], timer->calls,
+        timer->total_ns, timer->max_ns,
+        (i + 1 < NUM_STAT_TIMERS) ? "," : "");
+  }
+  fprintf(file, "  }\n}\n");
+} /* write_stats_json() */
@@ -0,0 +1,89 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//  Statistics are only recorded when built with -DMIDI_STATS. Otherwise
+//  every STAT_ macro expands to nothing and its arguments are not evaluated
+
+typedef enum stat_counter_e {
+  STAT_SONGS_PARSED,
+  STAT_TRACKS_PARSED,
+  STAT_MIDI_EVENTS,
+  STAT_META_EVENTS,
+  STAT_SYS_EVENTS,
+  STAT_BYTES_READ,
+  //  Allocations made while parsing and loading the library
+  STAT_ALLOCATIONS,
+  STAT_BYTES_ALLOCATED,
+  STAT_LIBRARY_INSERTS,
+  //  Sum and maximum of the depths songs were placed at in the library tree
+  STAT_INSERT_DEPTH,
+  STAT_MAX_INSERT_DEPTH,
+  NUM_STAT_COUNTERS
+} stat_counter_t;
+
+//  Timers nest, parse_file includes parse_header, parse_track and the event
+//  timers, and make_library includes the parse timers of its songs
+typedef enum stat_timer_e {
+  TIMER_PARSE_FILE,
+  TIMER_PARSE_HEADER,
+  TIMER_PARSE_TRACK,
+  TIMER_PARSE_MIDI,
+  TIMER_PARSE_META,
+  TIMER_PARSE_SYS,
+  TIMER_MAKE_LIBRARY,
+  TIMER_CHANGE_OCTAVE,
+  TIMER_WARP_TIME,
+  TIMER_REMAP_INSTRUMENTS,
+  TIMER_REMAP_NOTES,
+  TIMER_ADD_ROUND,
+  NUM_STAT_TIMERS
+} stat_timer_t;
+
+typedef struct timer_stats_s {
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t max_ns;
+} timer_stats_t;
+
+//  Updated with relaxed atomics, so threads may record at the same time
+typedef struct stats_s {
+  uint64_t counters[NUM_STAT_COUNTERS];
+  timer_stats_t timers[NUM_STAT_TIMERS];
+} stats_t;
+
+extern stats_t g_stats;
+extern const bool g_stats_enabled;
+
+uint64_t stat_clock();
+void stat_max(stat_counter_t, uint64_t);
+void stat_stop(stat_timer_t, uint64_t);
+void reset_stats();
+
+//  Reports
+void print_stats(FILE *);
+void write_stats_json(FILE *);
+
+#ifdef MIDI_STATS
+#define STAT_ADD(counter, amount) \
+  __atomic_fetch_add(&g_stats.counters[counter], (amount), __ATOMIC_RELAXED)
+#define STAT_MAX(counter, value) stat_max((counter), (value))
+#define STAT_ALLOC(bytes) \
+  do { \
+    STAT_ADD(STAT_ALLOCATIONS, 1); \
+    STAT_ADD(STAT_BYTES_ALLOCATED, (bytes)); \
+  } while (0)
+#define STAT_START(name) uint64_t name = stat_clock()
+#define STAT_STOP(timer, name) stat_stop((timer), (name))
+#else
+#define STAT_ADD(counter, amount) ((void) 0)
+#define STAT_MAX(counter, value) ((void) 0)
+#define STAT_ALLOC(bytes) ((void) 0)
+#define STAT_START(name) do { } while (0)
+#define STAT_STOP(timer, name) ((void) 0)
+#endif // MIDI_STATS
+
+#endif // _STATS_H
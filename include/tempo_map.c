@@ -0,0 +1,333 @@
+/* Name, tempo_map.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "tempo_map.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+#define TEMPO_LEN (3)
+#define TEMPO_MIN_CAPACITY (16)
+#define SMPTE_DROP_FRAME (29)
+#define SMPTE_DROP_RATE (2997)
+#define SMPTE_MAX_FPS (30)
+#define SMPTE_FPS_BITS (128)
+#define CENTI (100)
+#define MICROS_PER_CENTI_SECOND ((uint64_t) MICROS_PER_SECOND * CENTI)
+
+typedef struct tempo_change_s {
+  uint64_t tick;
+  uint32_t tempo;
+  uint16_t track;
+  uint32_t position;
+} tempo_change_t;
+
+int compare_tempo_changes(const void *change_1, const void *change_2);
+uint64_t scale_ticks(uint64_t value, uint64_t multiplier, uint64_t divisor);
+uint32_t tempo_point(tempo_map_t *map, uint64_t tick);
+uint32_t tempo_point_micros(tempo_map_t *map, uint64_t micros);
+
+/*
+ * returns value * multiplier / divisor without overflowing for any value
+ */
+
+uint64_t scale_ticks(uint64_t value, uint64_t multiplier, uint64_t divisor) {
+  return (value / divisor) * multiplier +
+    (value % divisor) * multiplier / divisor;
+} /* scale_ticks() */
+
+/*
+ * orders tempo changes by tick, then track, then position in the track
+ */
+
+int compare_tempo_changes(const void *change_1, const void *change_2) {
+  const tempo_change_t *first = change_1;
+  const tempo_change_t *second = change_2;
+  if (first->tick != second->tick) {
+    return (first->tick < second->tick) ? -1 : 1;
+  }
+  if (first->track != second->track) {
+    return (first->track < second->track) ? -1 : 1;
+  }
+  return (first->position < second->position) ? -1 :
+    (first->position > second->position);
+} /* compare_tempo_changes() */
+
+/*
+ * builds the tempo map of the song from its Set Tempo events
+ */
+
+tempo_map_t *build_tempo_map(song_data_t *song) {
+  assert(song);
+  tempo_map_t *map = malloc(sizeof(tempo_map_t));
+  assert(map);
+  map->uses_tpq = song->division.uses_tpq;
+  if (map->uses_tpq) {
+    map->resolution = song->division.ticks_per_qtr ?
+      song->division.ticks_per_qtr : 1;
+  }
+  else {
+    //  The frame rate is stored negated in 7 bits
+    uint32_t fps = song->division.frames_per_sec;
+    if (fps > SMPTE_MAX_FPS) {
+      fps = SMPTE_FPS_BITS - fps;
+    }
+    uint32_t rate = (fps == SMPTE_DROP_FRAME) ? SMPTE_DROP_RATE :
+      fps * CENTI;
+    map->resolution = rate * song->division.ticks_per_frame;
+    if (map->resolution == 0) {
+      map->resolution = 1;
+    }
+  }
+
+  //  SMPTE timing ignores tempo changes, but the song is still walked to
+  //  find its last tick
+  map->last_tick = 0;
+  uint32_t capacity = 0;
+  uint32_t count = 0;
+  tempo_change_t *changes = NULL;
+  uint16_t track = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    uint64_t tick = 0;
+    uint32_t position = 0;
+    event_node_t *event_list = track_list->track->event_list;
+    while (event_list) {
+      event_t *event = event_list->event;
+      tick += event->delta_time;
+      if ((map->uses_tpq) && (event->type == META_EVENT) &&
+          (event->meta_event.name == META_TABLE[SET_TEMPO].name) &&
+          (event->meta_event.data_len == TEMPO_LEN)) {
+        if (count == capacity) {
+          capacity = capacity ? capacity * 2 : TEMPO_MIN_CAPACITY;
+          changes = realloc(changes, sizeof(tempo_change_t) * capacity);
+          assert(changes);
+        }
+        uint8_t *data = event->meta_event.data;
+        changes[count++] = (tempo_change_t) {
+          tick, (data[0] << 16) | (data[1] << 8) | data[2], track, position
+        };
+      }
+      position++;
+      event_list = event_list->next_event;
+    }
+    if (tick > map->last_tick) {
+      map->last_tick = tick;
+    }
+    track++;
+    track_list = track_list->next_track;
+  }
+  if (count) {
+    qsort(changes, count, sizeof(tempo_change_t), compare_tempo_changes);
+  }
+
+  //  One extra breakpoint for the default tempo before the first change
+  map->ticks = malloc(sizeof(uint64_t) * (count + 1));
+  assert(map->ticks);
+  map->micros = malloc(sizeof(uint64_t) * (count + 1));
+  assert(map->micros);
+  map->tempos = malloc(sizeof(uint32_t) * (count + 1));
+  assert(map->tempos);
+  map->ticks[0] = 0;
+  map->micros[0] = 0;
+  map->tempos[0] = DEFAULT_TEMPO;
+  map->num_points = 1;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t last = map->num_points - 1;
+    uint32_t tempo = changes[i].tempo ? changes[i].tempo : 1;
+    if (changes[i].tick == map->ticks[last]) {
+      //  A later change on the same tick wins
+      map->tempos[last] = tempo;
+      continue;
+    }
+    map->ticks[map->num_points] = changes[i].tick;
+    map->micros[map->num_points] = map->micros[last] + scale_ticks(
+        changes[i].tick - map->ticks[last], map->tempos[last],
+        map->resolution);
+    map->tempos[map->num_points] = tempo;
+    map->num_points++;
+  }
+  free(changes);
+  changes = NULL;
+  return map;
+} /* build_tempo_map() */
+
+/*
+ * returns the tempo map of the song, building it the first time
+ */
+
+tempo_map_t *song_tempo_map(song_data_t *song) {
+  assert(song);
+  if (song->tempo_map == NULL) {
+    song->tempo_map = build_tempo_map(song);
+    account_song_caches(song);
+  }
+  return song->tempo_map;
+} /* song_tempo_map() */
+
+/*
+ * drops the tempo map of the song after its timing changed
+ */
+
+void invalidate_tempo_map(song_data_t *song) {
+  if (song->tempo_map) {
+    free_tempo_map(song->tempo_map);
+    song->tempo_map = NULL;
+    account_song_caches(song);
+  }
+} /* invalidate_tempo_map() */
+
+/*
+ * frees the memory associated with a tempo_map_t struct
+ */
+
+void free_tempo_map(tempo_map_t *map) {
+  free(map->ticks);
+  map->ticks = NULL;
+  free(map->micros);
+  map->micros = NULL;
+  free(map->tempos);
+  map->tempos = NULL;
+  free(map);
+  map = NULL;
+} /* free_tempo_map() */
+
+/*
+ * returns the number of bytes held by a tempo map, 0 if there is none
+ */
+
+uint64_t tempo_map_size(tempo_map_t *map) {
+  if (map == NULL) {
+    return 0;
+  }
+  return sizeof(tempo_map_t) + (uint64_t) map->num_points *
+    (sizeof(uint64_t) * 2 + sizeof(uint32_t));
+} /* tempo_map_size() */
+
+/*
+ * returns the last breakpoint at or before tick
+ */
+
+uint32_t tempo_point(tempo_map_t *map, uint64_t tick) {
+  uint32_t low = 0;
+  uint32_t high = map->num_points;
+  while (high - low > 1) {
+    uint32_t middle = low + (high - low) / 2;
+    if (map->ticks[middle] <= tick) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return low;
+} /* tempo_point() */
+
+/*
+ * returns the last breakpoint at or before the given time
+ */
+
+uint32_t tempo_point_micros(tempo_map_t *map, uint64_t micros) {
+  uint32_t low = 0;
+  uint32_t high = map->num_points;
+  while (high - low > 1) {
+    uint32_t middle = low + (high - low) / 2;
+    if (map->micros[middle] <= micros) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return low;
+} /* tempo_point_micros() */
+
+/*
+ * converts an absolute tick to microseconds from the start of the song
+ */
+
+uint64_t tick_to_micros(tempo_map_t *map, uint64_t tick) {
+  assert(map);
+  if (!map->uses_tpq) {
+    return scale_ticks(tick, MICROS_PER_CENTI_SECOND, map->resolution);
+  }
+  uint32_t point = tempo_point(map, tick);
+  return map->micros[point] + scale_ticks(tick - map->ticks[point],
+      map->tempos[point], map->resolution);
+} /* tick_to_micros() */
+
+/*
+ * converts microseconds from the start of the song to an absolute tick
+ */
+
+uint64_t micros_to_tick(tempo_map_t *map, uint64_t micros) {
+  assert(map);
+  if (!map->uses_tpq) {
+    return scale_ticks(micros, map->resolution, MICROS_PER_CENTI_SECOND);
+  }
+  uint32_t point = tempo_point_micros(map, micros);
+  return map->ticks[point] + scale_ticks(micros - map->micros[point],
+      map->resolution, map->tempos[point]);
+} /* micros_to_tick() */
+
+/*
+ * converts an absolute tick to seconds from the start of the song
+ */
+
+double tick_to_seconds(tempo_map_t *map, uint64_t tick) {
+  return tick_to_micros(map, tick) / (double) MICROS_PER_SECOND;
+} /* tick_to_seconds() */
+
+/*
+ * converts seconds from the start of the song to an absolute tick
+ */
+
+uint64_t seconds_to_tick(tempo_map_t *map, double seconds) {
+  if (seconds <= 0) {
+    return 0;
+  }
+  return micros_to_tick(map, (uint64_t) (seconds * MICROS_PER_SECOND));
+} /* seconds_to_tick() */
+
+/*
+ * converts count ticks to seconds. Sorted columns, such as a tick index, are
+ * converted by walking the breakpoints alongside them
+ */
+
+void ticks_to_seconds(tempo_map_t *map, const uint64_t *ticks,
+    double *seconds, uint32_t count) {
+  assert(map);
+  if (!map->uses_tpq) {
+    for (uint32_t i = 0; i < count; i++) {
+      seconds[i] = tick_to_seconds(map, ticks[i]);
+    }
+    return;
+  }
+  uint32_t point = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (ticks[i] < map->ticks[point]) {
+      point = tempo_point(map, ticks[i]);
+    }
+    while ((point + 1 < map->num_points) &&
+        (map->ticks[point + 1] <= ticks[i])) {
+      point++;
+    }
+    uint64_t micros = map->micros[point] + scale_ticks(
+        ticks[i] - map->ticks[point], map->tempos[point], map->resolution);
+    seconds[i] = micros / (double) MICROS_PER_SECOND;
+  }
+} /* ticks_to_seconds() */
+
+/*
+ * returns the length of the song in seconds
+ */
+
+double song_duration(song_data_t *song) {
+  tempo_map_t *map = song_tempo_map(song);
+  return tick_to_seconds(map, map->last_tick);
+} /* song_duration() */
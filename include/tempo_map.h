@@ -0,0 +1,41 @@
+#ifndef _TEMPO_MAP_H
+#define _TEMPO_MAP_H
+
+#include "parser.h"
+
+#define SET_TEMPO (0x51)
+#define DEFAULT_TEMPO (500000)
+#define MICROS_PER_SECOND (1000000)
+
+//  Tick/microsecond breakpoints, one per tempo change
+typedef struct tempo_map_s {
+  uint32_t num_points;
+  uint64_t *ticks;
+  uint64_t *micros;
+  //  Microseconds per quarter note from the breakpoint on
+  uint32_t *tempos;
+  //  Ticks per quarter note, or ticks per 100 seconds for SMPTE timing
+  uint32_t resolution;
+  bool uses_tpq;
+  //  Absolute tick of the last event of the song
+  uint64_t last_tick;
+} tempo_map_t;
+
+tempo_map_t *build_tempo_map(song_data_t *);
+tempo_map_t *song_tempo_map(song_data_t *);
+void invalidate_tempo_map(song_data_t *);
+void free_tempo_map(tempo_map_t *);
+uint64_t tempo_map_size(tempo_map_t *);
+
+//  Conversions, O(log n) in the number of tempo changes
+uint64_t tick_to_micros(tempo_map_t *, uint64_t);
+uint64_t micros_to_tick(tempo_map_t *, uint64_t);
+double tick_to_seconds(tempo_map_t *, uint64_t);
+uint64_t seconds_to_tick(tempo_map_t *, double);
+
+//  Batch conversion of a column of ticks, fastest when sorted
+void ticks_to_seconds(tempo_map_t *, const uint64_t *, double *, uint32_t);
+
+double song_duration(song_data_t *);
+
+#endif // _TEMPO_MAP_H
@@ -0,0 +1,298 @@
+/* Name, timeline.c, CS 24000, Spring 2020
+ * Last updated October 19, 2026
+ */
+
+/* Add any includes here */
+
+#include "timeline.h"
+#include "memory_usage.h"
+
+#include <assert.h>
+#include <malloc.h>
+
+bool timeline_before(timeline_event_t *event_1, timeline_event_t *event_2);
+void timeline_sift_down(timeline_t *timeline, uint16_t position);
+void timeline_sift_up(timeline_t *timeline, uint16_t position);
+void timeline_push(timeline_t *timeline, uint16_t track, uint32_t index);
+
+/*
+ * returns the tick index of the track, building it if needed
+ */
+
+tick_index_t *track_ticks(track_t *track) {
+  assert(track);
+  if (track->tick_index) {
+    return track->tick_index;
+  }
+  tick_index_t *index = malloc(sizeof(tick_index_t));
+  assert(index);
+  index->num_events = 0;
+  event_node_t *event_list = track->event_list;
+  while (event_list) {
+    index->num_events++;
+    event_list = event_list->next_event;
+  }
+  index->ticks = malloc(sizeof(uint64_t) *
+      (index->num_events ? index->num_events : 1));
+  assert(index->ticks);
+  index->events = malloc(sizeof(event_t *) *
+      (index->num_events ? index->num_events : 1));
+  assert(index->events);
+  event_list = track->event_list;
+  for (uint32_t i = 0; i < index->num_events; i++) {
+    index->events[i] = event_list->event;
+    event_list = event_list->next_event;
+  }
+  track->tick_index = index;
+  refresh_tick_index(track);
+  return index;
+} /* track_ticks() */
+
+/*
+ * recomputes the absolute ticks of an existing index after the delta-times
+ * of its track changed
+ */
+
+void refresh_tick_index(track_t *track) {
+  tick_index_t *index = track->tick_index;
+  if (index == NULL) {
+    return;
+  }
+  uint64_t tick = 0;
+  for (uint32_t i = 0; i < index->num_events; i++) {
+    tick += index->events[i]->delta_time;
+    index->ticks[i] = tick;
+  }
+} /* refresh_tick_index() */
+
+/*
+ * frees the tick index of the track, if it has one
+ */
+
+void free_tick_index(track_t *track) {
+  if (track->tick_index == NULL) {
+    return;
+  }
+  free(track->tick_index->ticks);
+  track->tick_index->ticks = NULL;
+  free(track->tick_index->events);
+  track->tick_index->events = NULL;
+  free(track->tick_index);
+  track->tick_index = NULL;
+} /* free_tick_index() */
+
+/*
+ * returns the number of bytes held by a tick index, 0 if there is none
+ */
+
+uint64_t tick_index_size(tick_index_t *index) {
+  if (index == NULL) {
+    return 0;
+  }
+  uint32_t size = index->num_events ? index->num_events : 1;
+  return sizeof(tick_index_t) +
+    (uint64_t) size * (sizeof(uint64_t) + sizeof(event_t *));
+} /* tick_index_size() */
+
+/*
+ * returns the position of the first event at or after tick
+ */
+
+uint32_t tick_lower_bound(tick_index_t *index, uint64_t tick) {
+  uint32_t low = 0;
+  uint32_t high = index->num_events;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (index->ticks[middle] < tick) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return low;
+} /* tick_lower_bound() */
+
+/*
+ * returns the number of events of the track in [start, end) and sets first
+ * to the position of the first of them
+ */
+
+uint32_t events_in_range(track_t *track, uint64_t start, uint64_t end,
+    uint32_t *first) {
+  tick_index_t *index = track_ticks(track);
+  uint32_t low = tick_lower_bound(index, start);
+  uint32_t high = (end > start) ? tick_lower_bound(index, end) : low;
+  if (first) {
+    *first = low;
+  }
+  return high - low;
+} /* events_in_range() */
+
+/*
+ * returns the absolute tick of the last event of the track
+ */
+
+uint64_t track_duration(track_t *track) {
+  tick_index_t *index = track_ticks(track);
+  if (index->num_events == 0) {
+    return 0;
+  }
+  return index->ticks[index->num_events - 1];
+} /* track_duration() */
+
+/*
+ * orders timeline events by tick, then track, then position in the track
+ */
+
+bool timeline_before(timeline_event_t *event_1, timeline_event_t *event_2) {
+  if (event_1->tick != event_2->tick) {
+    return event_1->tick < event_2->tick;
+  }
+  if (event_1->track != event_2->track) {
+    return event_1->track < event_2->track;
+  }
+  return event_1->index < event_2->index;
+} /* timeline_before() */
+
+/*
+ * restores the heap below position
+ */
+
+void timeline_sift_down(timeline_t *timeline, uint16_t position) {
+  timeline_event_t *heap = timeline->heap;
+  while (1) {
+    uint32_t smallest = position;
+    uint32_t left = 2 * (uint32_t) position + 1;
+    uint32_t right = left + 1;
+    if ((left < timeline->heap_size) &&
+        timeline_before(&heap[left], &heap[smallest])) {
+      smallest = left;
+    }
+    if ((right < timeline->heap_size) &&
+        timeline_before(&heap[right], &heap[smallest])) {
+      smallest = right;
+    }
+    if (smallest == position) {
+      return;
+    }
+    timeline_event_t swap = heap[position];
+    heap[position] = heap[smallest];
+    heap[smallest] = swap;
+    position = smallest;
+  }
+} /* timeline_sift_down() */
+
+/*
+ * restores the heap above position
+ */
+
+void timeline_sift_up(timeline_t *timeline, uint16_t position) {
+  timeline_event_t *heap = timeline->heap;
+  while (position > 0) {
+    uint16_t parent = (position - 1) / 2;
+    if (!timeline_before(&heap[position], &heap[parent])) {
+      return;
+    }
+    timeline_event_t swap = heap[position];
+    heap[position] = heap[parent];
+    heap[parent] = swap;
+    position = parent;
+  }
+} /* timeline_sift_up() */
+
+/*
+ * adds event index of track to the heap if the track has that many events
+ */
+
+void timeline_push(timeline_t *timeline, uint16_t track, uint32_t index) {
+  tick_index_t *ticks = timeline->indexes[track];
+  if (index >= ticks->num_events) {
+    return;
+  }
+  timeline->heap[timeline->heap_size] = (timeline_event_t) {
+    ticks->ticks[index], track, index, ticks->events[index]
+  };
+  timeline_sift_up(timeline, timeline->heap_size++);
+} /* timeline_push() */
+
+/*
+ * opens a merged timeline over every track of the song, starting at the
+ * first event at or after start_tick
+ */
+
+timeline_t *open_timeline(song_data_t *song, uint64_t start_tick) {
+  assert(song);
+  assert(song->format != 2);
+  timeline_t *timeline = malloc(sizeof(timeline_t));
+  assert(timeline);
+  timeline->num_tracks = 0;
+  track_node_t *track_list = song->track_list;
+  while (track_list) {
+    timeline->num_tracks++;
+    track_list = track_list->next_track;
+  }
+  uint16_t size = timeline->num_tracks ? timeline->num_tracks : 1;
+  timeline->indexes = malloc(sizeof(tick_index_t *) * size);
+  assert(timeline->indexes);
+  timeline->heap = malloc(sizeof(timeline_event_t) * size);
+  assert(timeline->heap);
+  track_list = song->track_list;
+  for (uint16_t i = 0; i < timeline->num_tracks; i++) {
+    timeline->indexes[i] = track_ticks(track_list->track);
+    track_list = track_list->next_track;
+  }
+  account_song_caches(song);
+  seek_timeline(timeline, start_tick);
+  return timeline;
+} /* open_timeline() */
+
+/*
+ * moves the timeline back or forward to the first event at or after tick
+ */
+
+void seek_timeline(timeline_t *timeline, uint64_t tick) {
+  assert(timeline);
+  timeline->heap_size = 0;
+  for (uint16_t i = 0; i < timeline->num_tracks; i++) {
+    timeline_push(timeline, i, tick_lower_bound(timeline->indexes[i], tick));
+  }
+} /* seek_timeline() */
+
+/*
+ * stores the next event of the timeline in next. Returns false once every
+ * track is exhausted
+ */
+
+bool timeline_next(timeline_t *timeline, timeline_event_t *next) {
+  assert(timeline);
+  if (timeline->heap_size == 0) {
+    return false;
+  }
+  *next = timeline->heap[0];
+  uint32_t index = next->index + 1;
+  tick_index_t *ticks = timeline->indexes[next->track];
+  if (index < ticks->num_events) {
+    timeline->heap[0] = (timeline_event_t) {
+      ticks->ticks[index], next->track, index, ticks->events[index]
+    };
+  }
+  else {
+    timeline->heap[0] = timeline->heap[--timeline->heap_size];
+  }
+  timeline_sift_down(timeline, 0);
+  return true;
+} /* timeline_next() */
+
+/*
+ * frees the timeline. The tick indexes stay with their tracks
+ */
+
+void close_timeline(timeline_t *timeline) {
+  free(timeline->indexes);
+  timeline->indexes = NULL;
+  free(timeline->heap);
+  timeline->heap = NULL;
+  free(timeline);
+  timeline = NULL;
+} /* close_timeline() */
@@ -0,0 +1,45 @@
+#ifndef _TIMELINE_H
+#define _TIMELINE_H
+
+#include "parser.h"
+
+//  Absolute tick of every event of a track, built lazily by track_ticks()
+typedef struct tick_index_s {
+  uint32_t num_events;
+  uint64_t *ticks;
+  event_t **events;
+} tick_index_t;
+
+//  One event of a merged timeline
+typedef struct timeline_event_s {
+  uint64_t tick;
+  uint16_t track;
+  uint32_t index;
+  event_t *event;
+} timeline_event_t;
+
+//  k-way merge of the tracks of a song in absolute time
+typedef struct timeline_s {
+  uint16_t num_tracks;
+  tick_index_t **indexes;
+  //  Binary min-heap of the next event of each unfinished track
+  uint16_t heap_size;
+  timeline_event_t *heap;
+} timeline_t;
+
+//  Per-track index
+tick_index_t *track_ticks(track_t *);
+void refresh_tick_index(track_t *);
+void free_tick_index(track_t *);
+uint64_t tick_index_size(tick_index_t *);
+uint32_t tick_lower_bound(tick_index_t *, uint64_t);
+uint32_t events_in_range(track_t *, uint64_t, uint64_t, uint32_t *);
+uint64_t track_duration(track_t *);
+
+//  Merged timeline
+timeline_t *open_timeline(song_data_t *, uint64_t);
+bool timeline_next(timeline_t *, timeline_event_t *);
+void seek_timeline(timeline_t *, uint64_t);
+void close_timeline(timeline_t *);
+
+#endif // _TIMELINE_H
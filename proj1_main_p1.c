@@ -1,20 +1,34 @@
 #include <assert.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <string.h>
 
 #include "parser.h"
 #include "library.h"
 
 #include "song_writer.h"
+#include "stats.h"
+#include "load_pipeline.h"
+#include "push_parser.h"
+
+#define STATS_OPTION (256)
+#define STDIN_PATH "-"
 
 #define USAGE \
 "Usage instructions:\n\n"\
 "  flags:\n"\
 "    -d directory_path   Reads in all of the .mid files in the specified"\
 " directory to create the library.\n"\
-"    -s song_path        Parses the specified midi file.\n"\
+"    -s song_path        Parses the specified midi file, or standard"\
+" input if the path is -.\n"\
 "    -w write_path       Writes the parsed midi file to the path specified"\
 " here. If the -s option is not also used, the -w option is ignored.\n"\
+"    -m                  Prints the memory held by the library, or by the"\
+" song if there is no library.\n"\
+"    --stats[=json]      Prints the parse, library and alteration counters"\
+" and timers on exit, as JSON if requested. They are only recorded when"\
+" built with -DMIDI_STATS. The table also shows the stages of the library"\
+" load.\n"\
 "    -h                  Display information on the options and"\
 " arguments supported.\n\n"\
 "  example usage:\n"\
@@ -41,8 +55,16 @@ int main(int argc, char **argv) {
   char *song_path = NULL;
   char *new_song_path = NULL;
   song_data_t *song = NULL;
+  bool show_stats = false;
+  bool stats_json = false;
+  bool show_memory = false;
+  struct option long_options[] = {
+    {"stats", optional_argument, NULL, STATS_OPTION},
+    {NULL, 0, NULL, 0}
+  };
 
-  while ((opt = getopt(argc, argv, ":hd:s:w:")) != -1) {
+  while ((opt = getopt_long(argc, argv, ":hmd:s:w:", long_options, NULL)) !=
+      -1) {
     switch (opt) {
       case 'h':
         printf(USAGE);
@@ -56,6 +78,18 @@ int main(int argc, char **argv) {
       case 'w':
         new_song_path = optarg;
         break;
+      case 'm':
+        show_memory = true;
+        break;
+      case STATS_OPTION:
+        show_stats = true;
+        if ((optarg) && (strcmp(optarg, "json") == 0)) {
+          stats_json = true;
+        }
+        else if (optarg) {
+          printf("unknown stats format: %s\n", optarg);
+        }
+        break;
       case ':':
         printf("option needs a value\n");
         break;
@@ -66,13 +100,26 @@ int main(int argc, char **argv) {
   }
 
   if (lib_dir_path) {
-    make_library(lib_dir_path);
+    int duplicates = make_library(lib_dir_path);
+    if (duplicates) {
+      printf("Skipped %d songs with the same name as another\n", duplicates);
+    }
     printf("Songs in %s:\n\n", lib_dir_path);
     write_song_list(stdout, g_song_library);
   }
 
   if (song_path) {
-    song = parse_file(song_path);
+    if (strcmp(song_path, STDIN_PATH) == 0) {
+      const char *error = NULL;
+      song = parse_unseekable(stdin, song_path, &error);
+      if (song == NULL) {
+        printf("could not parse standard input: %s\n", error);
+        return -1;
+      }
+    }
+    else {
+      song = parse_file(song_path);
+    }
     assert(song);
 
     if (new_song_path) {
@@ -81,12 +128,34 @@ int main(int argc, char **argv) {
     }
   }
 
+  if ((show_memory) && (lib_dir_path)) {
+    memory_usage_t usage = library_memory();
+    printf("Memory held by the library:\n");
+    print_memory_usage(stdout, &usage);
+  }
+  else if ((show_memory) && (song)) {
+    printf("Memory held by %s:\n", song_path);
+    print_memory_usage(stdout, &song->memory);
+  }
+
   if (lib_dir_path) {
+    free_melody_index(g_melody_index);
+    g_melody_index = NULL;
     free_library(g_song_library);
   }
   if (song_path) {
     free_song(song);
   }
 
+  if ((show_stats) && (stats_json)) {
+    write_stats_json(stdout);
+  }
+  else if (show_stats) {
+    print_stats(stdout);
+    if (lib_dir_path) {
+      print_load_stats(stdout, &g_last_load);
+    }
+  }
+
   return 0;
 }
\ No newline at end of file
@@ -1,12 +1,15 @@
 #include <gtk/gtk.h>
 
 #include "ui.h"
+#include "density.h"
 #include "ui_skeleton.c"
 int main(int argc, char* argv[])
 {
   setvbuf(stdout, NULL, _IONBF, 0);
   setvbuf(stderr, NULL, _IONBF, 0);
   setvbuf(stdin, NULL, _IONBF, 0);
+  //  Songs opened by the UI build their density cache for draw_cb()
+  g_density_on_load = true;
   GtkApplication* app = gtk_application_new("org.purdue.cs240proj", G_APPLICATION_FLAGS_NONE);
   g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
   int status = g_application_run(G_APPLICATION(app), argc, argv);